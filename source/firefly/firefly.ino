@@ -58,6 +58,15 @@
  *    standards compliant but gains 1318 bytes of storage.
  *  - Use uECC Optimiation level 1 (instead of 2); increases signing from 6s to 7.2s but
  *    gains 2168 bytes of storage.
+ *  - The signature is shown as a single version 4 QR code to scan once, as the
+ *    firefly_config library builds the QR code library with LOCK_VERSION 0 and
+ *    QR_MAX_VERSION 4; the mask and function patterns are then computed, and a streamed
+ *    QR code keeps its 137 byte module grid. On the host that build uses 1080 bytes of
+ *    stack to encode rather than 744. Removing those options from firefly_config.h
+ *    restores the library defaults (LOCK_VERSION 3, with the version 3 flash tables),
+ *    which show two version 3 QR codes (r and s). Version 4 tables would be another
+ *    1370 bytes of storage (8 masks and 2 function grids of 137 bytes), and the address
+ *    and pairing QR codes are version 3, so there is no LOCK_VERSION 4.
  */
 
 
@@ -98,12 +107,25 @@ static const uint8_t privateKey[] = {
 // received over BLECast.
 #define DEBUG_SERIAL  0
 
+// If non-zero, a signature that does not fit one QR code (without the firefly_config
+// QR code options; see Available Trade-offs) is shown as an animated QR code (see
+// firefly_qrcode_fountain.h) rather than as two QR codes. Nothing else is too large
+// for the screen yet, so this is for trying animated QR code receivers.
+#define ANIMATED_QRCODE  0
+
+
+// The options the libraries are built with (this must be included first, so the Arduino
+// IDE puts it on the include path of every library; see firefly_config.h)
+#include <firefly_config.h>
 
 // The Ethereum library (signing, parsing transactions and cryptographic hashes)
 #include <ethers.h>
 
 // A customied version of my QR code library, to improve memory, flash and storage space as needed
 #include <firefly_qrcode.h>
+#if ANIMATED_QRCODE
+#include <firefly_qrcode_fountain.h>
+#endif
 
 // A customized version of my BLECast library, to improve memory, flash and storage space as needed
 // In the future this will also be used for its AES implementation for encrypted private keys
@@ -137,6 +159,20 @@ typedef enum ErrorCode {
 #define EEPROM_DATA_OFFSET_ADDRESS_URI         (EEPROM_DATA_OFFSET_ADDRESS + EEPROM_DATA_LENGTH_ADDRESS)
 #define EEPROM_DATA_LENGTH_ADDRESS_URI         (9 + ETHERS_CHECKSUM_ADDRESS_LENGTH)   
 
+// The modules of the address and pairing QR codes (version 3; qrcode_getBufferSize(3) bytes)
+#define EEPROM_DATA_OFFSET_ADDRESS_QRCODE      (EEPROM_DATA_OFFSET_ADDRESS_URI + EEPROM_DATA_LENGTH_ADDRESS_URI)
+#define EEPROM_DATA_LENGTH_ADDRESS_QRCODE      (106)
+
+#define EEPROM_DATA_OFFSET_PAIRING_QRCODE      (EEPROM_DATA_OFFSET_ADDRESS_QRCODE + EEPROM_DATA_LENGTH_ADDRESS_QRCODE)
+#define EEPROM_DATA_LENGTH_PAIRING_QRCODE      (106)
+
+// The layout of the cached data; a Firefly with a cache from an older layout (even if
+// the checksum matches) regenerates it
+#define EEPROM_DATA_OFFSET_CACHE_VERSION       (EEPROM_DATA_OFFSET_PAIRING_QRCODE + EEPROM_DATA_LENGTH_PAIRING_QRCODE)
+#define EEPROM_DATA_LENGTH_CACHE_VERSION       (1)
+
+#define CACHE_VERSION                          (1)
+
 
 extern unsigned int __heap_start;
 extern void *__brkval;
@@ -176,6 +212,33 @@ int freeMemory() {
   return free_memory;
 }
 
+#if DEBUG_SERIAL == 1
+
+// The pattern paintStack fills the free memory with
+#define STACK_PAINT    (0xa5)
+
+// The lowest address the stack may grow down to (the top of the heap)
+static uint8_t* stackLimit() {
+    if ((int)__brkval == 0) { return (uint8_t*)(&__heap_start); }
+    return (uint8_t*)__brkval;
+}
+
+// Fills the free memory below this function's frame with STACK_PAINT, so stackUsed can
+// find the deepest the stack reaches afterwards
+static void __attribute__((noinline)) paintStack() {
+    uint8_t marker;
+    for (uint8_t *p = stackLimit(); p < &marker - 8; p++) { *p = STACK_PAINT; }
+}
+
+// Returns how many bytes below top the stack has reached since paintStack
+static uint16_t stackUsed(uint8_t *top) {
+    uint8_t *p = stackLimit();
+    while (p < top && *p == STACK_PAINT) { p++; }
+    return top - p;
+}
+
+#endif
+
 
 /**
  *  Our Hardware Configuration
@@ -221,6 +284,41 @@ void dumpFreeMemory() {
 #endif
 }
 
+// Shows the BLECast receive counters (enable BLECAST_STATS in firefly_blecast.h); packets
+// read on channels 37, 38 and 39, then PDU rejects, CRC failures, duplicates, stale
+// sessions, message CRC failures, decompress failures and resets
+static void dumpReceiveStats(BLECastMessage *message) {
+#if BLECAST_STATS
+    BLECastStats *stats = &message->stats;
+
+    display_clear(DISPLAY_ADDRESS);
+
+    display_debug_text(DISPLAY_ADDRESS, (const char*)"RX");
+    for (uint8_t i = 0; i < 3; i++) {
+        display_debug_char(DISPLAY_ADDRESS, '7' + i);
+        display_debug_int(DISPLAY_ADDRESS, stats->packets[i]);
+    }
+
+    display_debug_char(DISPLAY_ADDRESS, 'P');
+    display_debug_int(DISPLAY_ADDRESS, stats->pduRejects);
+    display_debug_char(DISPLAY_ADDRESS, 'C');
+    display_debug_int(DISPLAY_ADDRESS, stats->crcFailures);
+    display_debug_char(DISPLAY_ADDRESS, 'D');
+    display_debug_int(DISPLAY_ADDRESS, stats->duplicates);
+    display_debug_char(DISPLAY_ADDRESS, 'S');
+    display_debug_int(DISPLAY_ADDRESS, stats->staleSessions);
+    display_debug_char(DISPLAY_ADDRESS, 'M');
+    display_debug_int(DISPLAY_ADDRESS, stats->messageCrcFailures);
+    display_debug_char(DISPLAY_ADDRESS, 'Z');
+    display_debug_int(DISPLAY_ADDRESS, stats->decompressFailures);
+    display_debug_char(DISPLAY_ADDRESS, 'R');
+    display_debug_int(DISPLAY_ADDRESS, stats->resets);
+
+    waitForButton();
+    display_clear(DISPLAY_ADDRESS);
+#endif
+}
+
 static char getHexNibble(uint8_t value) {
     value &= 0x0f;
     if (value <= 9) { return '0' + value; }
@@ -279,15 +377,48 @@ static void writeStorage(uint16_t offset, uint16_t length, uint8_t *buffer) {
     }
 }
 
+static void expandHexNibbles(uint8_t *buffer, uint8_t length) {
+    for (int8_t i = length - 1; i >= 0; i--) {
+        buffer[2 * i + 1] = getHexNibble(buffer[i]);
+        buffer[2 * i + 0] = getHexNibble(buffer[i] >> 4);
+    }
+}
+
+// Writes the pairing URI (77 bytes, with the null termination) from the address and pairing
+// secret in EEPROM
+static void generatePairingURI(char *text) {
+    uint8_t *pairString = (uint8_t*)text;
+    pairString[0] = 'V';
+    pairString[1] = '0';
+    pairString[2] = '/';
+    pairString[43] = '/';
+    pairString[76] = 0;
+
+    // Put the raw binary in the pairing string and expand it into nibbles
+    readStorage(EEPROM_DATA_OFFSET_ADDRESS, EEPROM_DATA_LENGTH_ADDRESS, &pairString[3]);
+    expandHexNibbles(&pairString[3], 20);
+
+    // Put the secret key (for transmission) in the pairing string and expand it into nibbles
+    readStorage(EEPROM_DATA_OFFSET_PAIR_SECRET, EEPROM_DATA_LENGTH_PAIR_SECRET, &pairString[44]);
+    expandHexNibbles(&pairString[44], 16);
+}
+
 static void generateCache() {
     uint8_t checksum[32];
     ethers_keccak256(privateKey, 32, checksum);
     
     // Already generated all the cached data (note: this is written last like a journal commit)
-    if (equalsStorage(EEPROM_DATA_OFFSET_CHECKSUM, EEPROM_DATA_LENGTH_CHECKSUM, checksum)) {
+    uint8_t cacheVersion = CACHE_VERSION;
+    if (equalsStorage(EEPROM_DATA_OFFSET_CHECKSUM, EEPROM_DATA_LENGTH_CHECKSUM, checksum) &&
+      equalsStorage(EEPROM_DATA_OFFSET_CACHE_VERSION, EEPROM_DATA_LENGTH_CACHE_VERSION, &cacheVersion)) {
         return;
     }
 
+    // Space for the QR code modules, and the pairing URI they are generated from
+    uint8_t *modules = (uint8_t*)malloc(qrcode_getBufferSize(3) + 77);
+    if (!modules) { crash(ErrorCodeOutOfMemory, __LINE__); }
+    QRCode qrcode;
+
      // The largest amount of memory we need for anything we cache
     uint8_t scratch[9 + ETHERS_CHECKSUM_ADDRESS_LENGTH];
 
@@ -306,6 +437,11 @@ static void generateCache() {
 
     writeStorage(EEPROM_DATA_OFFSET_ADDRESS_URI, EEPROM_DATA_LENGTH_ADDRESS_URI, scratch);
 
+    // *********
+    // Generate the address QR code, so showing it only needs it read
+    qrcode_initText(&qrcode, modules, 3, ECC_LOW, (char*)scratch);
+    writeStorage(EEPROM_DATA_OFFSET_ADDRESS_QRCODE, EEPROM_DATA_LENGTH_ADDRESS_QRCODE, modules);
+
     // *********
     // Compute the pairing secret keccak(0x00 || keccak(privateKey))[:16]
     ethers_keccak256(checksum, 32, &scratch[33]);
@@ -315,59 +451,42 @@ static void generateCache() {
     writeStorage(EEPROM_DATA_OFFSET_PAIR_SECRET, EEPROM_DATA_LENGTH_PAIR_SECRET, scratch);
 
     // *********
-    // Compute the pairing secret keccak(0x00 || keccak(privateKey))[:16]
+    // Generate the pairing QR code (from the address and pairing secret stored above)
+    char *pairString = (char*)(&modules[qrcode_getBufferSize(3)]);
+    generatePairingURI(pairString);
+    qrcode_initText(&qrcode, modules, 3, ECC_LOW, pairString);
+    writeStorage(EEPROM_DATA_OFFSET_PAIRING_QRCODE, EEPROM_DATA_LENGTH_PAIRING_QRCODE, modules);
+
+    free(modules);
+
+    // *********
+    // Commit the cache; its layout and the checksum of the private key it was generated from
+    writeStorage(EEPROM_DATA_OFFSET_CACHE_VERSION, EEPROM_DATA_LENGTH_CACHE_VERSION, &cacheVersion);
     writeStorage(EEPROM_DATA_OFFSET_CHECKSUM, EEPROM_DATA_LENGTH_CHECKSUM, checksum);
 }
 
-static void showAddress() {
+// Shows a QR code cached in EEPROM by generateCache
+static void showCachedQRCode(uint16_t offset, uint16_t length) {
+    uint8_t *modules = (uint8_t*)malloc(length);
+    if (!modules) { crash(ErrorCodeOutOfMemory, __LINE__); }
 
-    // We use this scratch space for (QR Code module data) ("ethereum:" + checkSumAddress)
-    uint8_t qrCodeBufferSize = qrcode_getBufferSize(3);
-    uint8_t *scratch = (uint8_t*)malloc(qrCodeBufferSize + (9 + ETHERS_CHECKSUM_ADDRESS_LENGTH));
-
-    // Load the cached URI from EEPROM
-    readStorage(EEPROM_DATA_OFFSET_ADDRESS_URI, EEPROM_DATA_LENGTH_ADDRESS_URI, &scratch[qrCodeBufferSize]);
+    readStorage(offset, length, modules);
 
     QRCode qrcode;
-    qrcode_initText(&qrcode, &scratch[0], 3, 0, (char*)(&scratch[qrCodeBufferSize]));
+    qrcode_initModules(&qrcode, modules, 3, ECC_LOW);
     display_qrcodes(DISPLAY_ADDRESS, &qrcode, NULL);
 
-    free(scratch);
+    free(modules);
 }
 
-static void expandHexNibbles(uint8_t *buffer, uint8_t length) {
-    for (int8_t i = length - 1; i >= 0; i--) {
-        buffer[2 * i + 1] = getHexNibble(buffer[i]);
-        buffer[2 * i + 0] = getHexNibble(buffer[i] >> 4);
-    }
+static void showAddress() {
+    // "ethereum:" + checkSumAddress (see generateCache)
+    showCachedQRCode(EEPROM_DATA_OFFSET_ADDRESS_QRCODE, EEPROM_DATA_LENGTH_ADDRESS_QRCODE);
 }
 
 static void showPairingScreen() {
-    // We use this scratch space for (QR Code Address) (temporary space to generate string)
-    uint8_t qrCodeBufferSize = qrcode_getBufferSize(3);
-    uint8_t *scratch = (uint8_t*)malloc(qrCodeBufferSize + 77);
-
-    uint8_t *pairString = (&scratch[qrCodeBufferSize]);
-    pairString[0] = 'V';
-    pairString[1] = '0';
-    pairString[2] = '/';
-    pairString[43] = '/';
-    pairString[76] = 0;
-
-    // Put the raw binary in the pairing string and expand it into nibbles
-    readStorage(EEPROM_DATA_OFFSET_ADDRESS, EEPROM_DATA_LENGTH_ADDRESS, &pairString[3]);
-    expandHexNibbles(&pairString[3], 20);
-
-    // Put the secret key (for transmission) in the pairing string and expand it into nibbles
-    readStorage(EEPROM_DATA_OFFSET_PAIR_SECRET, EEPROM_DATA_LENGTH_PAIR_SECRET, &pairString[44]);
-    expandHexNibbles(&pairString[44], 16);
-
-    // Show the QR code
-    QRCode qrcode;
-    qrcode_initText(&qrcode, &scratch[0], 3, 0, (char*)pairString);
-    display_qrcodes(DISPLAY_ADDRESS, &qrcode, NULL);
-
-    free(scratch);
+    // "V0/" + address + "/" + pairing secret (see generatePairingURI)
+    showCachedQRCode(EEPROM_DATA_OFFSET_PAIRING_QRCODE, EEPROM_DATA_LENGTH_PAIRING_QRCODE);
 }
 
 #define SHOW_PAIRIING_SCREEN_DURATION      3000
@@ -378,7 +497,7 @@ static void showPairingScreen() {
 //       way for the sender to know a chunk has been received. The total message from the
 //       driver is a 1 byte command followed by the payload
 //
-//       Command 0: The payload (up to 779 bytes) is an unsigned Ethereum transacrtion
+//       Command 0: The payload (up to 764 bytes) is an unsigned Ethereum transacrtion
 //       Command 1: The payload (up to 128 bytes) is a printable-ASCII (plus \n) message
 //       Command 2: The payload (up to 48 bytes) is a binary message
 //
@@ -395,8 +514,8 @@ static void waitForTransaction(uint8_t unsignedTransactionHash[32]) {
     // The Serial library takes up extra space (buffers, etc), so we cannot have as large a message
     const uint16_t messageDataSize = 256;
 #else
-    // 780 will hold 60 payloads (12 bytes data + 1 byte marker) for a total payload of 720 bytes
-    const uint16_t messageDataSize = 780;
+    // 765 will hold all 64 payloads (12 bytes data each, less the 3 byte message CRC)
+    const uint16_t messageDataSize = 765;
 #endif
 
     // Allocate a buffer to receive the message (payload)
@@ -436,6 +555,8 @@ static void waitForTransaction(uint8_t unsignedTransactionHash[32]) {
         bool foundMessage = blecast_poll(&message);
         if (!foundMessage) { continue; }
 
+        dumpReceiveStats(&message);
+
         Transaction transaction;
 
         // Check if this message is a valid transaction
@@ -513,10 +634,45 @@ static void waitForTransaction(uint8_t unsignedTransactionHash[32]) {
     }
 }
 
+#if QR_LARGEST_VERSION >= 4
+
+// "SIG:RS/" and the Base45 of r and s (3 characters per 2 bytes), in one QR code
+#define SIGNATURE_URI_LENGTH    (7 + 3 * ETHERS_SIGNATURE_LENGTH / 2)
+#define SIGNATURE_QRCODES       1
+
+// Note: The URI is generated entirely using upper-case letters and symbols available
+//       in the QR code standard for Alphanumeric types (Base45 packs 16 bits into 3
+//       characters, which is 16.5 bits of QR data, where hex takes 22), so the whole
+//       signature fits in a single version 4 QR code (of 114 available characters,
+//       this uses 103)
+static void generateSignatureURI(uint8_t *signature, char *text) {
+    // URI Scheme; i.e. "SIG:"
+    text[0] = 'S';
+    text[1] = 'I';
+    text[2] = 'G';
+    text[3] = ':';
+
+    // URI path prefix; i.e. "RS/"
+    text[4] = 'R';
+    text[5] = 'S';
+    text[6] = '/';
+
+    // Null termination
+    text[SIGNATURE_URI_LENGTH] = 0;
+
+    // URI path; i.e. Base45(r || s)
+    qrcode_base45Encode(signature, ETHERS_SIGNATURE_LENGTH, &text[7]);
+}
+
+#else
+
+// "SIG:R/" or "SIG:S/" and the hex of r or s, in one QR code each
+#define SIGNATURE_URI_LENGTH    (6 + 64)
+#define SIGNATURE_QRCODES       2
 
 // Note: The URI is generated entirely using upper-case letters and symbols available
 //       in the QR code standard for Alphanumeric types, so that everything fits in a
-//       version 3 QR code (of 77 available characters, this uses 71)
+//       version 3 QR code (of 77 available characters, this uses 70)
 static void generateSignatureURI(char component, uint8_t *signature, char *text) {
     // URI Scheme; i.e. "SIG:"
     text[0] = 'S';
@@ -529,7 +685,7 @@ static void generateSignatureURI(char component, uint8_t *signature, char *text)
     text[5] = '/';
 
     // Null termination
-    text[7 + 64 - 1] = 0;
+    text[SIGNATURE_URI_LENGTH] = 0;
 
     // URI path; i.e. "[0-9A-F]{64}"
     uint8_t offset = 6;
@@ -539,29 +695,135 @@ static void generateSignatureURI(char component, uint8_t *signature, char *text)
     }
 }
 
+#endif
+
+
+#if ANIMATED_QRCODE
+
+// How long each frame of an animated QR code is shown (in ms)
+#define ANIMATED_FRAME_DURATION    250
+
+// Reads a payload kept in memory (context) for showAnimatedQRCode
+static void readMemory(void *context, uint16_t offset, uint8_t *buffer, uint8_t length) {
+    memcpy(buffer, &((uint8_t*)context)[offset], length);
+}
 
+// Shows a payload too large for one QR code as an animated QR code, until the button is
+// pressed. Each frame (see firefly_qrcode_fountain.h) is "FTN:" and the Base45 of as much
+// of the payload as fits the largest QR code (72 bytes in version 4, 48 in version 3);
+// frames are generated (reading the payload through reader) as they are shown, and a
+// receiver can rebuild the payload from any frames it catches, with 1 or 2 to spare.
+static void showAnimatedQRCode(QRFountainReader reader, void *context, uint16_t length) {
+    // Frames are at most 254 bytes (versions over 8 could hold more)
+    uint16_t capacity = (qrcode_getCapacity(QR_LARGEST_VERSION, ECC_LOW, MODE_ALPHANUMERIC) - 4) / 3;
+    uint8_t frameSize = 2 * ((capacity < 127) ? capacity: 127);
+    uint16_t textLength = 4 + 3 * frameSize / 2;
+
+    QRFountain fountain;
+    if (!qrfountain_init(&fountain, reader, context, length, frameSize)) { crash(ErrorCodeOutOfMemory, __LINE__); }
+
+    // We use this scratch space for: (QR Code) (frame) (frame URI)
+    uint8_t qrCodeBufferSize = qrcode_getCodewordsSize(QR_LARGEST_VERSION);
+    uint8_t *scratch = (uint8_t*)malloc(qrCodeBufferSize + frameSize + (textLength + 1));
+    if (!scratch) { crash(ErrorCodeOutOfMemory, __LINE__); }
+
+    uint8_t *frame = &scratch[qrCodeBufferSize];
+    char *text = (char*)(&frame[frameSize]);
+
+    // URI Scheme; i.e. "FTN:"
+    text[0] = 'F';
+    text[1] = 'T';
+    text[2] = 'N';
+    text[3] = ':';
+    text[textLength] = 0;
+
+    // Every frame uses the same version, so the code does not change size as it animates
+    QRCode qrcode;
+    while (true) {
+        uint32_t frameStart = millis();
+
+        qrfountain_nextFrame(&fountain, frame);
+        qrcode_base45Encode(frame, frameSize, &text[4]);
+        qrcode_initStreamedText(&qrcode, &scratch[0], QR_LARGEST_VERSION, ECC_LOW, text);
+        display_qrcodes(DISPLAY_ADDRESS, &qrcode, NULL);
+
+        // Show the frame for the rest of its duration, unless the button is pressed
+        while (millis() - frameStart < ANIMATED_FRAME_DURATION) {
+            if (digitalRead(BUTTON_PIN)) {
+                free(scratch);
+                return;
+            }
+            delay(10);
+        }
+    }
+}
+
+#endif
+
+
+// The signature is one version 4 QR code if the QR code library is built for it (as
+// firefly_config.h does), otherwise two version 3 QR codes (r and s), or an animated QR
+// code with ANIMATED_QRCODE
 static void showSignedTransaction(uint8_t *signature) {
-    uint8_t qrCodeBufferSize = qrcode_getBufferSize(3);
+#if ANIMATED_QRCODE && SIGNATURE_QRCODES > 1
+    showAnimatedQRCode(readMemory, signature, ETHERS_SIGNATURE_LENGTH);
+    return;
+#endif
 
-    // We use this scratch space for: (QR Code R) (QR Code S) (temporary space to generate string)
-    uint8_t *scratch = (uint8_t*)malloc(2 * qrCodeBufferSize + (7 + 64));
+    // The QR codes are streamed to the display, so only their codewords are kept (71 bytes
+    // each at version 3, rather than a 106 byte module grid; without QR_FUNCTION_TABLES,
+    // the grid); they are sized for the largest version, as the version is picked once the
+    // URI is generated
+    uint8_t qrCodeBufferSize = qrcode_getCodewordsSize(QR_LARGEST_VERSION);
+
+    // We use this scratch space for: (QR Code, or QR Codes R and S) (temporary space to generate string)
+    uint8_t *scratch = (uint8_t*)malloc(SIGNATURE_QRCODES * qrCodeBufferSize + (SIGNATURE_URI_LENGTH + 1));
     if (!scratch) { crash(ErrorCodeOutOfMemory, __LINE__); }
-    
-    char *text = (char*)(&scratch[2 * qrCodeBufferSize]);
 
+    char *text = (char*)(&scratch[SIGNATURE_QRCODES * qrCodeBufferSize]);
+
+#if DEBUG_SERIAL == 1
+    // Time generating the QR codes (mostly scoring the 8 mask patterns of each), and find
+    // the most stack they use below this frame
+    uint8_t stackTop;
+    paintStack();
+    uint32_t qrStart = micros();
+#endif
+
+#if QR_LARGEST_VERSION >= 4
+    generateSignatureURI(signature, text);
+
+    uint8_t version = qrcode_getMinimumVersion(ECC_LOW, (uint8_t*)text, SIGNATURE_URI_LENGTH);
+    if (version == 0) { crash(ErrorCodeOutOfMemory, __LINE__); }
+
+    QRCode qrcode;
+    qrcode_initStreamedText(&qrcode, &scratch[0], version, ECC_LOW, text);
+#else
     // SIG:R/XXXX
     generateSignatureURI('R', &signature[0], text);
 
     QRCode qrcodeR;
-    qrcode_initText(&qrcodeR, &scratch[0], 3, 0, text);
+    qrcode_initStreamedText(&qrcodeR, &scratch[0], 3, ECC_LOW, text);
 
     // SIG:S/XXXX
     generateSignatureURI('S', &signature[32], text);
 
     QRCode qrcodeS;
-    qrcode_initText(&qrcodeS, &scratch[qrCodeBufferSize], 3, 0, text);
+    qrcode_initStreamedText(&qrcodeS, &scratch[qrCodeBufferSize], 3, ECC_LOW, text);
+#endif
 
+#if DEBUG_SERIAL == 1
+    Serial.print("QR codes (us): ");
+    Serial.println(micros() - qrStart);
+    Serial.print("QR codes stack (bytes): ");
+    Serial.println(stackUsed(&stackTop));
+#endif
+
+#if QR_LARGEST_VERSION >= 4
+    display_qrcodes(DISPLAY_ADDRESS, &qrcode, NULL);
+#else
     display_qrcodes(DISPLAY_ADDRESS, &qrcodeR, &qrcodeS);
+#endif
 
     free(scratch);
 }
@@ -609,6 +871,12 @@ void setup() {
     // Show the wallet address
     showAddress();
 
+#if DEBUG_SERIAL == 1
+    // From reset until the address is on the display
+    Serial.print("Address screen (us): ");
+    Serial.println(micros());
+#endif
+
     // Wait for a valid transaction over BLECast and compute its hash
     uint8_t unsignedTransactionHash[ETHERS_KECCAK256_LENGTH];
     waitForTransaction(unsignedTransactionHash);
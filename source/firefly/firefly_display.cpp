@@ -408,15 +408,52 @@ void display_debug_buffer(uint8_t address, uint8_t *value, uint16_t length) {
 }
 
 
+// Each QR code is drawn in a 64x64 pixel square, with modules scaled to the largest whole
+// number of pixels that leaves at least 2 pixels of border (so version 10, of 57 modules, is
+// the largest that fits). A page (8 pixel rows) spans at most 5 rows of 2 pixel modules or
+// 8 rows of 1 pixel modules (so the stripe is sized by the largest version supported).
+#if QR_LARGEST_VERSION <= 3
+#define QRCODE_STRIPE_BITS                  (5 * (4 * QR_LARGEST_VERSION + 17))
+#elif QR_LARGEST_VERSION <= 10
+#define QRCODE_STRIPE_BITS                  (8 * (4 * QR_LARGEST_VERSION + 17))
+#else
+#define QRCODE_STRIPE_BITS                  (8 * 57)
+#endif
+
 void display_qrcode(DisplayContext *context, QRCode *qrcode, uint8_t py) {
+     uint8_t size = qrcode->size;
+     uint8_t scale = (64 - 2 * 2) / size;
+
+     uint8_t border = (64 - scale * size) / 2;
+     uint8_t by = py * 8;
+
+     // Too large to show, or this page is all border
+     if (scale == 0 || by + 7 < border || by >= border + scale * size) {
+         display_chunks(context, 0xff, 64);
+         return;
+     }
+
+     // Only the module rows of this page are generated (see qrcode_getStripe), so with
+     // QR_FUNCTION_TABLES a streamed QR code never has its full module grid in memory
+     // (without them, it keeps its module grid and the rows are copied)
+     uint8_t top = (by < border) ? 0: (by - border) / scale;
+     uint8_t stripe[(QRCODE_STRIPE_BITS + 7) / 8];
+     qrcode_getStripe(qrcode, top, (by + 7 - border) / scale - top + 1, stripe);
+
      for (uint8_t x = 0; x < 64; x++) {
-          uint8_t by = py * 8;
           uint8_t col = 0;
 
           for (uint8_t y = 0; y < 8; y++) {
-              if (x < 3 || x >= 64 - 3 || by + y < 3 || by + y >= 64 -3 || !qrcode_getModule(qrcode, (x - 3) / 2, (by + y - 3) / 2)) {
+              uint8_t mx = (x - border) / scale, my = (by + y - border) / scale;
+              if (x < border || by + y < border || mx >= size || my >= size) {
+                  col |= (1 << y);
+                  continue;
+              }
+
+              uint16_t offset = (my - top) * size + mx;
+              if (!(stripe[offset >> 3] & (0x80 >> (offset & 0x07)))) {
                   col |= (1 << y);
-               }
+              }
           }
           display_chunk(context, col);
      }
@@ -0,0 +1,115 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018 Richard Moore <me@ricmoo.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/**
+ *  aes_test - the FIPS-197 AES-128 known answers (Appendix B and C.1) for each
+ *  AES function the receiver and the reference encoder use; the on-the-fly
+ *  decrypt (and its start key), the key schedule decrypt and the on-the-fly
+ *  encrypt.
+ *
+ *  Build (from this folder; add -DAES_SBOX_TABLE=0 for the computed S-box, or
+ *  run: make test, which tests both):
+ *    cc -O2 -I../src aes_test.c ../src/aes-otfks-encrypt.c \
+ *        ../src/aes-otfks-decrypt.c ../src/aes-decrypt.c -o aes_test
+ *
+ *  Usage:
+ *    aes_test
+ *
+ *    Prints each failure; exits with 1 if anything failed.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "aes.h"
+
+
+typedef struct KnownAnswer {
+    const char *name;
+    uint8_t key[AES128_KEY_SIZE];
+    uint8_t plaintext[AES_BLOCK_SIZE];
+    uint8_t ciphertext[AES_BLOCK_SIZE];
+
+    // The last round key (the on-the-fly decrypt start key)
+    uint8_t lastRoundKey[AES128_KEY_SIZE];
+} KnownAnswer;
+
+static const KnownAnswer knownAnswers[] = {
+    {
+        "FIPS-197 Appendix B",
+        { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c },
+        { 0x32, 0x43, 0xf6, 0xa8, 0x88, 0x5a, 0x30, 0x8d, 0x31, 0x31, 0x98, 0xa2, 0xe0, 0x37, 0x07, 0x34 },
+        { 0x39, 0x25, 0x84, 0x1d, 0x02, 0xdc, 0x09, 0xfb, 0xdc, 0x11, 0x85, 0x97, 0x19, 0x6a, 0x0b, 0x32 },
+        { 0xd0, 0x14, 0xf9, 0xa8, 0xc9, 0xee, 0x25, 0x89, 0xe1, 0x3f, 0x0c, 0xc8, 0xb6, 0x63, 0x0c, 0xa6 }
+    },
+    {
+        "FIPS-197 Appendix C.1",
+        { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f },
+        { 0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff },
+        { 0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30, 0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a },
+        { 0x13, 0x11, 0x1d, 0x7f, 0xe3, 0x94, 0x4a, 0x17, 0xf3, 0x07, 0xa7, 0x8b, 0x4d, 0x2b, 0x30, 0xc5 }
+    }
+};
+
+
+static int failures = 0;
+
+static void check(const char *name, const char *function, const uint8_t *result, const uint8_t *expected) {
+    if (!memcmp(result, expected, AES_BLOCK_SIZE)) { return; }
+
+    failures++;
+    printf("FAIL %s: %s\n", name, function);
+}
+
+int main(void) {
+    for (uint8_t i = 0; i < sizeof(knownAnswers) / sizeof(knownAnswers[0]); i++) {
+        const KnownAnswer *test = &knownAnswers[i];
+        uint8_t block[AES_BLOCK_SIZE], key[AES128_KEY_SIZE];
+
+        memcpy(key, test->key, AES128_KEY_SIZE);
+        aes128_otfks_decrypt_start_key(key);
+        check(test->name, "aes128_otfks_decrypt_start_key", key, test->lastRoundKey);
+
+        memcpy(block, test->ciphertext, AES_BLOCK_SIZE);
+        aes128_otfks_decrypt(block, key);
+        check(test->name, "aes128_otfks_decrypt", block, test->plaintext);
+
+        uint8_t schedule[AES128_KEY_SCHEDULE_SIZE];
+        aes128_key_schedule(schedule, test->key);
+        check(test->name, "aes128_key_schedule", &schedule[AES128_KEY_SCHEDULE_SIZE - AES_BLOCK_SIZE], test->lastRoundKey);
+
+        memcpy(block, test->ciphertext, AES_BLOCK_SIZE);
+        aes128_decrypt(block, schedule);
+        check(test->name, "aes128_decrypt", block, test->plaintext);
+
+        memcpy(key, test->key, AES128_KEY_SIZE);
+        memcpy(block, test->plaintext, AES_BLOCK_SIZE);
+        aes128_otfks_encrypt(block, key);
+        check(test->name, "aes128_otfks_encrypt", block, test->ciphertext);
+    }
+
+    printf("AES_SBOX_TABLE=%d: %s\n", AES_SBOX_TABLE, failures ? "FAILED": "passed");
+
+    return failures ? 1: 0;
+}
@@ -0,0 +1,115 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018 Richard Moore <me@ricmoo.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/**
+ *  blecast_corpus - reports the payload counts of a corpus of messages, with and
+ *  without compression, to measure how many fewer payloads (and so how much less
+ *  time receiving) compression needs for typical messages.
+ *
+ *  Build (from this folder; or run: make tools):
+ *    cc -O2 -DCRC24_TABLE=CRC24_TABLE_SLICE8 -I../src blecast_corpus.c ../src/firefly_blecast_encoder.c \
+ *        ../src/crc24.c ../src/aes-otfks-encrypt.c ../src/aes-otfks-decrypt.c \
+ *        -o blecast_corpus
+ *
+ *  Usage:
+ *    blecast_corpus < CORPUS
+ *
+ *    The corpus is one message per line (hex); blank lines and lines starting
+ *    with # are ignored.
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "firefly_blecast_encoder.h"
+
+
+static int parseHex(const char *hex, uint8_t *data, int maxLength) {
+    int length = 0;
+    while (isxdigit((unsigned char)hex[0]) && isxdigit((unsigned char)hex[1])) {
+        unsigned int value;
+        if (length == maxLength || sscanf(hex, "%2x", &value) != 1) { return -1; }
+        data[length++] = value;
+        hex += 2;
+    }
+
+    return (*hex == 0 || isspace((unsigned char)*hex)) ? length: -1;
+}
+
+int main(void) {
+    const uint8_t key[16] = { 0 };
+
+    char line[4 * BLECAST_ENCODER_MAX_LENGTH];
+    int lineNo = 0, count = 0;
+    unsigned long totalBytes = 0, totalCompressedBytes = 0;
+    unsigned long totalPayloads = 0, totalCompressedPayloads = 0;
+
+    printf("%6s  %6s  %10s  %8s  %10s\n", "line", "bytes", "compressed", "payloads", "compressed");
+
+    while (fgets(line, sizeof(line), stdin)) {
+        lineNo++;
+
+        const char *hex = line;
+        while (isspace((unsigned char)*hex)) { hex++; }
+        if (*hex == 0 || *hex == '#') { continue; }
+        if (hex[0] == '0' && (hex[1] == 'x' || hex[1] == 'X')) { hex += 2; }
+
+        uint8_t message[BLECAST_ENCODER_MAX_LENGTH];
+        int length = parseHex(hex, message, sizeof(message));
+        if (length < 0) {
+            fprintf(stderr, "Line %d: invalid or too long\n", lineNo);
+            continue;
+        }
+
+        BLECastEncoder encoder;
+        blecast_encoder_init(&encoder, key, message, length, 0, 0);
+
+        // The sender only compresses when it saves payloads
+        uint8_t compressed[BLECAST_ENCODER_MAX_LENGTH];
+        uint16_t compressedLength = blecast_encoder_compress(message, length, compressed, sizeof(compressed));
+
+        BLECastEncoder compressedEncoder = encoder;
+        if (compressedLength) {
+            blecast_encoder_initCompressed(&compressedEncoder, key, compressed, compressedLength, 0, 0);
+            if (compressedEncoder.payloadCount >= encoder.payloadCount) { compressedEncoder = encoder; }
+        }
+
+        printf("%6d  %6d  %10d  %8d  %10d\n", lineNo, length, compressedLength,
+          encoder.payloadCount, compressedEncoder.payloadCount);
+
+        count++;
+        totalBytes += length;
+        totalCompressedBytes += compressedLength ? compressedLength: length;
+        totalPayloads += encoder.payloadCount;
+        totalCompressedPayloads += compressedEncoder.payloadCount;
+    }
+
+    if (count == 0) { return 1; }
+
+    printf("\n%d messages; %lu bytes compressed to %lu, %lu payloads to %lu (%.1f%% fewer)\n",
+      count, totalBytes, totalCompressedBytes, totalPayloads, totalCompressedPayloads,
+      100.0 * (totalPayloads - totalCompressedPayloads) / totalPayloads);
+
+    return 0;
+}
@@ -0,0 +1,158 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018 Richard Moore <me@ricmoo.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ *  blecast_encode - writes the BLECast packets for a message, as they are read
+ *  from the radio by the receiver (17 bytes each; the PDU header and the 16 byte
+ *  payload), so the receiver can be tested and benchmarked without a radio.
+ *
+ *  Build (from this folder; or run: make tools):
+ *    cc -O2 -DBLECAST_ERASURE_CODING=1 -DCRC24_TABLE=CRC24_TABLE_SLICE8 -I../src -I../../firefly_qrcode/src \
+ *        blecast_encode.c ../src/firefly_blecast_encoder.c ../src/crc24.c \
+ *        ../src/aes-otfks-encrypt.c ../src/aes-otfks-decrypt.c \
+ *        ../../firefly_qrcode/src/firefly_qrcode.c -o blecast_encode
+ *
+ *  Usage:
+ *    blecast_encode -k KEY [-m MESSAGE] [-c CHANNEL] [-s SESSION] [-p PARITY]
+ *        [-r ROUNDS] [-o FILE] [-z]
+ *
+ *    -k KEY       The 16 byte AES-128 key (hex)
+ *    -m MESSAGE   The message (hex); otherwise the message is read from stdin. Over
+ *                 765 bytes (up to 196605) it is sent as an extended message
+ *    -c CHANNEL   The advertising channel; 37 (default), 38 or 39
+ *    -s SESSION   The session tag; 0 (default, untagged) to 15
+ *    -p PARITY    The number of parity payloads (default: 0)
+ *    -r ROUNDS    The number of times to repeat the payloads (default: 1)
+ *    -o FILE      The output file (default: stdout)
+ *    -z           Compress the message, if that requires fewer payloads (the
+ *                 receiver must be built with BLECAST_COMPRESSION)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "firefly_blecast_encoder.h"
+
+
+static int parseHex(const char *hex, uint8_t *data, int maxLength) {
+    int length = strlen(hex);
+    if (length % 2 || length / 2 > maxLength) { return -1; }
+
+    for (int i = 0; i < length / 2; i++) {
+        unsigned int value;
+        if (sscanf(&hex[2 * i], "%2x", &value) != 1) { return -1; }
+        data[i] = value;
+    }
+
+    return length / 2;
+}
+
+static void usage(const char *name) {
+    fprintf(stderr, "Usage: %s -k KEY [-m MESSAGE] [-c CHANNEL] [-s SESSION] [-p PARITY] [-r ROUNDS] [-o FILE] [-z]\n", name);
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    uint8_t key[16];
+    bool hasKey = false;
+
+    static uint8_t message[BLECAST_ENCODER_MAX_EXTENDED_LENGTH + 1];
+    int length = -1;
+
+    int channel = 37, session = 0, parity = 0, rounds = 1;
+    const char *filename = NULL;
+    bool compress = false;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "k:m:c:s:p:r:o:z")) != -1) {
+        switch (opt) {
+            case 'k':
+                if (parseHex(optarg, key, sizeof(key)) != sizeof(key)) { usage(argv[0]); }
+                hasKey = true;
+                break;
+            case 'm':
+                length = parseHex(optarg, message, BLECAST_ENCODER_MAX_EXTENDED_LENGTH);
+                if (length < 0) { usage(argv[0]); }
+                break;
+            case 'c': channel = atoi(optarg); break;
+            case 's': session = atoi(optarg); break;
+            case 'p': parity = atoi(optarg); break;
+            case 'r': rounds = atoi(optarg); break;
+            case 'o': filename = optarg; break;
+            case 'z': compress = true; break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    if (!hasKey || channel < 37 || channel > 39 || session < 0 || parity < 0 || rounds < 1) { usage(argv[0]); }
+
+    if (length == -1) {
+        length = fread(message, 1, sizeof(message), stdin);
+        if (length > BLECAST_ENCODER_MAX_EXTENDED_LENGTH) {
+            fprintf(stderr, "Message too long (maximum %d bytes)\n", BLECAST_ENCODER_MAX_EXTENDED_LENGTH);
+            return 1;
+        }
+    }
+
+    BLECastEncoder encoder;
+    if (!blecast_encoder_init(&encoder, key, message, length, session, parity)) {
+        fprintf(stderr, "Invalid message, session or parity\n");
+        return 1;
+    }
+
+    uint8_t compressed[BLECAST_ENCODER_MAX_LENGTH];
+    if (compress && length <= BLECAST_ENCODER_MAX_LENGTH) {
+        uint16_t compressedLength = blecast_encoder_compress(message, length, compressed, sizeof(compressed));
+
+        BLECastEncoder compressedEncoder;
+        if (compressedLength && blecast_encoder_initCompressed(&compressedEncoder, key, compressed, compressedLength, session, parity) &&
+          compressedEncoder.payloadCount < encoder.payloadCount) {
+            fprintf(stderr, "Compressed %d bytes to %d bytes (%d payloads to %d)\n", length, compressedLength,
+              encoder.payloadCount, compressedEncoder.payloadCount);
+            encoder = compressedEncoder;
+        }
+    }
+
+    FILE *output = filename ? fopen(filename, "wb"): stdout;
+    if (!output) {
+        perror(filename);
+        return 1;
+    }
+
+    uint16_t count = blecast_encoder_getPayloadCount(&encoder);
+    for (int round = 0; round < rounds; round++) {
+        for (uint16_t i = 0; i < count; i++) {
+            uint8_t packet[BLECAST_ENCODER_PACKET_SIZE];
+            blecast_encoder_getPacket(&encoder, i, channel - 37, packet);
+            fwrite(packet, 1, sizeof(packet), output);
+        }
+    }
+
+    if (output != stdout) { fclose(output); }
+
+    return 0;
+}
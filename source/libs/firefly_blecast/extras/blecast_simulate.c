@@ -0,0 +1,401 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018 Richard Moore <me@ricmoo.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ *  blecast_simulate - a host simulator for the BLECast receiver.
+ *
+ *  The receiver (firefly_blecast.c, built with BLECAST_MOCK_RADIO) runs against a
+ *  mock radio with a virtual clock. A simulated sender advertises the packets of
+ *  the reference encoder, each advertising event sending the current payload on
+ *  channels 37, 38 and 39. The mock radio follows the timing of the real driver;
+ *  the radio only captures packets on its channel while listening (the 10ms
+ *  window of radio_startListening), into a 3 packet FIFO, and is off for the 5ms
+ *  of radio_stopListening.
+ *
+ *  For each message size (1 to 64 payloads) it reports the distribution of
+ *  virtual time from the first packet sent until blecast_poll returns true, the
+ *  trials that did not complete in time, and the trials that completed with the
+ *  wrong size or data (which exits with 1). If built with BLECAST_STATS=1, the
+ *  average receive counters per trial follow.
+ *
+ *  If the receiver is built with BLECAST_ACK_BEACON=1 and -a is given, the sender
+ *  applies the receiver's acknowledgment beacons (each lost with the same loss
+ *  probability) and skips the payloads they acknowledge.
+ *
+ *  Build (from this folder; add -DBLECAST_ERASURE_CODING=1, firefly_qrcode.c and
+ *  -I../../firefly_qrcode/src to simulate parity payloads):
+ *    cc -O2 -DBLECAST_MOCK_RADIO=1 -DCRC24_TABLE=CRC24_TABLE_SLICE8 -I../src blecast_simulate.c \
+ *        ../src/firefly_blecast.c ../src/firefly_blecast_encoder.c ../src/crc24.c \
+ *        ../src/aes-otfks-encrypt.c ../src/aes-otfks-decrypt.c ../src/aes-decrypt.c \
+ *        -o blecast_simulate
+ *
+ *  Usage:
+ *    blecast_simulate [-n TRIALS] [-l LOSS] [-d DUPLICATE] [-o REORDER]
+ *        [-k SKEW37,SKEW38,SKEW39] [-i INTERVAL] [-t PROCESS] [-p PARITY]
+ *        [-s SESSION] [-c COUNT] [-x SEED] [-a]
+ *
+ *    -n TRIALS     Trials per message size (default: 200)
+ *    -l LOSS       Probability a packet is lost (default: 0.1)
+ *    -d DUPLICATE  Probability a packet is received twice (default: 0)
+ *    -o REORDER    Probability a payload swaps places with the next (default: 0)
+ *    -k SKEW       Additional loss probability per channel (default: 0,0,0)
+ *    -i INTERVAL   Advertising interval in microseconds (default: 20000; each
+ *                  event also has the BLE 0-10ms random advertising delay)
+ *    -t PROCESS    Virtual microseconds the receiver spends on each packet read,
+ *                  for decryption and reassembly (default: 0; not measured)
+ *    -p PARITY     Parity payloads (requires BLECAST_ERASURE_CODING)
+ *    -s SESSION    Session tag (default: 0; requires BLECAST_SESSIONS)
+ *    -c COUNT      Only simulate messages of COUNT payloads
+ *    -x SEED       Random seed (default: 1)
+ *    -a            The sender skips acknowledged payloads (requires BLECAST_ACK_BEACON)
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "firefly_blecast.h"
+#include "firefly_blecast_encoder.h"
+
+
+// The time for each advertising packet on air (47 bytes at 1Mbps) between channels
+#define PACKET_DURATION        (376)
+
+// nRF24L01+ RX settling time after CE is raised
+#define RX_SETTLE              (130)
+
+// The RX FIFO of the nRF24L01+ holds 3 packets
+#define FIFO_SIZE              (3)
+
+// SPI costs (approximate, at 8MHz SPI with digitalWrite pins) of checking the FIFO,
+// reading a packet and setting a channel
+#define AVAILABLE_COST         (10)
+#define READ_COST              (50)
+#define SET_CHANNEL_COST       (10)
+
+// Sending an acknowledgment beacon; powering up (2ms), then settling and sending
+#define ACK_COST               (2500)
+
+// Give up on a trial after this much virtual time
+#define TIMEOUT                (600000000ULL)
+
+#define MAX_PAYLOADS           (64 + BLECAST_ENCODER_MAX_PARITY)
+
+
+// Simulation parameters
+static double lossRate = 0.1, duplicateRate = 0.0, reorderRate = 0.0;
+static double channelSkew[3] = { 0, 0, 0 };
+static uint32_t advertisingInterval = 20000, processCost = 0;
+static bool acknowledgments = false;
+
+// The sender; each payload's packets for each channel
+static BLECastEncoder encoder;
+static uint8_t packets[MAX_PAYLOADS][3][BLECAST_ENCODER_PACKET_SIZE];
+static uint8_t payloadCount;
+static uint8_t order[MAX_PAYLOADS];
+static uint32_t event;
+static uint64_t nextEventTime, firstPacketTime;
+
+// The radio
+static uint64_t now;
+static bool listening;
+static uint64_t listenStart;
+static uint8_t channel;
+static uint8_t fifo[FIFO_SIZE][BLECAST_ENCODER_PACKET_SIZE];
+static uint8_t fifoCount;
+
+
+static double randomUnit() {
+    return (double)rand() / ((double)RAND_MAX + 1.0);
+}
+
+// Shuffle each round of payloads by swapping neighbours
+static void sender_reorder() {
+    for (uint8_t i = 0; i < payloadCount; i++) { order[i] = i; }
+    for (uint8_t i = 0; i + 1 < payloadCount; i++) {
+        if (randomUnit() < reorderRate) {
+            uint8_t tmp = order[i];
+            order[i] = order[i + 1];
+            order[i + 1] = tmp;
+            i++;
+        }
+    }
+}
+
+static void radio_receive(const uint8_t *packet) {
+    if (fifoCount == FIFO_SIZE) { return; }
+    memcpy(fifo[fifoCount++], packet, BLECAST_ENCODER_PACKET_SIZE);
+}
+
+// Deliver every advertising packet sent up until the time
+static void sender_advance(uint64_t until) {
+    while (nextEventTime <= until) {
+        uint8_t index = event % payloadCount;
+        if (index == 0) { sender_reorder(); }
+
+        // Skip ahead to the next payload not acknowledged (if any remain)
+        for (uint8_t i = 0; i < payloadCount && blecast_encoder_isAcknowledged(&encoder, order[index]); i++) {
+            index = (++event) % payloadCount;
+            if (index == 0) { sender_reorder(); }
+        }
+
+        for (uint8_t c = 0; c < 3; c++) {
+            if (blecast_encoder_isAcknowledged(&encoder, order[index])) { break; }
+            uint64_t sent = nextEventTime + c * PACKET_DURATION;
+            if (!listening || c != channel || sent < listenStart + RX_SETTLE || sent > until) { continue; }
+            if (randomUnit() < lossRate + channelSkew[c]) { continue; }
+
+            radio_receive(packets[order[index]][c]);
+            if (randomUnit() < duplicateRate) { radio_receive(packets[order[index]][c]); }
+        }
+
+        event++;
+        nextEventTime += advertisingInterval + (rand() % 10001);
+    }
+}
+
+
+// Mock radio (see BLECAST_MOCK_RADIO in firefly_blecast.c)
+
+void radio_init(BLECastMessage *message) { (void)message; }
+
+void radio_shutdown(BLECastMessage *message) { (void)message; }
+
+void radio_startListening(BLECastMessage *message) {
+    (void)message;
+
+    sender_advance(now);
+    listening = true;
+    listenStart = now;
+    fifoCount = 0;
+
+    // delay(10)
+    now += 10000;
+    sender_advance(now);
+}
+
+void radio_stopListening(BLECastMessage *message) {
+    (void)message;
+
+    sender_advance(now);
+    listening = false;
+
+    // delay(5)
+    now += 5000;
+}
+
+uint8_t radio_available(BLECastMessage *message) {
+    (void)message;
+
+    now += AVAILABLE_COST;
+    sender_advance(now);
+    return fifoCount;
+}
+
+void radio_read_packet(BLECastMessage *message, uint8_t *buffer) {
+    (void)message;
+
+    memcpy(buffer, fifo[0], BLECAST_ENCODER_PACKET_SIZE);
+    memmove(fifo[0], fifo[1], (FIFO_SIZE - 1) * BLECAST_ENCODER_PACKET_SIZE);
+    fifoCount--;
+
+    now += READ_COST + processCost;
+}
+
+void radio_setChannel(BLECastMessage *message, uint8_t value) {
+    (void)message;
+
+    channel = value;
+    now += SET_CHANNEL_COST;
+}
+
+void radio_send_packet(BLECastMessage *message, const uint8_t *packet) {
+    (void)message;
+
+    sender_advance(now);
+    now += ACK_COST;
+
+    if (!acknowledgments || randomUnit() < lossRate + channelSkew[channel]) { return; }
+
+    if (!blecast_encoder_readAck(&encoder, packet, channel)) {
+        fprintf(stderr, "Invalid acknowledgment beacon\n");
+        exit(1);
+    }
+}
+
+
+static int compare(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+int main(int argc, char **argv) {
+    int trials = 200, parity = 0, session = 0, onlyCount = 0;
+    unsigned int seed = 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:l:d:o:k:i:t:p:s:c:x:a")) != -1) {
+        switch (opt) {
+            case 'n': trials = atoi(optarg); break;
+            case 'l': lossRate = atof(optarg); break;
+            case 'd': duplicateRate = atof(optarg); break;
+            case 'o': reorderRate = atof(optarg); break;
+            case 'k':
+                if (sscanf(optarg, "%lf,%lf,%lf", &channelSkew[0], &channelSkew[1], &channelSkew[2]) != 3) { return 1; }
+                break;
+            case 'i': advertisingInterval = atoi(optarg); break;
+            case 't': processCost = atoi(optarg); break;
+            case 'p': parity = atoi(optarg); break;
+            case 's': session = atoi(optarg); break;
+            case 'c': onlyCount = atoi(optarg); break;
+            case 'x': seed = atoi(optarg); break;
+            case 'a': acknowledgments = true; break;
+            default:
+                fprintf(stderr, "Usage: %s [-n TRIALS] [-l LOSS] [-d DUPLICATE] [-o REORDER] [-k SKEW37,SKEW38,SKEW39]\n"
+                  "    [-i INTERVAL] [-t PROCESS] [-p PARITY] [-s SESSION] [-c COUNT] [-x SEED] [-a]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (trials < 1) { return 1; }
+
+#if !BLECAST_ACK_BEACON
+    if (acknowledgments) {
+        fprintf(stderr, "Acknowledgments require BLECAST_ACK_BEACON=1\n");
+        return 1;
+    }
+#endif
+
+    srand(seed);
+
+    uint8_t key[16];
+    for (uint8_t i = 0; i < 16; i++) { key[i] = rand(); }
+
+    uint8_t messageData[BLECAST_ENCODER_MAX_LENGTH + 12 * BLECAST_ENCODER_MAX_PARITY];
+    uint64_t *times = malloc(trials * sizeof(uint64_t));
+
+    // Trials of every size that completed with the wrong size or data
+    int corruptTotal = 0;
+
+    printf("payloads  bytes    mean(ms)   p50(ms)   p90(ms)   p99(ms)   max(ms)  timeouts   corrupt\n");
+
+    for (int count = 1; count <= 64; count++) {
+        if (onlyCount && count != onlyCount) { continue; }
+
+        // The longest message of count payloads
+        uint16_t length = (count == 1) ? 12: (12 * count - 3);
+
+        int completed = 0, timeouts = 0, corrupt = 0;
+
+#if BLECAST_STATS
+        // The receive counters, summed over all trials
+        uint32_t totals[sizeof(BLECastStats) / sizeof(uint16_t)];
+        memset(totals, 0, sizeof(totals));
+#endif
+        for (int trial = 0; trial < trials; trial++) {
+            uint8_t message[BLECAST_ENCODER_MAX_LENGTH];
+            for (uint16_t i = 0; i < length; i++) { message[i] = rand(); }
+
+            if (!blecast_encoder_init(&encoder, key, message, length, session, parity)) {
+                fprintf(stderr, "Invalid session or parity\n");
+                return 1;
+            }
+
+            payloadCount = blecast_encoder_getPayloadCount(&encoder);
+            for (uint8_t i = 0; i < payloadCount; i++) {
+                for (uint8_t c = 0; c < 3; c++) { blecast_encoder_getPacket(&encoder, i, c, packets[i][c]); }
+            }
+
+            // The sender starts at a random point relative to the receiver
+            now = 0;
+            listening = false;
+            channel = 0;
+            event = 0;
+            firstPacketTime = nextEventTime = rand() % (advertisingInterval + 10001);
+
+            BLECastMessage receiver;
+            blecast_init(&receiver, key, messageData, sizeof(messageData));
+
+            bool done = false;
+            while (now - firstPacketTime < TIMEOUT || now < firstPacketTime) {
+                if (blecast_poll(&receiver)) { done = true; break; }
+            }
+
+#if BLECAST_STATS
+            const uint16_t *counters = (const uint16_t*)&receiver.stats;
+            for (uint8_t i = 0; i < sizeof(BLECastStats) / sizeof(uint16_t); i++) { totals[i] += counters[i]; }
+#endif
+
+            if (!done) {
+                timeouts++;
+                continue;
+            }
+
+            if (receiver.size != length || memcmp(receiver.data, message, length)) {
+                corrupt++;
+                continue;
+            }
+
+            times[completed++] = (now > firstPacketTime) ? (now - firstPacketTime): 0;
+        }
+
+        if (completed == 0) {
+            printf("%8d  %5d         -         -         -         -         -  %8d  %8d\n", count, length, timeouts, corrupt);
+            corruptTotal += corrupt;
+            continue;
+        }
+
+        qsort(times, completed, sizeof(uint64_t), compare);
+
+        double mean = 0;
+        for (int i = 0; i < completed; i++) { mean += times[i]; }
+        mean /= completed;
+
+        printf("%8d  %5d  %9.1f %9.1f %9.1f %9.1f %9.1f  %8d  %8d\n", count, length, mean / 1000.0,
+          times[completed / 2] / 1000.0, times[(completed * 90) / 100] / 1000.0,
+          times[(completed * 99) / 100] / 1000.0, times[completed - 1] / 1000.0, timeouts, corrupt);
+        corruptTotal += corrupt;
+
+#if BLECAST_STATS
+        // In the order of BLECastStats
+        static const char *names[] = { "37", "38", "39", "pdu", "crc", "dup", "stale", "mcrc", "unzip", "resets" };
+        printf("          per trial:");
+        for (uint8_t i = 0; i < sizeof(BLECastStats) / sizeof(uint16_t); i++) {
+            printf(" %s=%.1f", names[i], (double)totals[i] / trials);
+        }
+        printf("\n");
+#endif
+    }
+
+    free(times);
+
+    if (corruptTotal) {
+        fprintf(stderr, "%d trials completed with the wrong message\n", corruptTotal);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,650 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018 Richard Moore <me@ricmoo.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/**
+ *  blecast_test - host tests for the BLECast receiver.
+ *
+ *  The receiver (firefly_blecast.c, built with BLECAST_MOCK_RADIO) is fed the
+ *  packets of the reference encoder through a mock radio, one packet per
+ *  blecast_poll, on whichever channel the receiver is listening to. Messages of
+ *  every payload count are sent in a shuffled order with duplicates, and each
+ *  must complete on exactly its last new payload, with the sent data and ID.
+ *  Receivers built with BLECAST_ERASURE_CODING must also recover messages sent
+ *  with 1, 2 and 4 parity payloads, missing as many data payloads, on exactly
+ *  the payload that makes up the data payload count, and with BLECAST_STREAMING,
+ *  stream extended messages of up to 10000 bytes in order through the window.
+ *  Receivers built with BLECAST_SESSIONS are also checked against interleaved
+ *  sessions, and with any tagged payloads (see BLECAST_TAGS), against single
+ *  tagged payloads from other messages and random payloads. Receivers built with
+ *  BLECAST_ACK_BEACON must send beacons (captured by the mock radio) that the
+ *  encoder opens to exactly the payloads received, on every channel, and rejects
+ *  with any bit flipped.
+ *
+ *  A digest of every decoded message (its size, ID and data) is printed, so the
+ *  output of receivers built with different options can be compared (see the
+ *  Makefile, which compares BLECAST_AES_KEY_SCHEDULE 0 and 1).
+ *
+ *  Build (from this folder; or run: make test):
+ *    cc -O2 -DBLECAST_MOCK_RADIO=1 -I../src blecast_test.c \
+ *        ../src/firefly_blecast.c ../src/firefly_blecast_encoder.c ../src/crc24.c \
+ *        ../src/aes-otfks-encrypt.c ../src/aes-otfks-decrypt.c ../src/aes-decrypt.c \
+ *        -o blecast_test
+ *
+ *  Usage:
+ *    blecast_test
+ *
+ *    Prints each failure and the digest; exits with 1 if anything failed.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "firefly_blecast.h"
+#include "firefly_blecast_encoder.h"
+
+
+// The message buffer (as the Firefly wallet uses) and the longest message it holds
+#if BLECAST_ERASURE_CODING
+#define BUFFER_SIZE            (BLECAST_ENCODER_MAX_LENGTH + 12 * BLECAST_MAX_PARITY)
+#else
+#define BUFFER_SIZE            (BLECAST_ENCODER_MAX_LENGTH)
+#endif
+#define MAX_LENGTH             (BLECAST_ENCODER_MAX_LENGTH / BLECAST_SESSION_SLOTS)
+
+// The packets received until the next blecast_poll
+#define QUEUE_SIZE             (3)
+
+// A random payload (as from another sender or noise) instead of a payload index
+#define NOISE                  (0xffff)
+
+
+static int failures = 0;
+
+#define check(condition, ...)  do { \
+        if (!(condition)) { \
+            failures++; \
+            printf("FAIL %s:%d: ", __func__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+        } \
+    } while (0)
+
+
+// Mock radio (see BLECAST_MOCK_RADIO in firefly_blecast.c)
+
+typedef struct QueuedPacket {
+    BLECastEncoder *encoder;
+    uint16_t index;
+} QueuedPacket;
+
+static QueuedPacket queue[QUEUE_SIZE];
+static uint8_t queueCount;
+static uint8_t channel;
+
+void radio_init(BLECastMessage *message) { (void)message; channel = 0; }
+
+void radio_shutdown(BLECastMessage *message) { (void)message; }
+
+void radio_startListening(BLECastMessage *message) { (void)message; }
+
+void radio_stopListening(BLECastMessage *message) { (void)message; }
+
+uint8_t radio_available(BLECastMessage *message) {
+    (void)message;
+    return queueCount;
+}
+
+// The packet is generated for the channel being listened to, as it was sent on all 3
+void radio_read_packet(BLECastMessage *message, uint8_t *buffer) {
+    (void)message;
+    if (queue[0].index == NOISE) {
+        blecast_encoder_getPacket(queue[0].encoder, 0, channel, buffer);
+        for (uint8_t i = 1; i < BLECAST_ENCODER_PACKET_SIZE; i++) { buffer[i] = rand(); }
+    } else {
+        blecast_encoder_getPacket(queue[0].encoder, queue[0].index, channel, buffer);
+    }
+    memmove(&queue[0], &queue[1], (QUEUE_SIZE - 1) * sizeof(QueuedPacket));
+    queueCount--;
+}
+
+void radio_setChannel(BLECastMessage *message, uint8_t value) {
+    (void)message;
+    channel = value;
+}
+
+// The last acknowledgment beacon sent, the channel it was sent on and the beacons sent
+static uint8_t sentPacket[BLECAST_ENCODER_ACK_PACKET_SIZE];
+static uint8_t sentChannel;
+static uint16_t sentCount;
+
+void radio_send_packet(BLECastMessage *message, const uint8_t *packet) {
+    (void)message;
+    memcpy(sentPacket, packet, sizeof(sentPacket));
+    sentChannel = channel;
+    sentCount++;
+}
+
+// Receives payload index of encoder, returning whether the message completed
+static bool receive(BLECastMessage *receiver, BLECastEncoder *encoder, uint16_t index) {
+    queue[queueCount].encoder = encoder;
+    queue[queueCount].index = index;
+    queueCount++;
+    return blecast_poll(receiver);
+}
+
+
+// FNV-1a, over the decoded messages
+static uint32_t digest = 0x811c9dc5;
+
+static void addDigest(const void *data, uint16_t length) {
+    for (uint16_t i = 0; i < length; i++) {
+        digest = (digest ^ ((const uint8_t*)data)[i]) * 0x01000193;
+    }
+}
+
+static void shuffle(uint16_t *values, uint16_t count) {
+    for (uint16_t i = count - 1; i > 0; i--) {
+        uint16_t j = rand() % (i + 1);
+        uint16_t tmp = values[i];
+        values[i] = values[j];
+        values[j] = tmp;
+    }
+}
+
+
+static uint8_t key[16];
+static uint8_t buffer[BUFFER_SIZE];
+
+
+// Every payload count, full and partial, in a shuffled order with duplicates
+static void testMessages() {
+    for (uint16_t length = 1; length <= MAX_LENGTH; length += (length < 24) ? 1: 7) {
+        uint8_t message[MAX_LENGTH];
+        for (uint16_t i = 0; i < length; i++) { message[i] = rand(); }
+
+        BLECastEncoder encoder;
+        check(blecast_encoder_init(&encoder, key, message, length, 0, 0), "encoder length=%d", length);
+
+        uint16_t count = blecast_encoder_getPayloadCount(&encoder);
+        uint16_t order[2 * BLECAST_MAX_PAYLOADS];
+        for (uint16_t i = 0; i < count; i++) { order[i] = i; }
+        shuffle(order, count);
+
+        BLECastMessage receiver;
+        blecast_init(&receiver, key, buffer, sizeof(buffer));
+
+        // Resend a random payload already sent before each new one
+        uint16_t sent = 0;
+        bool complete = false;
+        while (sent < count && !complete) {
+            if (sent && (rand() & 1)) {
+                complete = receive(&receiver, &encoder, order[rand() % sent]);
+                check(!complete, "completed on a duplicate length=%d", length);
+            }
+            complete = receive(&receiver, &encoder, order[sent++]);
+        }
+
+        check(complete && sent == count, "length=%d complete=%d sent=%d/%d", length, complete, sent, count);
+        check(receiver.size == length, "length=%d size=%d", length, receiver.size);
+        check(receiver.size != length || !memcmp(receiver.data, message, length), "length=%d data", length);
+        check(receiver.id != BLECAST_INVALID_ID, "length=%d id", length);
+        if (count > 1) { check(receiver.id == encoder.messageCrc, "length=%d id=%06x", length, receiver.id); }
+
+        addDigest(&receiver.size, sizeof(receiver.size));
+        addDigest(&receiver.id, sizeof(receiver.id));
+        addDigest(receiver.data, (receiver.size > 0) ? receiver.size: 0);
+    }
+}
+
+
+#if BLECAST_ERASURE_CODING
+
+// The first payloads of a message (the terminal, index 0 or neither) to drop
+#define DROP_TERMINAL          (0)
+#define DROP_FIRST             (1)
+#define DROP_RANDOM            (2)
+
+// Messages with parity payloads, of full and partial last payloads, where up to the
+// parity count of data payloads (including the terminal or the first) never arrive;
+// each must complete, recovered, on exactly its payload count-th distinct payload
+static void testErasure() {
+    static const uint16_t lengths[] = { 13, 21, 22, 33, 45, 100, 201, 381, 500, 700, 753, 764, 765 };
+    static const uint8_t parityCounts[] = { 1, 2, 4 };
+
+    for (uint8_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        uint16_t length = lengths[l];
+        uint8_t message[BLECAST_ENCODER_MAX_LENGTH];
+        for (uint16_t i = 0; i < length; i++) { message[i] = rand(); }
+
+        for (uint8_t p = 0; p < sizeof(parityCounts); p++) {
+            uint8_t parityCount = parityCounts[p];
+
+            BLECastEncoder encoder;
+            check(blecast_encoder_init(&encoder, key, message, length, 0, parityCount), "encoder length=%d parity=%d", length, parityCount);
+            uint16_t dataCount = encoder.payloadCount;
+
+            for (uint8_t dropCount = 1; dropCount <= parityCount && dropCount < dataCount; dropCount++) {
+                for (uint8_t mode = DROP_TERMINAL; mode <= DROP_RANDOM; mode++) {
+
+                    // Choose the data payloads to drop (from a shuffled order, so the
+                    // terminal or first payload is moved to the front first)
+                    uint16_t order[BLECAST_MAX_PAYLOADS + BLECAST_ENCODER_MAX_PARITY];
+                    for (uint16_t i = 0; i < dataCount; i++) { order[i] = i; }
+                    shuffle(order, dataCount);
+                    for (uint16_t i = 0; i < dataCount; i++) {
+                        uint16_t first = (mode == DROP_TERMINAL) ? (dataCount - 1): 0;
+                        if (mode == DROP_RANDOM || order[i] != first) { continue; }
+                        order[i] = order[0];
+                        order[0] = first;
+                    }
+
+                    // Send the rest of the data and all of the parity, shuffled
+                    uint16_t count = 0;
+                    for (uint16_t i = dropCount; i < dataCount; i++) { order[count++] = order[i]; }
+                    for (uint16_t i = 0; i < parityCount; i++) { order[count++] = dataCount + i; }
+                    shuffle(order, count);
+
+                    BLECastMessage receiver;
+                    blecast_init(&receiver, key, buffer, sizeof(buffer));
+
+                    // Resend a random payload already sent before each new one
+                    uint16_t sent = 0;
+                    bool complete = false;
+                    while (sent < count && !complete) {
+                        if (sent && (rand() & 1)) {
+                            complete = receive(&receiver, &encoder, order[rand() % sent]);
+                            check(!complete, "completed on a duplicate length=%d parity=%d", length, parityCount);
+                        }
+                        complete = receive(&receiver, &encoder, order[sent++]);
+                    }
+
+                    check(complete && sent == dataCount, "length=%d parity=%d drop=%d mode=%d complete=%d sent=%d/%d",
+                      length, parityCount, dropCount, mode, complete, sent, dataCount);
+                    check(receiver.size == length, "length=%d parity=%d size=%d", length, parityCount, receiver.size);
+                    check(receiver.size != length || !memcmp(receiver.data, message, length),
+                      "length=%d parity=%d drop=%d mode=%d data", length, parityCount, dropCount, mode);
+                    check(receiver.id == encoder.messageCrc, "length=%d parity=%d id=%06x", length, parityCount, receiver.id);
+
+                    addDigest(&receiver.size, sizeof(receiver.size));
+                    addDigest(receiver.data, (receiver.size > 0) ? receiver.size: 0);
+                }
+            }
+        }
+    }
+}
+
+#endif
+
+
+#if BLECAST_TAGS
+
+// Sends every payload of encoder in order, returning whether the message completed
+static bool receiveAll(BLECastMessage *receiver, BLECastEncoder *encoder) {
+    bool complete = false;
+    for (uint16_t i = 0; i < blecast_encoder_getPayloadCount(encoder) && !complete; i++) {
+        complete = receive(receiver, encoder, i);
+    }
+    return complete;
+}
+
+// Whether the receiver completed with message
+static bool isReceived(BLECastMessage *receiver, bool complete, const uint8_t *message, uint16_t length) {
+    return complete && receiver->size == length && !memcmp(receiver->data, message, length);
+}
+
+#endif
+
+
+#if BLECAST_SESSIONS
+
+// A single payload of a new session must not discard the message in progress (from
+// an untagged or tagged sender), but a second one must replace it
+static void testSessions() {
+    uint16_t length = 100;
+    uint8_t messageA[100], messageB[100];
+    for (uint16_t i = 0; i < length; i++) {
+        messageA[i] = rand();
+        messageB[i] = rand();
+    }
+
+    for (uint8_t session = 0; session < 3; session++) {
+        BLECastEncoder encoderA, encoderB;
+        blecast_encoder_init(&encoderA, key, messageA, length, session, 0);
+        blecast_encoder_init(&encoderB, key, messageB, length, session + 1, 0);
+
+        BLECastMessage receiver;
+        blecast_init(&receiver, key, buffer, sizeof(buffer));
+
+        // An outlier partway through
+        receive(&receiver, &encoderA, 0);
+        receive(&receiver, &encoderA, 1);
+        receive(&receiver, &encoderB, 2);
+        bool complete = receiveAll(&receiver, &encoderA);
+        check(isReceived(&receiver, complete, messageA, length), "outlier discarded session=%d", session);
+
+        // The sender moves on to a new message
+        blecast_reset(&receiver);
+        receive(&receiver, &encoderA, 0);
+        receive(&receiver, &encoderA, 1);
+        receive(&receiver, &encoderB, 0);
+        receive(&receiver, &encoderB, 1);
+
+        // A late payload from the previous message is dropped
+        receive(&receiver, &encoderA, 2);
+
+        complete = receiveAll(&receiver, &encoderB);
+        check(isReceived(&receiver, complete, messageB, length), "new session not received session=%d", session + 1);
+    }
+}
+
+#endif
+
+
+#if BLECAST_STREAMING
+
+// The payloads the receiver keeps ahead of its stream (see blecast_getStreamWindow)
+#define STREAM_WINDOW          ((BUFFER_SIZE / BLECAST_SESSION_SLOTS / 12 > BLECAST_MAX_PAYLOADS) ? \
+                                 BLECAST_MAX_PAYLOADS: (BUFFER_SIZE / BLECAST_SESSION_SLOTS / 12))
+
+// What a stream consumer received; the data must arrive in order
+typedef struct StreamCheck {
+    const uint8_t *message;
+    uint32_t length;
+    uint32_t digest;
+    bool ordered;
+    bool abandoned;
+} StreamCheck;
+
+static void checkStream(void *context, const uint8_t *data, uint16_t length) {
+    StreamCheck *stream = (StreamCheck*)context;
+    if (data == NULL) {
+        stream->abandoned = true;
+        return;
+    }
+
+    if (memcmp(data, &stream->message[stream->length], length)) { stream->ordered = false; }
+    for (uint16_t i = 0; i < length; i++) {
+        stream->digest = (stream->digest ^ data[i]) * 0x01000193;
+    }
+    stream->length += length;
+}
+
+// Extended messages, sent a window at a time; each window shuffled (its first payload
+// always last, so the rest fill the window), with duplicates, payloads already
+// streamed and payloads beyond the window (which the sender must repeat). Each must
+// stream in order and complete on exactly its last payload.
+static void testStreaming() {
+    static const uint32_t lengths[] = { BLECAST_ENCODER_MAX_LENGTH + 1, 4000, 12 * 3 * STREAM_WINDOW - 3, 10000 };
+    static uint8_t message[10000];
+
+    for (uint8_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+        uint32_t length = lengths[l];
+
+        uint32_t expected = 0x811c9dc5;
+        for (uint32_t i = 0; i < length; i++) {
+            message[i] = rand();
+            expected = (expected ^ message[i]) * 0x01000193;
+        }
+
+        BLECastEncoder encoder;
+        check(blecast_encoder_init(&encoder, key, message, length, 0, 0) && encoder.extended, "encoder length=%u", length);
+        uint16_t count = blecast_encoder_getPayloadCount(&encoder);
+
+        StreamCheck stream = { message, 0, 0x811c9dc5, true, false };
+        BLECastMessage receiver;
+        blecast_init(&receiver, key, buffer, sizeof(buffer));
+        blecast_setStream(&receiver, checkStream, &stream);
+
+        bool complete = false;
+        for (uint16_t base = 0; base < count && !complete; base += STREAM_WINDOW) {
+            uint16_t order[STREAM_WINDOW];
+            uint16_t windowCount = (count - base < STREAM_WINDOW) ? (count - base): STREAM_WINDOW;
+            for (uint16_t i = 0; i < windowCount; i++) { order[i] = base + 1 + i; }
+            if (windowCount > 1) { shuffle(order, windowCount - 1); }
+            order[windowCount - 1] = base;
+
+            for (uint16_t i = 0; i < windowCount && !complete; i++) {
+                uint16_t r = rand() % 4;
+                if (r == 0 && i) {
+                    complete = receive(&receiver, &encoder, order[rand() % i]);
+                } else if (r == 1 && base) {
+                    complete = receive(&receiver, &encoder, rand() % base);
+                } else if (r == 2 && base + STREAM_WINDOW < count) {
+                    complete = receive(&receiver, &encoder, base + STREAM_WINDOW + rand() % (count - base - STREAM_WINDOW));
+                }
+                check(!complete, "completed early length=%u window=%d", length, base);
+
+                complete = receive(&receiver, &encoder, order[i]);
+                check(!complete || (base + windowCount == count && i == windowCount - 1),
+                  "completed early length=%u window=%d", length, base);
+            }
+        }
+
+        check(complete, "length=%u not complete", length);
+        check(stream.ordered && !stream.abandoned, "length=%u ordered=%d abandoned=%d", length, stream.ordered, stream.abandoned);
+        check(stream.length == length && receiver.streamLength == length, "length=%u streamed=%u/%u", length, stream.length, receiver.streamLength);
+        check(stream.digest == expected, "length=%u digest=%08x expected=%08x", length, stream.digest, expected);
+        check(receiver.size == 0 && receiver.id == encoder.messageCrc, "length=%u size=%d id=%06x", length, receiver.size, receiver.id);
+
+        addDigest(&stream.length, sizeof(stream.length));
+        addDigest(&stream.digest, sizeof(stream.digest));
+    }
+}
+
+#endif
+
+
+#if BLECAST_TAGS
+
+#if BLECAST_STREAMING
+static void discardStream(void *context, const uint8_t *data, uint16_t length) {
+    (void)context;
+    (void)data;
+    (void)length;
+}
+#endif
+
+// Sends half of message (after its terminal, if terminalFirst), then the outlier
+// payloads, then the rest of message, returning whether the message is received
+static bool receiveAround(const uint8_t *message, uint16_t length, bool terminalFirst, BLECastEncoder *outlier, const uint16_t *indices, uint8_t count) {
+    BLECastEncoder encoder;
+    blecast_encoder_init(&encoder, key, message, length, 0, 0);
+
+    BLECastMessage receiver;
+    blecast_init(&receiver, key, buffer, sizeof(buffer));
+#if BLECAST_STREAMING
+    blecast_setStream(&receiver, discardStream, NULL);
+#endif
+
+    uint16_t payloadCount = blecast_encoder_getPayloadCount(&encoder);
+    if (terminalFirst) { receive(&receiver, &encoder, payloadCount - 1); }
+    for (uint16_t i = 0; i < payloadCount / 2; i++) { receive(&receiver, &encoder, i); }
+    for (uint8_t i = 0; i < count; i++) { receive(&receiver, outlier, indices[i]); }
+
+    bool complete = false;
+    for (uint16_t i = payloadCount / 2; i < payloadCount && !complete; i++) {
+        complete = receive(&receiver, &encoder, i);
+    }
+
+    return isReceived(&receiver, complete, message, length);
+}
+
+// A single tagged payload that disagrees with the message in progress must not discard
+// it; a second must (the sender moved on to another message)
+static void testTags() {
+    uint8_t messageA[200], messageB[300];
+    for (uint16_t i = 0; i < sizeof(messageA); i++) { messageA[i] = rand(); }
+    for (uint16_t i = 0; i < sizeof(messageB); i++) { messageB[i] = (i % 5) ? 0: rand(); }
+
+    BLECastEncoder outlier;
+    uint16_t indices[2];
+
+#if BLECAST_ERASURE_CODING
+    // Parity payloads of a longer message; once the count is known from the terminal,
+    // a second discards the message; before, they give way to the data payloads
+    blecast_encoder_init(&outlier, key, messageB, sizeof(messageB), 0, 2);
+    indices[0] = outlier.payloadCount;
+    indices[1] = outlier.payloadCount + 1;
+    check(receiveAround(messageA, sizeof(messageA), true, &outlier, indices, 1), "parity outlier discarded the message");
+    check(!receiveAround(messageA, sizeof(messageA), true, &outlier, indices, 2), "parity payloads did not discard the message");
+    check(receiveAround(messageA, sizeof(messageA), false, &outlier, indices, 2), "parity payloads before the terminal discarded the message");
+
+    // Parity payloads agreeing with the count, but of another message, recover garbage
+    blecast_encoder_init(&outlier, key, messageB, sizeof(messageA), 0, 2);
+    check(receiveAround(messageA, sizeof(messageA), true, &outlier, indices, 2), "parity of another message discarded the message");
+#endif
+
+#if BLECAST_COMPRESSION
+    uint8_t compressed[sizeof(messageB)];
+    uint16_t compressedLength = blecast_encoder_compress(messageB, sizeof(messageB), compressed, sizeof(compressed));
+    blecast_encoder_initCompressed(&outlier, key, compressed, compressedLength, 0, 0);
+    indices[0] = 1;
+    indices[1] = 2;
+    check(receiveAround(messageA, sizeof(messageA), true, &outlier, indices, 1), "compressed outlier discarded the message");
+
+    // The sender moves on to the compressed message
+    BLECastMessage receiver;
+    blecast_init(&receiver, key, buffer, sizeof(buffer));
+    BLECastEncoder encoder;
+    blecast_encoder_init(&encoder, key, messageA, sizeof(messageA), 0, 0);
+    for (uint16_t i = 0; i < 8; i++) { receive(&receiver, &encoder, i); }
+    bool complete = receiveAll(&receiver, &outlier) || receiveAll(&receiver, &outlier);
+    check(isReceived(&receiver, complete, messageB, sizeof(messageB)), "compressed message not received");
+#endif
+
+#if BLECAST_STREAMING
+    // A payload of an extended message
+    static uint8_t extended[BLECAST_ENCODER_MAX_LENGTH + 100];
+    blecast_encoder_init(&outlier, key, extended, sizeof(extended), 0, 0);
+    indices[0] = 70;
+    check(receiveAround(messageA, sizeof(messageA), true, &outlier, indices, 1), "extended outlier discarded the message");
+#endif
+
+    // Random payloads; some pass a tag, but must not disturb the message
+    BLECastMessage noisy;
+    blecast_init(&noisy, key, buffer, sizeof(buffer));
+    BLECastEncoder encoderA;
+    blecast_encoder_init(&encoderA, key, messageA, sizeof(messageA), 0, 0);
+    bool received = false;
+    for (uint16_t i = 0; i < blecast_encoder_getPayloadCount(&encoderA) && !received; i++) {
+        for (uint16_t j = 0; j < 100; j++) { receive(&noisy, &encoderA, NOISE); }
+        received = receive(&noisy, &encoderA, i);
+    }
+    check(isReceived(&noisy, received, messageA, sizeof(messageA)), "noise discarded the message");
+}
+
+#endif
+
+
+#if BLECAST_ACK_BEACON
+
+// Messages received in a shuffled order; each beacon sent must open (for a sender on the
+// channel it was sent on) to exactly the payloads received so far, or every payload once
+// complete, and with any bit flipped, or on another channel, must be rejected. Beacons
+// must be sent on all 3 channels.
+static void testAck() {
+    uint8_t channels = 0;
+
+    for (uint16_t length = 13; length <= MAX_LENGTH; length += 61) {
+        uint8_t message[MAX_LENGTH];
+        for (uint16_t i = 0; i < length; i++) { message[i] = rand(); }
+
+        BLECastEncoder encoder;
+        blecast_encoder_init(&encoder, key, message, length, 0, 0);
+
+        uint16_t count = blecast_encoder_getPayloadCount(&encoder);
+        uint16_t order[BLECAST_MAX_PAYLOADS];
+        for (uint16_t i = 0; i < count; i++) { order[i] = i; }
+        shuffle(order, count);
+
+        BLECastMessage receiver;
+        blecast_init(&receiver, key, buffer, sizeof(buffer));
+
+        uint8_t received[8] = { 0 };
+        bool complete = false;
+        for (uint16_t sent = 0; sent < count && !complete; sent++) {
+            uint16_t before = sentCount;
+            complete = receive(&receiver, &encoder, order[sent]);
+            received[order[sent] >> 3] |= 1 << (order[sent] & 0x07);
+
+            check(!complete || sentCount != before, "length=%d no beacon on completion", length);
+            if (sentCount == before) { continue; }
+            check(sentChannel <= 2, "length=%d channel=%d", length, sentChannel);
+            channels |= 1 << sentChannel;
+
+            BLECastEncoder sender;
+            blecast_encoder_init(&sender, key, message, length, 0, 0);
+            check(blecast_encoder_readAck(&sender, sentPacket, sentChannel), "length=%d sent=%d beacon rejected", length, sent + 1);
+            for (uint16_t i = 0; i < count; i++) {
+                bool expected = complete || (received[i >> 3] & (1 << (i & 0x07)));
+                check(blecast_encoder_isAcknowledged(&sender, i) == expected,
+                      "length=%d sent=%d payload %d acknowledged=%d", length, sent + 1, i, !expected);
+            }
+
+            blecast_encoder_init(&sender, key, message, length, 0, 0);
+            check(!blecast_encoder_readAck(&sender, sentPacket, (sentChannel + 1) % 3), "length=%d beacon read on another channel", length);
+
+            uint8_t flipped[BLECAST_ENCODER_ACK_PACKET_SIZE];
+            memcpy(flipped, sentPacket, sizeof(flipped));
+            uint16_t bit = rand() % (8 * sizeof(flipped));
+            flipped[bit >> 3] ^= 1 << (bit & 0x07);
+            check(!blecast_encoder_readAck(&sender, flipped, sentChannel), "length=%d flipped bit %d accepted", length, bit);
+        }
+
+        check(complete, "length=%d not complete", length);
+    }
+
+    check(channels == 0x07, "beacons only sent on channels 0x%02x", channels);
+}
+
+#endif
+
+
+int main(void) {
+    srand(1);
+    for (uint8_t i = 0; i < 16; i++) { key[i] = rand(); }
+
+    testMessages();
+#if BLECAST_ERASURE_CODING
+    testErasure();
+#endif
+#if BLECAST_STREAMING
+    testStreaming();
+#endif
+#if BLECAST_SESSIONS
+    testSessions();
+#endif
+#if BLECAST_TAGS
+    testTags();
+#endif
+#if BLECAST_ACK_BEACON
+    testAck();
+#endif
+
+    printf("digest: %08x\n", digest);
+    printf("%s\n", failures ? "FAILED": "passed");
+
+    return failures ? 1: 0;
+}
@@ -0,0 +1,154 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018 Richard Moore <me@ricmoo.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/**
+ *  crc24_test - the CRC-24 known answers (the RFC 4880 check value and others)
+ *  for whichever CRC24_TABLE crc24.c is built with, and random data of every
+ *  length up to past a few slices (and one long buffer) against the bitwise
+ *  CRC-24, computed at once and split into incremental crc24_update calls at
+ *  every offset and in chunks of 1 to 17 bytes.
+ *
+ *  Build (from this folder; add -DCRC24_TABLE=0 to 3 for each implementation, or
+ *  run: make test, which tests all of them):
+ *    cc -O2 -I../src crc24_test.c ../src/crc24.c -o crc24_test
+ *
+ *  Usage:
+ *    crc24_test
+ *
+ *    Prints each failure; exits with 1 if anything failed.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "crc24.h"
+
+
+typedef struct KnownAnswer {
+    const char *data;
+    uint16_t length;
+    uint32_t crc;
+} KnownAnswer;
+
+static const KnownAnswer knownAnswers[] = {
+    { "", 0, 0xb704ce },
+    { "a", 1, 0xf25713 },
+    { "abc", 3, 0xba1c7b },
+    { "123456789", 9, 0x21cf02 },
+    { "message digest", 14, 0xdbf0b6 },
+    { "\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff"
+      "\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff", 32, 0x28b9f1 },
+};
+
+// Random data up to this length is tested at every length and split
+#define MAX_LENGTH             (80)
+
+// And one long buffer
+#define LONG_LENGTH            (4000)
+
+
+static int failures = 0;
+
+#define check(condition, ...)  do { \
+        if (!(condition)) { \
+            failures++; \
+            printf("FAIL %s:%d: ", __func__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+        } \
+    } while (0)
+
+
+// The bitwise CRC-24 (RFC 4880 section 6.1), independent of crc24.c
+static uint32_t getReference(const uint8_t *data, uint16_t length) {
+    uint32_t crc = CRC24_INIT;
+    for (uint16_t i = 0; i < length; i++) {
+        crc ^= (uint32_t)data[i] << 16;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            crc <<= 1;
+            if (crc & 0x1000000) { crc ^= CRC24_POLY; }
+        }
+    }
+    return crc & 0xffffff;
+}
+
+// A small deterministic generator, so the data is the same on any host
+static uint32_t seed = 1;
+
+static uint32_t nextRandom() {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+// Computes the CRC-24 of data with a crc24_update call for every chunk bytes
+static uint32_t getChunked(const uint8_t *data, uint16_t length, uint16_t chunk) {
+    uint32_t crc = CRC24_INIT;
+    for (uint16_t offset = 0; offset < length; offset += chunk) {
+        crc = crc24_update(crc, &data[offset], (length - offset < chunk) ? length - offset: chunk);
+    }
+    return crc;
+}
+
+
+int main(void) {
+    for (uint8_t i = 0; i < sizeof(knownAnswers) / sizeof(knownAnswers[0]); i++) {
+        const KnownAnswer *test = &knownAnswers[i];
+        const uint8_t *data = (const uint8_t*)test->data;
+
+        check(getReference(data, test->length) == test->crc, "reference of vector %d", i);
+
+        uint32_t crc = crc24_compute(data, test->length);
+        check(crc == test->crc, "vector %d is %06x, not %06x", i, crc, test->crc);
+    }
+
+    static uint8_t data[LONG_LENGTH];
+    for (uint16_t i = 0; i < sizeof(data); i++) { data[i] = nextRandom(); }
+
+    for (uint16_t length = 0; length <= MAX_LENGTH; length++) {
+        uint32_t expected = getReference(data, length);
+
+        check(crc24_compute(data, length) == expected, "length=%d", length);
+
+        for (uint16_t split = 0; split <= length; split++) {
+            uint32_t crc = crc24_update(crc24_update(CRC24_INIT, data, split), &data[split], length - split);
+            check(crc == expected, "length=%d split=%d", length, split);
+        }
+
+        for (uint16_t chunk = 1; chunk <= 17; chunk++) {
+            check(getChunked(data, length, chunk) == expected, "length=%d chunk=%d", length, chunk);
+        }
+    }
+
+    uint32_t expected = getReference(data, LONG_LENGTH);
+    check(crc24_compute(data, LONG_LENGTH) == expected, "length=%d", LONG_LENGTH);
+    for (uint16_t chunk = 1; chunk <= 17; chunk++) {
+        check(getChunked(data, LONG_LENGTH, chunk) == expected, "length=%d chunk=%d", LONG_LENGTH, chunk);
+    }
+
+    printf("CRC24_TABLE=%d: %s\n", CRC24_TABLE, failures ? "FAILED": "passed");
+
+    return failures ? 1: 0;
+}
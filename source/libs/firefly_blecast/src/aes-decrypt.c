@@ -0,0 +1,92 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2014 Craig McQueen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  See: https://github.com/cmcqueen/aes-min
+ */
+
+/*****************************************************************************
+ * aes-decrypt.c
+ *
+ * AES-128 decryption using a pre-computed key schedule. This needs 176 bytes
+ * for the key schedule, but no key scheduling is performed per block.
+ ****************************************************************************/
+
+#include "aes-internal.h"
+
+#include <string.h>
+
+/*****************************************************************************
+ * Defines
+ ****************************************************************************/
+
+#define AES_KEY_SCHEDULE_FIRST_RCON     1u
+
+/*****************************************************************************
+ * Functions
+ ****************************************************************************/
+
+/* Expand the 16-byte AES-128 key into the 176-byte key schedule; each round key
+ * is the previous round key, put through one round of the key schedule.
+ */
+void aes128_key_schedule(uint8_t p_key_schedule[AES128_KEY_SCHEDULE_SIZE], const uint8_t p_key[AES128_KEY_SIZE])
+{
+    uint_fast8_t    round;
+    uint8_t         rcon = AES_KEY_SCHEDULE_FIRST_RCON;
+
+    memcpy(p_key_schedule, p_key, AES128_KEY_SIZE);
+
+    for (round = 0; round < AES128_NUM_ROUNDS; ++round)
+    {
+        memcpy(&p_key_schedule[AES_BLOCK_SIZE], p_key_schedule, AES_BLOCK_SIZE);
+        p_key_schedule += AES_BLOCK_SIZE;
+
+        aes128_key_schedule_round(p_key_schedule, rcon);
+
+        /* Next rcon */
+        rcon = aes_mul(rcon, 2u);
+    }
+}
+
+/* AES-128 decryption with a pre-computed key schedule.
+ *
+ * p_block points to a 16-byte buffer of encrypted data to decrypt. Decryption
+ * is done in-place in that buffer.
+ * p_key_schedule is the key schedule from aes128_key_schedule(); it is not
+ * modified, so it may be re-used for any number of blocks.
+ */
+void aes128_decrypt(uint8_t p_block[AES_BLOCK_SIZE], const uint8_t p_key_schedule[AES128_KEY_SCHEDULE_SIZE])
+{
+    uint_fast8_t    round;
+
+    aes_add_round_key(p_block, &p_key_schedule[AES128_NUM_ROUNDS * AES_BLOCK_SIZE]);
+    aes_shift_rows_inv(p_block);
+    aes_sbox_inv_apply_block(p_block);
+    for (round = AES128_NUM_ROUNDS - 1u; round >= 1u; --round)
+    {
+        aes_add_round_key(p_block, &p_key_schedule[round * AES_BLOCK_SIZE]);
+        aes_mix_columns_inv(p_block);
+        aes_shift_rows_inv(p_block);
+        aes_sbox_inv_apply_block(p_block);
+    }
+    aes_add_round_key(p_block, p_key_schedule);
+}
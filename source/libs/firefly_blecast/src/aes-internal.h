@@ -0,0 +1,93 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2014 Craig McQueen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  See: https://github.com/cmcqueen/aes-min
+ */
+
+/*****************************************************************************
+ * aes-internal.h
+ *
+ * Building blocks shared between the AES-128 implementations in this library.
+ ****************************************************************************/
+
+#ifndef AES_INTERNAL_H
+#define AES_INTERNAL_H
+
+/*****************************************************************************
+ * Includes
+ ****************************************************************************/
+
+#include "aes.h"
+
+#ifdef __AVR__
+#include <avr/pgmspace.h>
+#define AES_PROGMEM                 PROGMEM
+#define aes_read_table(addr)        pgm_read_byte(addr)
+#else
+#define AES_PROGMEM
+#define aes_read_table(addr)        (*(const uint8_t*)(addr))
+#endif
+
+/*****************************************************************************
+ * Inline functions
+ ****************************************************************************/
+
+// XOR the specified round key into the AES block.
+static inline void aes_add_round_key(uint8_t p_block[AES_BLOCK_SIZE], const uint8_t p_round_key[AES_BLOCK_SIZE]) {
+    uint_fast8_t i;
+
+    for (i = 0; i < AES_BLOCK_SIZE; ++i) {
+        p_block[i] ^= p_round_key[i];
+    }
+}
+
+/*****************************************************************************
+ * Function prototypes
+ ****************************************************************************/
+
+#ifdef __cplusplus
+extern "C"{
+#endif  /* __cplusplus */
+
+uint8_t aes_mul(uint8_t a, uint8_t b);
+
+uint8_t aes_sbox(uint8_t a);
+uint8_t aes_sbox_inv(uint8_t a);
+
+void aes_sbox_apply_block(uint8_t p_block[AES_BLOCK_SIZE]);
+void aes_sbox_inv_apply_block(uint8_t p_block[AES_BLOCK_SIZE]);
+
+void aes_shift_rows(uint8_t p_block[AES_BLOCK_SIZE]);
+void aes_shift_rows_inv(uint8_t p_block[AES_BLOCK_SIZE]);
+
+void aes_mix_columns(uint8_t p_block[AES_BLOCK_SIZE]);
+void aes_mix_columns_inv(uint8_t p_block[AES_BLOCK_SIZE]);
+
+void aes128_key_schedule_round(uint8_t p_key[AES128_KEY_SIZE], uint8_t rcon);
+
+#ifdef __cplusplus
+}
+#endif  /* __cplusplus */
+
+
+#endif /* !defined(AES_INTERNAL_H) */
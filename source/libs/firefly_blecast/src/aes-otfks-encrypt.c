@@ -0,0 +1,75 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2014 Craig McQueen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ *
+ *  See: https://github.com/cmcqueen/aes-min
+ */
+
+/*****************************************************************************
+ * aes-otfks-encrypt.c
+ *
+ * AES-128 encryption with on-the-fly key schedule calculation. This is only
+ * needed to produce payloads (the BLECast encoder); the receiver only decrypts.
+ ****************************************************************************/
+
+#include "aes-internal.h"
+
+/*****************************************************************************
+ * Defines
+ ****************************************************************************/
+
+#define AES_KEY_SCHEDULE_FIRST_RCON     1u
+
+/*****************************************************************************
+ * Functions
+ ****************************************************************************/
+
+/* AES-128 encryption with on-the-fly key schedule calculation.
+ *
+ * p_block points to a 16-byte buffer of plain data to encrypt. Encryption
+ * is done in-place in that buffer.
+ * p_key must initially point to the AES-128 16-byte key. Key schedule is
+ * calculated on-the-fly in that buffer, so the buffer must re-initialised for
+ * subsequent encryption operations.
+ */
+void aes128_otfks_encrypt(uint8_t p_block[AES_BLOCK_SIZE], uint8_t p_key[AES128_KEY_SIZE])
+{
+    uint_fast8_t    round;
+    uint8_t         rcon = AES_KEY_SCHEDULE_FIRST_RCON;
+
+    aes_add_round_key(p_block, p_key);
+    for (round = 1; round < AES128_NUM_ROUNDS; ++round)
+    {
+        aes_sbox_apply_block(p_block);
+        aes_shift_rows(p_block);
+        aes_mix_columns(p_block);
+        aes128_key_schedule_round(p_key, rcon);
+        aes_add_round_key(p_block, p_key);
+
+        /* Next rcon */
+        rcon = aes_mul(rcon, 2u);
+    }
+    aes_sbox_apply_block(p_block);
+    aes_shift_rows(p_block);
+    aes128_key_schedule_round(p_key, rcon);
+    aes_add_round_key(p_block, p_key);
+}
@@ -54,6 +54,14 @@
 #define AES128_KEY_SIZE             16u
 #define AES128_KEY_SCHEDULE_SIZE    (AES_BLOCK_SIZE * (AES128_NUM_ROUNDS + 1u))
 
+/* If non-zero, the S-box and inverse S-box are 256-byte lookup tables (in
+ * PROGMEM on AVR; 512 bytes of flash in total). Otherwise each substitution is
+ * computed from the GF(2^8) inverse, which is smaller but much slower.
+ */
+#ifndef AES_SBOX_TABLE
+#define AES_SBOX_TABLE              1
+#endif
+
 /*****************************************************************************
  * Function prototypes
  ****************************************************************************/
@@ -63,9 +71,9 @@ extern "C"{
 #endif  /* __cplusplus */
 
 //void aes128_encrypt(uint8_t p_block[AES_BLOCK_SIZE], const uint8_t p_key_schedule[AES128_KEY_SCHEDULE_SIZE]);
-//void aes128_decrypt(uint8_t p_block[AES_BLOCK_SIZE], const uint8_t p_key_schedule[AES128_KEY_SCHEDULE_SIZE]);
+void aes128_decrypt(uint8_t p_block[AES_BLOCK_SIZE], const uint8_t p_key_schedule[AES128_KEY_SCHEDULE_SIZE]);
 
-//void aes128_key_schedule(uint8_t p_key_schedule[AES128_KEY_SCHEDULE_SIZE], const uint8_t p_key[AES128_KEY_SIZE]);
+void aes128_key_schedule(uint8_t p_key_schedule[AES128_KEY_SCHEDULE_SIZE], const uint8_t p_key[AES128_KEY_SIZE]);
 
 void aes128_otfks_encrypt(uint8_t p_block[AES_BLOCK_SIZE], uint8_t p_key[AES128_KEY_SIZE]);
 void aes128_otfks_decrypt(uint8_t p_block[AES_BLOCK_SIZE], uint8_t p_decrypt_start_key[AES128_KEY_SIZE]);
@@ -0,0 +1,252 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018 Richard Moore <me@ricmoo.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "crc24.h"
+
+#ifdef __AVR__
+#include <avr/pgmspace.h>
+#else
+#define PROGMEM
+#define pgm_read_byte(addr)    (*(const uint8_t*)(addr))
+#endif
+
+
+#if CRC24_TABLE == CRC24_TABLE_NONE
+
+uint32_t crc24_update(uint32_t crc, const uint8_t *data, uint16_t length) {
+    for (uint16_t i = 0; i < length; i++) {
+        crc ^= ((uint32_t)data[i]) << 16;
+
+        for (uint8_t j = 0; j < 8; j++) {
+            crc <<= 1;
+            if (crc & 0x1000000) {
+                crc ^= CRC24_POLY;
+            }
+        }
+    }
+
+    return crc & 0xffffff;
+}
+
+#elif CRC24_TABLE == CRC24_TABLE_NIBBLE
+
+// The CRC-24 of each nibble (in the top 4 bits), split into its high, middle and low bytes
+const uint8_t crc24NibbleHi[] PROGMEM = {
+    0x00, 0x86, 0x8a, 0x0c, 0x93, 0x15, 0x19, 0x9f, 0xa1, 0x27, 0x2b, 0xad, 0x32, 0xb4, 0xb8, 0x3e
+};
+
+const uint8_t crc24NibbleMid[] PROGMEM = {
+    0x00, 0x4c, 0xd5, 0x99, 0xe6, 0xaa, 0x33, 0x7f, 0x81, 0xcd, 0x54, 0x18, 0x67, 0x2b, 0xb2, 0xfe
+};
+
+const uint8_t crc24NibbleLo[] PROGMEM = {
+    0x00, 0xfb, 0x0d, 0xf6, 0xe1, 0x1a, 0xec, 0x17, 0x39, 0xc2, 0x34, 0xcf, 0xd8, 0x23, 0xd5, 0x2e
+};
+
+uint32_t crc24_update(uint32_t crc, const uint8_t *data, uint16_t length) {
+    for (uint16_t i = 0; i < length; i++) {
+        crc ^= ((uint32_t)data[i]) << 16;
+
+        for (uint8_t j = 0; j < 2; j++) {
+            uint8_t index = (crc >> 20) & 0x0f;
+            crc = (crc << 4) & 0xffffff;
+            crc ^= ((uint32_t)pgm_read_byte(&crc24NibbleHi[index])) << 16;
+            crc ^= ((uint16_t)pgm_read_byte(&crc24NibbleMid[index])) << 8;
+            crc ^= pgm_read_byte(&crc24NibbleLo[index]);
+        }
+    }
+
+    return crc;
+}
+
+#elif CRC24_TABLE == CRC24_TABLE_BYTE
+
+// The CRC-24 of each byte (in the top 8 bits), split into its high, middle and low bytes
+// so that each step is only 8-bit operations
+const uint8_t crc24ByteHi[] PROGMEM = {
+    0x00, 0x86, 0x8a, 0x0c, 0x93, 0x15, 0x19, 0x9f, 0xa1, 0x27, 0x2b, 0xad, 0x32, 0xb4, 0xb8, 0x3e,
+    0xc5, 0x43, 0x4f, 0xc9, 0x56, 0xd0, 0xdc, 0x5a, 0x64, 0xe2, 0xee, 0x68, 0xf7, 0x71, 0x7d, 0xfb,
+    0x0c, 0x8a, 0x86, 0x00, 0x9f, 0x19, 0x15, 0x93, 0xad, 0x2b, 0x27, 0xa1, 0x3e, 0xb8, 0xb4, 0x32,
+    0xc9, 0x4f, 0x43, 0xc5, 0x5a, 0xdc, 0xd0, 0x56, 0x68, 0xee, 0xe2, 0x64, 0xfb, 0x7d, 0x71, 0xf7,
+    0x19, 0x9f, 0x93, 0x15, 0x8a, 0x0c, 0x00, 0x86, 0xb8, 0x3e, 0x32, 0xb4, 0x2b, 0xad, 0xa1, 0x27,
+    0xdc, 0x5a, 0x56, 0xd0, 0x4f, 0xc9, 0xc5, 0x43, 0x7d, 0xfb, 0xf7, 0x71, 0xee, 0x68, 0x64, 0xe2,
+    0x15, 0x93, 0x9f, 0x19, 0x86, 0x00, 0x0c, 0x8a, 0xb4, 0x32, 0x3e, 0xb8, 0x27, 0xa1, 0xad, 0x2b,
+    0xd0, 0x56, 0x5a, 0xdc, 0x43, 0xc5, 0xc9, 0x4f, 0x71, 0xf7, 0xfb, 0x7d, 0xe2, 0x64, 0x68, 0xee,
+    0x33, 0xb5, 0xb9, 0x3f, 0xa0, 0x26, 0x2a, 0xac, 0x92, 0x14, 0x18, 0x9e, 0x01, 0x87, 0x8b, 0x0d,
+    0xf6, 0x70, 0x7c, 0xfa, 0x65, 0xe3, 0xef, 0x69, 0x57, 0xd1, 0xdd, 0x5b, 0xc4, 0x42, 0x4e, 0xc8,
+    0x3f, 0xb9, 0xb5, 0x33, 0xac, 0x2a, 0x26, 0xa0, 0x9e, 0x18, 0x14, 0x92, 0x0d, 0x8b, 0x87, 0x01,
+    0xfa, 0x7c, 0x70, 0xf6, 0x69, 0xef, 0xe3, 0x65, 0x5b, 0xdd, 0xd1, 0x57, 0xc8, 0x4e, 0x42, 0xc4,
+    0x2a, 0xac, 0xa0, 0x26, 0xb9, 0x3f, 0x33, 0xb5, 0x8b, 0x0d, 0x01, 0x87, 0x18, 0x9e, 0x92, 0x14,
+    0xef, 0x69, 0x65, 0xe3, 0x7c, 0xfa, 0xf6, 0x70, 0x4e, 0xc8, 0xc4, 0x42, 0xdd, 0x5b, 0x57, 0xd1,
+    0x26, 0xa0, 0xac, 0x2a, 0xb5, 0x33, 0x3f, 0xb9, 0x87, 0x01, 0x0d, 0x8b, 0x14, 0x92, 0x9e, 0x18,
+    0xe3, 0x65, 0x69, 0xef, 0x70, 0xf6, 0xfa, 0x7c, 0x42, 0xc4, 0xc8, 0x4e, 0xd1, 0x57, 0x5b, 0xdd
+};
+
+const uint8_t crc24ByteMid[] PROGMEM = {
+    0x00, 0x4c, 0xd5, 0x99, 0xe6, 0xaa, 0x33, 0x7f, 0x81, 0xcd, 0x54, 0x18, 0x67, 0x2b, 0xb2, 0xfe,
+    0x4e, 0x02, 0x9b, 0xd7, 0xa8, 0xe4, 0x7d, 0x31, 0xcf, 0x83, 0x1a, 0x56, 0x29, 0x65, 0xfc, 0xb0,
+    0xd1, 0x9d, 0x04, 0x48, 0x37, 0x7b, 0xe2, 0xae, 0x50, 0x1c, 0x85, 0xc9, 0xb6, 0xfa, 0x63, 0x2f,
+    0x9f, 0xd3, 0x4a, 0x06, 0x79, 0x35, 0xac, 0xe0, 0x1e, 0x52, 0xcb, 0x87, 0xf8, 0xb4, 0x2d, 0x61,
+    0xa3, 0xef, 0x76, 0x3a, 0x45, 0x09, 0x90, 0xdc, 0x22, 0x6e, 0xf7, 0xbb, 0xc4, 0x88, 0x11, 0x5d,
+    0xed, 0xa1, 0x38, 0x74, 0x0b, 0x47, 0xde, 0x92, 0x6c, 0x20, 0xb9, 0xf5, 0x8a, 0xc6, 0x5f, 0x13,
+    0x72, 0x3e, 0xa7, 0xeb, 0x94, 0xd8, 0x41, 0x0d, 0xf3, 0xbf, 0x26, 0x6a, 0x15, 0x59, 0xc0, 0x8c,
+    0x3c, 0x70, 0xe9, 0xa5, 0xda, 0x96, 0x0f, 0x43, 0xbd, 0xf1, 0x68, 0x24, 0x5b, 0x17, 0x8e, 0xc2,
+    0x47, 0x0b, 0x92, 0xde, 0xa1, 0xed, 0x74, 0x38, 0xc6, 0x8a, 0x13, 0x5f, 0x20, 0x6c, 0xf5, 0xb9,
+    0x09, 0x45, 0xdc, 0x90, 0xef, 0xa3, 0x3a, 0x76, 0x88, 0xc4, 0x5d, 0x11, 0x6e, 0x22, 0xbb, 0xf7,
+    0x96, 0xda, 0x43, 0x0f, 0x70, 0x3c, 0xa5, 0xe9, 0x17, 0x5b, 0xc2, 0x8e, 0xf1, 0xbd, 0x24, 0x68,
+    0xd8, 0x94, 0x0d, 0x41, 0x3e, 0x72, 0xeb, 0xa7, 0x59, 0x15, 0x8c, 0xc0, 0xbf, 0xf3, 0x6a, 0x26,
+    0xe4, 0xa8, 0x31, 0x7d, 0x02, 0x4e, 0xd7, 0x9b, 0x65, 0x29, 0xb0, 0xfc, 0x83, 0xcf, 0x56, 0x1a,
+    0xaa, 0xe6, 0x7f, 0x33, 0x4c, 0x00, 0x99, 0xd5, 0x2b, 0x67, 0xfe, 0xb2, 0xcd, 0x81, 0x18, 0x54,
+    0x35, 0x79, 0xe0, 0xac, 0xd3, 0x9f, 0x06, 0x4a, 0xb4, 0xf8, 0x61, 0x2d, 0x52, 0x1e, 0x87, 0xcb,
+    0x7b, 0x37, 0xae, 0xe2, 0x9d, 0xd1, 0x48, 0x04, 0xfa, 0xb6, 0x2f, 0x63, 0x1c, 0x50, 0xc9, 0x85
+};
+
+const uint8_t crc24ByteLo[] PROGMEM = {
+    0x00, 0xfb, 0x0d, 0xf6, 0xe1, 0x1a, 0xec, 0x17, 0x39, 0xc2, 0x34, 0xcf, 0xd8, 0x23, 0xd5, 0x2e,
+    0x89, 0x72, 0x84, 0x7f, 0x68, 0x93, 0x65, 0x9e, 0xb0, 0x4b, 0xbd, 0x46, 0x51, 0xaa, 0x5c, 0xa7,
+    0xe9, 0x12, 0xe4, 0x1f, 0x08, 0xf3, 0x05, 0xfe, 0xd0, 0x2b, 0xdd, 0x26, 0x31, 0xca, 0x3c, 0xc7,
+    0x60, 0x9b, 0x6d, 0x96, 0x81, 0x7a, 0x8c, 0x77, 0x59, 0xa2, 0x54, 0xaf, 0xb8, 0x43, 0xb5, 0x4e,
+    0xd2, 0x29, 0xdf, 0x24, 0x33, 0xc8, 0x3e, 0xc5, 0xeb, 0x10, 0xe6, 0x1d, 0x0a, 0xf1, 0x07, 0xfc,
+    0x5b, 0xa0, 0x56, 0xad, 0xba, 0x41, 0xb7, 0x4c, 0x62, 0x99, 0x6f, 0x94, 0x83, 0x78, 0x8e, 0x75,
+    0x3b, 0xc0, 0x36, 0xcd, 0xda, 0x21, 0xd7, 0x2c, 0x02, 0xf9, 0x0f, 0xf4, 0xe3, 0x18, 0xee, 0x15,
+    0xb2, 0x49, 0xbf, 0x44, 0x53, 0xa8, 0x5e, 0xa5, 0x8b, 0x70, 0x86, 0x7d, 0x6a, 0x91, 0x67, 0x9c,
+    0xa4, 0x5f, 0xa9, 0x52, 0x45, 0xbe, 0x48, 0xb3, 0x9d, 0x66, 0x90, 0x6b, 0x7c, 0x87, 0x71, 0x8a,
+    0x2d, 0xd6, 0x20, 0xdb, 0xcc, 0x37, 0xc1, 0x3a, 0x14, 0xef, 0x19, 0xe2, 0xf5, 0x0e, 0xf8, 0x03,
+    0x4d, 0xb6, 0x40, 0xbb, 0xac, 0x57, 0xa1, 0x5a, 0x74, 0x8f, 0x79, 0x82, 0x95, 0x6e, 0x98, 0x63,
+    0xc4, 0x3f, 0xc9, 0x32, 0x25, 0xde, 0x28, 0xd3, 0xfd, 0x06, 0xf0, 0x0b, 0x1c, 0xe7, 0x11, 0xea,
+    0x76, 0x8d, 0x7b, 0x80, 0x97, 0x6c, 0x9a, 0x61, 0x4f, 0xb4, 0x42, 0xb9, 0xae, 0x55, 0xa3, 0x58,
+    0xff, 0x04, 0xf2, 0x09, 0x1e, 0xe5, 0x13, 0xe8, 0xc6, 0x3d, 0xcb, 0x30, 0x27, 0xdc, 0x2a, 0xd1,
+    0x9f, 0x64, 0x92, 0x69, 0x7e, 0x85, 0x73, 0x88, 0xa6, 0x5d, 0xab, 0x50, 0x47, 0xbc, 0x4a, 0xb1,
+    0x16, 0xed, 0x1b, 0xe0, 0xf7, 0x0c, 0xfa, 0x01, 0x2f, 0xd4, 0x22, 0xd9, 0xce, 0x35, 0xc3, 0x38
+};
+
+uint32_t crc24_update(uint32_t crc, const uint8_t *data, uint16_t length) {
+    uint8_t hi = crc >> 16, mid = crc >> 8, lo = crc;
+
+    for (uint16_t i = 0; i < length; i++) {
+        uint8_t index = hi ^ data[i];
+        hi = mid ^ pgm_read_byte(&crc24ByteHi[index]);
+        mid = lo ^ pgm_read_byte(&crc24ByteMid[index]);
+        lo = pgm_read_byte(&crc24ByteLo[index]);
+    }
+
+    return ((uint32_t)hi << 16) | ((uint16_t)mid << 8) | lo;
+}
+
+#elif CRC24_TABLE == CRC24_TABLE_SLICE8
+
+#ifdef __AVR__
+#error CRC24_TABLE_SLICE8 is only intended for host tools
+#endif
+
+// Slicing-by-8; the CRC is kept in the top 24 bits of a 32-bit register, which
+// makes this a regular MSB-first CRC-32 with the polynomial shifted up 8 bits.
+// See: https://create.stephan-brumme.com/crc32/#slicing-by-8-overview
+
+static uint32_t crc24Slices[8][256];
+static uint8_t crc24SlicesReady = 0;
+
+static void crc24_initSlices() {
+    for (uint16_t i = 0; i < 256; i++) {
+        uint32_t crc = (uint32_t)i << 24;
+        for (uint8_t j = 0; j < 8; j++) {
+            crc = (crc << 1) ^ ((crc & 0x80000000) ? ((uint32_t)CRC24_POLY << 8): 0);
+        }
+        crc24Slices[0][i] = crc;
+    }
+
+    for (uint16_t i = 0; i < 256; i++) {
+        for (uint8_t k = 1; k < 8; k++) {
+            uint32_t crc = crc24Slices[k - 1][i];
+            crc24Slices[k][i] = (crc << 8) ^ crc24Slices[0][crc >> 24];
+        }
+    }
+
+    crc24SlicesReady = 1;
+}
+
+uint32_t crc24_update(uint32_t crc, const uint8_t *data, uint16_t length) {
+    if (!crc24SlicesReady) { crc24_initSlices(); }
+
+    crc <<= 8;
+
+    while (length >= 8) {
+        uint32_t one = crc ^ (((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3]);
+        uint32_t two = ((uint32_t)data[4] << 24) | ((uint32_t)data[5] << 16) | ((uint32_t)data[6] << 8) | data[7];
+
+        crc = crc24Slices[7][one >> 24] ^ crc24Slices[6][(one >> 16) & 0xff] ^
+              crc24Slices[5][(one >> 8) & 0xff] ^ crc24Slices[4][one & 0xff] ^
+              crc24Slices[3][two >> 24] ^ crc24Slices[2][(two >> 16) & 0xff] ^
+              crc24Slices[1][(two >> 8) & 0xff] ^ crc24Slices[0][two & 0xff];
+
+        data += 8;
+        length -= 8;
+    }
+
+    while (length--) {
+        crc = (crc << 8) ^ crc24Slices[0][(crc >> 24) ^ *data++];
+    }
+
+    return crc >> 8;
+}
+
+#else
+
+#error Unsupported CRC24_TABLE
+
+#endif
+
+
+uint32_t crc24_compute(const uint8_t *data, uint16_t length) {
+    return crc24_update(CRC24_INIT, data, length);
+}
+
+
+// The BLE link layer CRC (Core Specification B.3.1.1); the polynomial
+// x^24 + x^10 + x^9 + x^6 + x^4 + x^3 + x + 1 with an initial value of 0x555555,
+// over the bits of the PDU as sent (least significant bit first). The CRC itself
+// is sent most significant bit first, so each byte is bit reversed.
+void crc24_ble(const uint8_t *data, uint16_t length, uint8_t *crc) {
+    uint32_t state = 0x555555;
+
+    while (length--) {
+        uint8_t value = *data++;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            uint8_t feedback = ((state >> 23) ^ value) & 0x01;
+            state = (state << 1) & 0xffffff;
+            if (feedback) { state ^= 0x00065b; }
+            value >>= 1;
+        }
+    }
+
+    for (uint8_t i = 0; i < 3; i++) {
+        uint8_t value = state >> (16 - 8 * i);
+        uint8_t reversed = 0;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            reversed = (reversed << 1) | (value & 0x01);
+            value >>= 1;
+        }
+        crc[i] = reversed;
+    }
+}
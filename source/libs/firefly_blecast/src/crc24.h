@@ -0,0 +1,71 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018 Richard Moore <me@ricmoo.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ *  Cyclic Redundancy Check - 24 bit (CRC24)
+ *
+ *  See: http://sunsite.icm.edu.pl/gnupg/rfc2440-6.html
+ */
+
+#ifndef _CRC24_H_
+#define _CRC24_H_
+
+#include <stdint.h>
+
+
+#define CRC24_INIT                0xb704ce
+#define CRC24_POLY                0x1864cfb
+
+
+// Implementations; trading flash for speed
+#define CRC24_TABLE_NONE          0     // Bit-by-bit; no table
+#define CRC24_TABLE_NIBBLE        1     // 48 byte table (PROGMEM); 2 lookups per byte
+#define CRC24_TABLE_BYTE          2     // 768 byte table (PROGMEM); 1 lookup per byte
+#define CRC24_TABLE_SLICE8        3     // 8kb table (generated in RAM); host tools only
+
+#ifndef CRC24_TABLE
+#define CRC24_TABLE               CRC24_TABLE_NIBBLE
+#endif
+
+
+#ifdef __cplusplus
+extern "C"{
+#endif  /* __cplusplus */
+
+// Continue a CRC-24 over more data; begin with crc = CRC24_INIT
+uint32_t crc24_update(uint32_t crc, const uint8_t *data, uint16_t length);
+
+// Compute the CRC-24 of data
+uint32_t crc24_compute(const uint8_t *data, uint16_t length);
+
+// Compute the BLE link layer CRC-24 of a PDU (a different polynomial and bit order;
+// see crc24.c), writing the 3 bytes to append to the PDU to crc
+void crc24_ble(const uint8_t *data, uint16_t length, uint8_t *crc);
+
+#ifdef __cplusplus
+}
+#endif  /* __cplusplus */
+
+
+#endif  /* _CRC24_H_ */
@@ -32,6 +32,16 @@
 #include "firefly_blecast.h"
 
 #include "aes.h"
+#include "crc24.h"
+
+#if BLECAST_ERASURE_CODING
+#include <firefly_qrcode.h>
+#endif
+
+#if BLECAST_MOCK_RADIO
+#define PROGMEM
+#define pgm_read_byte(addr)    (*(const uint8_t*)(addr))
+#endif
 
 
 // We use this to pack enums into uint8_t
@@ -78,6 +88,9 @@ enum RadioRegister {
     RadioRegisterReceivePayloadWidthPipe0  = 0x11,
     RadioRegisterReceivePayloadWidthPipe1  = 0x12,
 
+    // Transmit
+    RadioRegisterTransmitAddress           = 0x10,
+
     RadioRegisterFIFOStatus                = 0x17,
 } attribute(packed);
 typedef enum RadioRegister RadioRegister;
@@ -87,7 +100,10 @@ enum RadioCommand {
     RadioCommandReadRegister       = 0x00,
     RadioCommandWriteRegister      = 0x20,
     RadioCommandReadPayload        = 0x61,
+    RadioCommandWritePayload       = 0xa0,
+    RadioCommandFlushTransmit      = 0xe1,
     RadioCommandFlushReceive       = 0xe2,
+    RadioCommandNop                = 0xff,
 } attribute(packed);
 typedef enum RadioCommand RadioCommand;
 
@@ -123,10 +139,23 @@ enum SPIStatus {
 } attribute(packed);
 typedef enum SPIStatus SPIStatus;
 
+enum PayloadResult {
+    // The payload was not for us (bad CRC) or could not be used
+    PayloadResultRejected              = 0,
+
+    // The payload was valid (but the message is not yet complete)
+    PayloadResultAccepted              = 1,
+
+    // The payload was valid and completed the message
+    PayloadResultComplete              = 2,
+} attribute(packed);
+typedef enum PayloadResult PayloadResult;
+
 STATIC_ASSERT( sizeof ( RadioRegister ) == 1, "RadioRegister is incorrect width");
 STATIC_ASSERT( sizeof ( RadioCommand ) == 1, "RadioCommand is incorrect width");
 STATIC_ASSERT( sizeof ( SPIControl ) == 1, "SPIControl is incorrect width");
 STATIC_ASSERT( sizeof ( SPIStatus ) == 1, "SPIStatus is incorrect width");
+STATIC_ASSERT( sizeof ( PayloadResult ) == 1, "PayloadResult is incorrect width");
 
 
 const uint8_t RadioRegisterMask = 0x1f;
@@ -135,58 +164,64 @@ const uint8_t RadioRegisterMask = 0x1f;
 // The size required to read a BLECast packet (1 byte PDU type and 16 bytes address)
 #define BLECAST_PACKET_SIZE    (1 + 16)
 
-// The size of a BLE packet
-#define BLE_PACKET_SIZE        (32)
-
-
-#define NEXT_CHANNEL      (0x7f)
-
-#define RADIO_SPEED       (10000000)
+// The bytes of each BLE packet the radio captures; the PDU type, the 12 bytes of BLE
+// metadata (length, advertiser address and advertising data headers) and the 16 bytes
+// of BLECast data. Anything after that is not needed, so is never clocked out.
+#define RADIO_PAYLOAD_SIZE     (1 + 12 + 16)
 
+// An acknowledgment beacon; a complete BLE advertising packet (with the BLE CRC)
+#define ACK_PACKET_SIZE        (32)
 
 
-/**
- *  Cyclic Redundancy Check - 24 bit (CRC24)
- *
- *  See: http://sunsite.icm.edu.pl/gnupg/rfc2440-6.html
- */
+#define NEXT_CHANNEL      (0x7f)
 
-#define CRC24_INIT      0xb704ce
-#define CRC24_POLY      0x1864cfb
+// Each valid payload adds this to the (decaying) score of its channel
+#define CHANNEL_SCORE_STEP    (16)
 
-static uint32_t computeCrc24(uint8_t *data, uint16_t length) {
-    uint32_t crc = CRC24_INIT;
+#define RADIO_SPEED       (10000000)
 
-    for (uint16_t i = 0; i < length; i++) {
-        crc ^= ((uint32_t)data[i]) << 16;
+// Receive counters (see BLECAST_STATS)
+#if BLECAST_STATS
+#define blecast_count(message, counter)    ((message)->stats.counter++)
+#else
+#define blecast_count(message, counter)
+#endif
 
-        for (uint8_t j = 0; j < 8; j++) {
-            crc <<= 1;
-            if (crc & 0x1000000) {
-                crc ^= CRC24_POLY;
-            }
-        }
-    }
 
-    return crc & 0xffffff;
-}
 
-// Reverse the bits in a byte (BLE bytes are backward)
-static uint8_t reverse(uint8_t v) {
+// Reverses the bits in a byte (BLE bytes are backward)
+const uint8_t reverseBits[] PROGMEM = {
+    0x00, 0x80, 0x40, 0xc0, 0x20, 0xa0, 0x60, 0xe0, 0x10, 0x90, 0x50, 0xd0, 0x30, 0xb0, 0x70, 0xf0,
+    0x08, 0x88, 0x48, 0xc8, 0x28, 0xa8, 0x68, 0xe8, 0x18, 0x98, 0x58, 0xd8, 0x38, 0xb8, 0x78, 0xf8,
+    0x04, 0x84, 0x44, 0xc4, 0x24, 0xa4, 0x64, 0xe4, 0x14, 0x94, 0x54, 0xd4, 0x34, 0xb4, 0x74, 0xf4,
+    0x0c, 0x8c, 0x4c, 0xcc, 0x2c, 0xac, 0x6c, 0xec, 0x1c, 0x9c, 0x5c, 0xdc, 0x3c, 0xbc, 0x7c, 0xfc,
+    0x02, 0x82, 0x42, 0xc2, 0x22, 0xa2, 0x62, 0xe2, 0x12, 0x92, 0x52, 0xd2, 0x32, 0xb2, 0x72, 0xf2,
+    0x0a, 0x8a, 0x4a, 0xca, 0x2a, 0xaa, 0x6a, 0xea, 0x1a, 0x9a, 0x5a, 0xda, 0x3a, 0xba, 0x7a, 0xfa,
+    0x06, 0x86, 0x46, 0xc6, 0x26, 0xa6, 0x66, 0xe6, 0x16, 0x96, 0x56, 0xd6, 0x36, 0xb6, 0x76, 0xf6,
+    0x0e, 0x8e, 0x4e, 0xce, 0x2e, 0xae, 0x6e, 0xee, 0x1e, 0x9e, 0x5e, 0xde, 0x3e, 0xbe, 0x7e, 0xfe,
+    0x01, 0x81, 0x41, 0xc1, 0x21, 0xa1, 0x61, 0xe1, 0x11, 0x91, 0x51, 0xd1, 0x31, 0xb1, 0x71, 0xf1,
+    0x09, 0x89, 0x49, 0xc9, 0x29, 0xa9, 0x69, 0xe9, 0x19, 0x99, 0x59, 0xd9, 0x39, 0xb9, 0x79, 0xf9,
+    0x05, 0x85, 0x45, 0xc5, 0x25, 0xa5, 0x65, 0xe5, 0x15, 0x95, 0x55, 0xd5, 0x35, 0xb5, 0x75, 0xf5,
+    0x0d, 0x8d, 0x4d, 0xcd, 0x2d, 0xad, 0x6d, 0xed, 0x1d, 0x9d, 0x5d, 0xdd, 0x3d, 0xbd, 0x7d, 0xfd,
+    0x03, 0x83, 0x43, 0xc3, 0x23, 0xa3, 0x63, 0xe3, 0x13, 0x93, 0x53, 0xd3, 0x33, 0xb3, 0x73, 0xf3,
+    0x0b, 0x8b, 0x4b, 0xcb, 0x2b, 0xab, 0x6b, 0xeb, 0x1b, 0x9b, 0x5b, 0xdb, 0x3b, 0xbb, 0x7b, 0xfb,
+    0x07, 0x87, 0x47, 0xc7, 0x27, 0xa7, 0x67, 0xe7, 0x17, 0x97, 0x57, 0xd7, 0x37, 0xb7, 0x77, 0xf7,
+    0x0f, 0x8f, 0x4f, 0xcf, 0x2f, 0xaf, 0x6f, 0xef, 0x1f, 0x9f, 0x5f, 0xdf, 0x3f, 0xbf, 0x7f, 0xff
+};
 
-    uint8_t result = 0;
+#if BLECAST_MOCK_RADIO
 
-    if (v & (1 << 0)) { result |= (1 << 7); }
-    if (v & (1 << 1)) { result |= (1 << 6); }
-    if (v & (1 << 2)) { result |= (1 << 5); }
-    if (v & (1 << 3)) { result |= (1 << 4); }
-    if (v & (1 << 4)) { result |= (1 << 3); }
-    if (v & (1 << 5)) { result |= (1 << 2); }
-    if (v & (1 << 6)) { result |= (1 << 1); }
-    if (v & (1 << 7)) { result |= (1 << 0); }
+// The radio is provided by the host simulator (see extras/blecast_simulate.c)
+void radio_init(BLECastMessage *message);
+void radio_shutdown(BLECastMessage *message);
+void radio_startListening(BLECastMessage *message);
+void radio_stopListening(BLECastMessage *message);
+uint8_t radio_available(BLECastMessage *message);
+void radio_read_packet(BLECastMessage *message, uint8_t *buffer);
+void radio_setChannel(BLECastMessage *message, uint8_t channel);
+void radio_send_packet(BLECastMessage *message, const uint8_t *packet);
 
-    return result;
-}
+#else
 
 // Returns ((clockRateFosc << 1) | SPIStatusDoubleSpeed)
 static uint8_t spi_getClockRate(uint32_t clock) {
@@ -246,22 +281,46 @@ static void spi_shutdown() {
     SPCR &= ~SPIControlEnabled;
 }
 
+#if defined(BLECAST_PIN_CE_PORT) && defined(BLECAST_PIN_CSN_PORT)
+
+// The data direction register directly precedes the port register (on the ATmega328P,
+// for ports B, C and D; see BLECAST_PIN_CE_PORT)
+#define RADIO_PIN_DDR(port)    (*(&(port) - 1))
+
+// The pins are known at compile time, so each toggle is a single sbi/cbi (for a port
+// in the low I/O space, as every ATmega328P port is)
+#define radio_ce(message, enable)    ((enable) ? (BLECAST_PIN_CE_PORT |= (1 << BLECAST_PIN_CE_BIT)): \
+                                       (BLECAST_PIN_CE_PORT &= ~(1 << BLECAST_PIN_CE_BIT)))
+#define radio_csn(message, enable)   ((enable) ? (BLECAST_PIN_CSN_PORT |= (1 << BLECAST_PIN_CSN_BIT)): \
+                                       (BLECAST_PIN_CSN_PORT &= ~(1 << BLECAST_PIN_CSN_BIT)))
+
+static void radio_initPins(BLECastMessage *message) {
+    RADIO_PIN_DDR(BLECAST_PIN_CE_PORT) |= (1 << BLECAST_PIN_CE_BIT);
+    RADIO_PIN_DDR(BLECAST_PIN_CSN_PORT) |= (1 << BLECAST_PIN_CSN_BIT);
+}
+
+#else
+
 static void radio_ce(BLECastMessage *message, uint8_t enable) {
     digitalWrite(message->radioPinCE, enable ? HIGH: LOW);
 }
 
 static void radio_csn(BLECastMessage *message, uint8_t enable) {
     digitalWrite(message->radioPinCSN, enable ? HIGH: LOW);
-    delayMicroseconds(5);
 }
 
-static void radio_beginTransaction(BLECastMessage *message) {
-    radio_csn(message, 0);
+static void radio_initPins(BLECastMessage *message) {
+    pinMode(message->radioPinCE, OUTPUT);
+    pinMode(message->radioPinCSN, OUTPUT);
 }
 
-static void radio_endTransaction(BLECastMessage *message) {
-    radio_csn(message, 1);
-}
+#endif
+
+// No delay is needed around CSN; the nRF24L01+ only requires 2ns of CSN setup and
+// hold and 50ns of CSN high between transactions (Table 13), which is less than a
+// single instruction at 16MHz
+#define radio_beginTransaction(message)    radio_csn(message, 0)
+#define radio_endTransaction(message)      radio_csn(message, 1)
 
 static void radio_writeRegister(BLECastMessage *message, RadioRegister reg, const uint8_t *buffer, uint8_t lengthOrValue) {
     radio_beginTransaction(message);
@@ -329,8 +388,7 @@ static void radio_setChannel(BLECastMessage *message, uint8_t channel) {
 
 static void radio_init(BLECastMessage *message) {
 
-    pinMode(message->radioPinCE, OUTPUT);
-    pinMode(message->radioPinCSN, OUTPUT);
+    radio_initPins(message);
 
     spi_init(message);
 
@@ -389,7 +447,13 @@ static void radio_init(BLECastMessage *message) {
     // Receive address data pipe 1 (LSB first)
     uint8_t address[] = { 0x71, 0x91, 0x7D, 0x6b };
     radio_writeRegister(message, RadioRegisterReceiveAddressPipe1, address, 4);
-    radio_writeRegister(message, RadioRegisterReceivePayloadWidthPipe1, NULL, BLE_PACKET_SIZE);
+    radio_writeRegister(message, RadioRegisterReceivePayloadWidthPipe1, NULL, RADIO_PAYLOAD_SIZE);
+
+#if BLECAST_ACK_BEACON
+    // TX_ADDR
+    // Transmit address (the same access address, for acknowledgment beacons)
+    radio_writeRegister(message, RadioRegisterTransmitAddress, address, 4);
+#endif
 
     // EN_RXADDR
     // Enabled RX Addresses
@@ -427,18 +491,23 @@ static void radio_stopListening(BLECastMessage *message) {
 }
 
 static uint8_t radio_available(BLECastMessage *message) {
-    // FIFO_STATUS
-    // FIFO Status Register
-    // 0x02 => RX full
-    // 0x01 => RX empty
-    return !(radio_readRegister(message, RadioRegisterFIFOStatus, NULL, 0) & 0x01);
+    // STATUS (shifted out with every command, so a NOP is a single byte transaction)
+    // 0x0e => Data pipe number of the next payload; 0x0e if the RX FIFO is empty
+    radio_beginTransaction(message);
+    uint8_t status = spi_transfer(RadioCommandNop);
+    radio_endTransaction(message);
+
+    return ((status & 0x0e) != 0x0e);
 }
 
 // Reads 17 bytes; 1 byte PDU type and the 16 byte BLE address (where BLECast transmits data)
+//
+// The payload leaves the RX FIFO as the transaction ends, and the Receive Data Ready
+// flag is left alone, since it only drives the (unused) IRQ pin.
 static void radio_read_packet(BLECastMessage *message, uint8_t *buffer) {
     radio_beginTransaction(message);
 
-    uint8_t status = spi_transfer(RadioCommandReadPayload);
+    spi_transfer(RadioCommandReadPayload);
 
     // Read the first byte (for the BLE PDU_TYPE)
     *buffer++ = spi_transfer(0xff);
@@ -448,41 +517,230 @@ static void radio_read_packet(BLECastMessage *message, uint8_t *buffer) {
         spi_transfer(0xff);
     }
 
-    // The 16 bytes of BLECast data (BLE address)
+    // The 16 bytes of BLECast data (BLE address); the last of the RADIO_PAYLOAD_SIZE
     for (uint8_t i = 0; i < 16; i++) {
         *buffer++ = spi_transfer(0xff);
     }
 
-    // Finish off the 32 byte of BLE_PACKET_SIZE (3 bytes remain)
-    for (uint8_t i = 0; i < 3; i++) {
-        spi_transfer(0xff);
-    }
+    radio_endTransaction(message);
+}
 
+
+#if BLECAST_ACK_BEACON
+
+// Sends a 32 byte packet (already whitened and bit reversed) on the current channel;
+// the radio must not be listening
+static void radio_send_packet(BLECastMessage *message, const uint8_t *packet) {
+    // RF_SETUP
+    // 0x06 => 1Mbps, 0dBm (radio_init leaves -18dBm, which barely reaches the sender)
+    radio_writeRegister(message, RadioRegisterRadioConfig, NULL, 0x06);
+
+    // CONFIG
+    // 0x02 => Power up (in transmit mode); 1.5ms from power down
+    radio_writeRegister(message, RadioRegisterConfig, NULL, 0x02);
+    delay(2);
+
+    radio_beginTransaction(message);
+    spi_transfer(RadioCommandFlushTransmit);
     radio_endTransaction(message);
 
-    // Clear the data so we can get more
+    radio_beginTransaction(message);
+    spi_transfer(RadioCommandWritePayload);
+    for (uint8_t i = 0; i < ACK_PACKET_SIZE; i++) {
+        spi_transfer(*packet++);
+    }
+    radio_endTransaction(message);
+
+    // Pulse CE (at least 10us) to send
+    radio_ce(message, 1);
+    delayMicroseconds(15);
+    radio_ce(message, 0);
+
+    // STATUS
+    // 0x20 => Sent Data Complete (130us to settle, then about 300us on air)
+    for (uint8_t i = 0; i < 100; i++) {
+        radio_beginTransaction(message);
+        uint8_t status = spi_transfer(RadioCommandNop);
+        radio_endTransaction(message);
+        if (status & 0x20) { break; }
+        delayMicroseconds(10);
+    }
+
     radio_writeRegister(message, RadioRegisterStatus, NULL, 0x70);
+    radio_writeRegister(message, RadioRegisterConfig, NULL, 0x00);
+
+    // RF_SETUP; back to 1Mbps, -18dBm (see radio_init)
+    radio_writeRegister(message, RadioRegisterRadioConfig, NULL, 0x00);
+}
+
+#endif
+
+
+#endif  /* BLECAST_MOCK_RADIO */
+
+
+static void blecast_resetSlot(BLECastSlot *slot) {
+    slot->totalPayloadCount = -1;
+    slot->discoveredPayloadCount = 0;
+    slot->session = 0;
+    slot->lastPayloadPartial = false;
+    memset(slot->foundPayloads, 0, sizeof(slot->foundPayloads));
+#if BLECAST_COMPRESSION
+    slot->compressed = false;
+#endif
+#if BLECAST_STREAMING
+    slot->extended = false;
+    slot->streamIndex = 0;
+    slot->streamTotal = 0;
+    slot->streamCrc = CRC24_INIT;
+#endif
+#if BLECAST_ERASURE_CODING
+    slot->parityPayloadCount = -1;
+    slot->discoveredParityCount = 0;
+    slot->foundParity = 0;
+#endif
+}
+
+
+// Discards the progress of a slot (a stray payload or failed message)
+static void blecast_discard(BLECastMessage *message, BLECastSlot *slot) {
+    (void)message;
+    blecast_count(message, resets);
+#if BLECAST_STREAMING
+    // Anything already streamed must be thrown away by the consumer
+    if (slot->extended && slot->streamIndex) {
+        message->streamCallback(message->streamContext, NULL, 0);
+        message->streamLength = 0;
+    }
+#endif
+    blecast_resetSlot(slot);
+}
+
+// Whether a slot has no message in progress
+static inline bool blecast_isEmpty(BLECastSlot *slot) {
+#if BLECAST_STREAMING
+    if (slot->extended) { return false; }
+#endif
+    return (slot->totalPayloadCount == -1 && slot->discoveredPayloadCount == 0);
+}
+
+
+// The ways a payload can disagree with the message in progress (in the high bits of
+// the pending signature; the low bits say how)
+#define PENDING_NONE               (0xffff)
+#define PENDING_SESSION            (0x1000)
+#define PENDING_COMPRESSED         (0x2000)
+#define PENDING_EXTENDED           (0x3000)
+#define PENDING_OTHER_STREAM       (0x4000)
+#define PENDING_STREAM             (0x5000)
+#define PENDING_PARITY             (0x6000)
+#define PENDING_DATA               (0x7000)
+
+#if BLECAST_TAGS
+
+// Whether a payload that disagrees with the message in progress may discard it. A
+// tagged payload passes the CRC far more easily than an untagged one (see
+// BLECAST_TAGS), so the first one that disagrees is only remembered (and dropped);
+// the message is discarded once a second one disagrees in the same way, which is
+// what a sender that moved on to another message sends.
+static bool blecast_confirm(BLECastMessage *message, uint16_t signature) {
+    if (message->pending != signature) {
+        message->pending = signature;
+        return false;
+    }
+
+    message->pending = PENDING_NONE;
+    return true;
 }
 
+#endif
+
+// Forgets any unconfirmed disagreement, once a payload agrees with the message in
+// progress (so only consecutive disagreements are confirmed)
+static inline void blecast_agree(BLECastMessage *message) {
+#if BLECAST_TAGS
+    message->pending = PENDING_NONE;
+#else
+    (void)message;
+#endif
+}
+
+// Discards the message in slot for a payload that disagrees with it (a stray payload
+// from another message), unless the payload is tagged and the disagreement is not yet
+// confirmed (see blecast_confirm); either way the payload itself is dropped
+static PayloadResult blecast_conflict(BLECastMessage *message, BLECastSlot *slot, bool tagged, uint16_t signature) {
+#if BLECAST_TAGS
+    if (tagged && !blecast_confirm(message, signature)) { return PayloadResultAccepted; }
+#else
+    (void)tagged;
+    (void)signature;
+#endif
+    blecast_discard(message, slot);
+    return PayloadResultAccepted;
+}
 
 static void _blecast_init(BLECastMessage *message) {
-    message->totalPayloadCount = -1;
-    message->discoveredPayloadCount = 0;
+    for (uint8_t i = 0; i < BLECAST_SESSION_SLOTS; i++) {
+        blecast_resetSlot(&message->slots[i]);
+    }
     message->size = -1;
     message->id = BLECAST_INVALID_ID;
-    memset(message->data, 0, message->maxSize);
+#if BLECAST_STREAMING
+    message->streamLength = 0;
+#endif
+#if BLECAST_ACK_BEACON
+    message->ackPolls = 0;
+#endif
+#if BLECAST_TAGS
+    message->pending = PENDING_NONE;
+#endif
 }
 
 
 bool blecast_init(BLECastMessage *message, uint8_t *key, uint8_t *data, uint16_t dataLength) {
+    if (dataLength < BLECAST_MINIMUM_BUFFER * BLECAST_SESSION_SLOTS) { return false; }
+
     message->data = data;
     message->maxSize = dataLength;
 
+    // Each slot reassembles into its own share of the data
+    for (uint8_t i = 0; i < BLECAST_SESSION_SLOTS; i++) {
+        message->slots[i].maxSize = dataLength / BLECAST_SESSION_SLOTS;
+        message->slots[i].data = &data[i * message->slots[i].maxSize];
+    }
+
     _blecast_init(message);
 
-    memcpy(message->aesKey, key, 16);
+    // Prepare the key once; each payload decrypt would otherwise need to run
+    // the key schedule forward (to find the start key) and then back again
+#if BLECAST_AES_KEY_SCHEDULE
+    aes128_key_schedule(message->aesKeySchedule, key);
+#else
+    memcpy(message->aesKey, key, AES128_KEY_SIZE);
+    aes128_otfks_decrypt_start_key(message->aesKey);
+#endif
+
+    // The radio starts on channel 37 (see radio_init)
+    message->radioChannel = 0;
+
+#if BLECAST_STATS
+    memset(&message->stats, 0, sizeof(message->stats));
+#endif
+
+#if BLECAST_STREAMING
+    message->streamCallback = NULL;
+    message->streamContext = NULL;
+#endif
+
+#if BLECAST_ADAPTIVE_CHANNELS
+    memset(message->channelScore, 0, sizeof(message->channelScore));
+    message->channelDwell = 0;
+    message->channelVisited = (1 << 0);
+#endif
 
     radio_init(message);
+
+    return true;
 }
 
 void blecast_shutdown(BLECastMessage *message) {
@@ -493,25 +751,75 @@ void blecast_reset(BLECastMessage *message) {
     _blecast_init(message);
 }
 
+#if BLECAST_STREAMING
+void blecast_setStream(BLECastMessage *message, BLECastStreamCallback callback, void *context) {
+    message->streamCallback = callback;
+    message->streamContext = context;
+}
+#endif
+
+
+static bool blecast_hasPayload(BLECastSlot *slot, uint8_t index) {
+    return (slot->foundPayloads[index >> 3] & (1 << (index & 0x07))) ? true: false;
+}
+
+static void blecast_setPayload(BLECastSlot *slot, uint8_t index) {
+    slot->foundPayloads[index >> 3] |= (1 << (index & 0x07));
+}
+
+// Whether any payload at or after index has been found
+static bool blecast_hasPayloadFrom(BLECastSlot *slot, uint8_t index) {
+    if (index >= BLECAST_MAX_PAYLOADS) { return false; }
+
+    uint8_t i = index >> 3;
+    if (slot->foundPayloads[i] & (0xff << (index & 0x07))) { return true; }
+    while (++i < BLECAST_MAX_PAYLOADS / 8) {
+        if (slot->foundPayloads[i]) { return true; }
+    }
+
+    return false;
+}
+
+// Returns the location of a payload byte. Payloads are placed directly at their
+// final offset in the message (index * 12 - 3), since the first payload of a
+// multi-payload message begins with the 3 byte message CRC, which is kept aside.
+static uint8_t* blecast_getPayloadByte(BLECastSlot *slot, uint8_t index, uint8_t offset) {
+    if (index == 0 && offset < 3) { return &slot->messageCrc[offset]; }
+    return &slot->data[12 * (uint16_t)index - 3 + offset];
+}
+
+// The number of message bytes available for payloads (any remaining is for parity)
+static uint16_t blecast_getCapacity(BLECastSlot *slot) {
+#if BLECAST_ERASURE_CODING
+    return slot->maxSize - 12 * BLECAST_MAX_PARITY;
+#else
+    return slot->maxSize;
+#endif
+}
+
 
-void blecast_dump(BLECastMessage *message) {
+void blecast_dump(BLECastMessage *message, BLECastSlot *slot) {
+    (void)message;
+    (void)slot;
 /*
-    Serial.print("Message count=");
-    Serial.print(message->totalPayloadCount);
+    Serial.print("Message session=");
+    Serial.print(slot->session);
+    Serial.print(", count=");
+    Serial.print(slot->totalPayloadCount);
     Serial.print(", discovered=");
-    Serial.print(message->discoveredPayloadCount);
+    Serial.print(slot->discoveredPayloadCount);
     Serial.print(", size=");
     Serial.print(message->size);
     Serial.print("\n");
-    for (uint8_t i = 0; i < (message->maxSize / 13); i++) {
-        uint8_t *data = &(message->data[i * 13]);
-        if (data[0] == 0) { continue; }
+    for (uint8_t i = 0; i < BLECAST_MAX_PAYLOADS; i++) {
+        if (!blecast_hasPayload(slot, i)) { continue; }
         Serial.print("  Payload ");
         Serial.print(i);
         Serial.print(": ");
-        for (uint8_t i = 1; i < 13; i++) {
-            if (data[i] < 0x10) { Serial.print("0"); }
-            Serial.print((uint8_t)(data[i]), HEX); Serial.print(" ");
+        for (uint8_t j = 0; j < 12; j++) {
+            uint8_t value = *blecast_getPayloadByte(slot, i, j);
+            if (value < 0x10) { Serial.print("0"); }
+            Serial.print(value, HEX); Serial.print(" ");
         }
         Serial.println("");
     }
@@ -519,14 +827,516 @@ void blecast_dump(BLECastMessage *message) {
 }
 
 
+#if BLECAST_COMPRESSION
+
+// Every payload of a compressed message has this bit set in its CRC tag
+#define COMPRESSED_TAG             (0x800)
+
+// Expands a compressed message in place, returning the expanded size (or -1 if it is
+// malformed or too large). Each zero byte is followed by a run length (1 to 255) and
+// is expanded to that many zero bytes; all other bytes are literal.
+//
+// The compressed data is first moved to the end of the buffer, so the expanded data
+// written from the front never overtakes the compressed data still to be read.
+static int16_t blecast_decompress(uint8_t *data, uint16_t size, uint16_t maxSize) {
+    uint16_t offset = maxSize - size;
+    memmove(&data[offset], data, size);
+
+    uint16_t length = 0;
+    while (offset < maxSize) {
+        uint8_t value = data[offset++];
+        if (value) {
+            data[length++] = value;
+            continue;
+        }
+
+        if (offset == maxSize) { return -1; }
+        uint8_t run = data[offset++];
+        if (run == 0 || length + run > offset) { return -1; }
+
+        memset(&data[length], 0, run);
+        length += run;
+    }
+
+    return length;
+}
+
+#endif
+
+
+// Computes the size and checks the message CRC once every payload is present,
+// returning -1 if the payloads do not make a message
+static int16_t blecast_getSize(BLECastMessage *message, BLECastSlot *slot) {
+    uint8_t lastIndex = slot->totalPayloadCount - 1;
+
+    // Conpute size (a partial payload has the length in its last byte)
+    uint16_t size = 12 * (uint16_t)lastIndex;
+    if (slot->lastPayloadPartial) {
+        uint8_t length = *blecast_getPayloadByte(slot, lastIndex, 11);
+        if (length >= 12) { return -1; }
+        size += length;
+
+    } else {
+        size += 12;
+    }
+
+    // If the message is more than 1 block, it contains an additional message CRC
+    // prefix; all payloads are already in place after it
+    if (slot->totalPayloadCount > 1) {
+        size -= 3;
+
+        uint32_t messageCrc = ((uint32_t)(slot->messageCrc[0]) << 16) | ((uint32_t)(slot->messageCrc[1]) << 8) | (slot->messageCrc[2]);
+
+        uint32_t computedMessageCrc = crc24_compute(slot->data, size);
+
+        if (computedMessageCrc != messageCrc) {
+            blecast_count(message, messageCrcFailures);
+            return -1;
+        }
+
+        message->id = messageCrc;
+
+    } else {
+        // Move the first 3 bytes back in front
+        memmove(&slot->data[3], slot->data, 9);
+        memcpy(slot->data, slot->messageCrc, 3);
+
+        // The ID is the payload CRC (of the index byte and data)
+        uint8_t index = 0x80 | (slot->lastPayloadPartial ? 0x40: 0);
+        message->id = crc24_update(crc24_update(CRC24_INIT, &index, 1), slot->data, 12);
+    }
+
+    return size;
+}
+
+// Expands and moves the message into place once checked (see blecast_getSize)
+static PayloadResult blecast_complete(BLECastMessage *message, BLECastSlot *slot, uint16_t size) {
+#if BLECAST_COMPRESSION
+    // Expand the message (any parity slots are no longer needed, so the entire slot is used)
+    if (slot->compressed) {
+        int16_t expandedSize = blecast_decompress(slot->data, size, slot->maxSize);
+        if (expandedSize < 0) {
+            blecast_count(message, decompressFailures);
+            blecast_discard(message, slot);
+            return PayloadResultAccepted;
+        }
+        size = expandedSize;
+    }
+#endif
+
+    // Move the message to the front of the data (if it is not in the first slot)
+    if (slot->data != message->data) {
+        memmove(message->data, slot->data, size);
+    }
+
+    message->size = size;
+
+    blecast_dump(message, slot);
+
+    return PayloadResultComplete;
+}
+
+
+#if BLECAST_ERASURE_CODING
+
+#if BLECAST_MAX_PARITY > 8
+#error BLECAST_MAX_PARITY must be 8 or less
+#endif
+
+// Parity payloads are marked by the partial bit without the terminal bit (which a
+// data payload never has) and the index bits hold the data payload count less one.
+//
+// The CRC field of a parity payload is its CRC XOR'd with a tag, which ensures the
+// payload is rejected by receivers that do not understand parity:
+//   [ 0x200 ] [ last payload partial 1 ] [ parity count - 1 4 ] [ parity index 4 ]
+#define PARITY_TAG_MARKER          (0x200)
+#define PARITY_TAG_PARTIAL         (0x100)
+
+// The largest parity count the tag can express (and so the most rs_init needs)
+#define MAX_PARITY_COUNT           (16)
+
+// Returns the slot for a parity payload (they are stored at the end of the data)
+static uint8_t* blecast_getParitySlot(BLECastSlot *slot, uint8_t parityIndex) {
+    return &slot->data[slot->maxSize - 12 * (parityIndex + 1)];
+}
+
+// Recovers the missing data payloads using the parity payloads.
+//
+// Each of the 12 byte columns is a systematic Reed-Solomon codeword; the data
+// payloads followed by the parity payloads, where the parity is the remainder
+// computed exactly as the QR code error correction (rs_init/rs_getRemainder).
+//
+// Since the remainder is linear, the parity of the received data (with the missing
+// payloads as zero) XOR'd with the received parity leaves only the contribution of
+// the missing payloads; one equation per parity payload. The contribution of each
+// missing payload is the remainder of a single 1 at its position, so inverting that
+// (erasures x erasures) matrix solves for the missing bytes in every column.
+static bool blecast_recover(BLECastSlot *slot) {
+    uint8_t totalCount = slot->totalPayloadCount;
+    uint8_t parityCount = slot->parityPayloadCount;
+
+    // The missing data payloads
+    uint8_t missing[BLECAST_MAX_PARITY];
+    uint8_t erasures = 0;
+    for (uint8_t i = 0; i < totalCount; i++) {
+        if (blecast_hasPayload(slot, i)) { continue; }
+        if (erasures == BLECAST_MAX_PARITY) { return false; }
+        missing[erasures++] = i;
+    }
+
+    // The parity payloads to recover them with
+    uint8_t parity[BLECAST_MAX_PARITY];
+    uint8_t parityFound = 0;
+    for (uint8_t i = 0; i < BLECAST_MAX_PARITY && parityFound < erasures; i++) {
+        if (slot->foundParity & (1 << i)) { parity[parityFound++] = i; }
+    }
+    if (parityFound < erasures) { return false; }
+
+    uint8_t coeff[MAX_PARITY_COUNT];
+    rs_init(parityCount, coeff);
+
+    // The contribution of each missing payload to the parity payloads, augmented
+    // with the identity matrix, which becomes the inverse (Gauss-Jordan)
+    uint8_t matrix[BLECAST_MAX_PARITY][2 * BLECAST_MAX_PARITY];
+    memset(matrix, 0, sizeof(matrix));
+
+    uint8_t zero = 0;
+    uint8_t remainder[MAX_PARITY_COUNT];
+    for (uint8_t b = 0; b < erasures; b++) {
+        memset(remainder, 0, parityCount);
+        uint8_t one = 1;
+        rs_getRemainder(parityCount, coeff, &one, 1, remainder, 1);
+        for (uint8_t i = missing[b] + 1; i < totalCount; i++) {
+            rs_getRemainder(parityCount, coeff, &zero, 1, remainder, 1);
+        }
+
+        for (uint8_t a = 0; a < erasures; a++) {
+            matrix[a][b] = remainder[parity[a]];
+        }
+        matrix[b][erasures + b] = 1;
+    }
+
+    for (uint8_t col = 0; col < erasures; col++) {
+
+        // Find a pivot (one always exists, as Reed-Solomon codes are MDS)
+        uint8_t pivot = col;
+        while (matrix[pivot][col] == 0) {
+            if (++pivot == erasures) { return false; }
+        }
 
-bool blecast_addPayload(BLECastMessage *message, uint8_t *data) {
+        for (uint8_t j = 0; j < 2 * erasures; j++) {
+            uint8_t tmp = matrix[col][j];
+            matrix[col][j] = matrix[pivot][j];
+            matrix[pivot][j] = tmp;
+        }
+
+        uint8_t scale = rs_inverse(matrix[col][col]);
+        for (uint8_t j = 0; j < 2 * erasures; j++) {
+            matrix[col][j] = rs_multiply(matrix[col][j], scale);
+        }
+
+        for (uint8_t row = 0; row < erasures; row++) {
+            uint8_t factor = matrix[row][col];
+            if (row == col || factor == 0) { continue; }
+            for (uint8_t j = 0; j < 2 * erasures; j++) {
+                matrix[row][j] ^= rs_multiply(matrix[col][j], factor);
+            }
+        }
+    }
+
+    // Solve each column
+    for (uint8_t j = 0; j < 12; j++) {
+        memset(remainder, 0, parityCount);
+        for (uint8_t i = 0; i < totalCount; i++) {
+            uint8_t *value = blecast_hasPayload(slot, i) ? blecast_getPayloadByte(slot, i, j): &zero;
+            rs_getRemainder(parityCount, coeff, value, 1, remainder, 1);
+        }
+
+        uint8_t syndrome[BLECAST_MAX_PARITY];
+        for (uint8_t a = 0; a < erasures; a++) {
+            syndrome[a] = remainder[parity[a]] ^ blecast_getParitySlot(slot, parity[a])[j];
+        }
+
+        for (uint8_t b = 0; b < erasures; b++) {
+            uint8_t value = 0;
+            for (uint8_t a = 0; a < erasures; a++) {
+                value ^= rs_multiply(matrix[b][erasures + a], syndrome[a]);
+            }
+            *blecast_getPayloadByte(slot, missing[b], j) = value;
+        }
+    }
+
+    // Mark the recovered payloads as found
+    for (uint8_t b = 0; b < erasures; b++) {
+        blecast_setPayload(slot, missing[b]);
+    }
+
+    slot->discoveredPayloadCount = totalCount;
+
+    return true;
+}
+
+// Forgets the parity payloads of a slot, and the counts if only they gave them (a
+// parity payload passes the CRC by its tag alone, so gives way to the data payloads)
+static void blecast_dropParity(BLECastSlot *slot) {
+    if (slot->totalPayloadCount != -1 && !blecast_hasPayload(slot, slot->totalPayloadCount - 1)) {
+        slot->totalPayloadCount = -1;
+        slot->lastPayloadPartial = false;
+    }
+    slot->parityPayloadCount = -1;
+    slot->discoveredParityCount = 0;
+    slot->foundParity = 0;
+}
+
+// Adds a parity payload (data is the 12 parity bytes)
+static PayloadResult blecast_addParity(BLECastMessage *message, BLECastSlot *slot, uint8_t index, uint16_t tag, uint8_t *data) {
+    uint8_t parityIndex = tag & 0x0f;
+    int8_t parityCount = ((tag >> 4) & 0x0f) + 1;
+    int8_t totalCount = (index & 0x3f) + 1;
+    bool lastPayloadPartial = (tag & PARITY_TAG_PARTIAL) ? true: false;
+
+    if (parityIndex >= parityCount) { return PayloadResultRejected; }
+
+    // The message this parity payload describes (its counts and partial bit)
+    uint16_t signature = PENDING_PARITY | ((index & 0x3f) << 5) | ((tag >> 4) & 0x1f);
+
+    // Too big to fit alongside the parity slots
+    if (12 * (uint16_t)totalCount - 3 > blecast_getCapacity(slot)) {
+        return blecast_conflict(message, slot, true, signature);
+    }
+
+    // A stray parity payload from a different message; the counts must agree with
+    // any already known, and the data payloads already found must all be within it
+    if ((slot->totalPayloadCount != -1 && (slot->totalPayloadCount != totalCount ||
+      slot->lastPayloadPartial != lastPayloadPartial)) ||
+      (slot->parityPayloadCount != -1 && slot->parityPayloadCount != parityCount) ||
+      blecast_hasPayloadFrom(slot, totalCount)) {
+        return blecast_conflict(message, slot, true, signature);
+    }
+
+    slot->totalPayloadCount = totalCount;
+    slot->parityPayloadCount = parityCount;
+    slot->lastPayloadPartial = lastPayloadPartial;
+    blecast_agree(message);
+
+    // We do not have room to keep this one (or already have it)
+    if (parityIndex >= BLECAST_MAX_PARITY) { return PayloadResultAccepted; }
+    if (slot->foundParity & (1 << parityIndex)) {
+        blecast_count(message, duplicates);
+        return PayloadResultAccepted;
+    }
+
+    memcpy(blecast_getParitySlot(slot, parityIndex), data, 12);
+    slot->foundParity |= (1 << parityIndex);
+
+    slot->discoveredParityCount++;
+
+    return PayloadResultAccepted;
+}
+
+#endif
+
+
+#if BLECAST_STREAMING
+
+// Extended payloads carry the high 8 bits of their 14 bit index in the CRC tag:
+//   [ 0x100 ] [ index >> 6 8 ]
+// and the low 6 bits in the index byte, so receivers without streaming reject them
+#define EXTENDED_TAG_MARKER        (0x100)
+
+// The number of payloads kept ahead of the stream
+static uint8_t blecast_getStreamWindow(BLECastSlot *slot) {
+    if (slot->maxSize / 12 > BLECAST_MAX_PAYLOADS) { return BLECAST_MAX_PAYLOADS; }
+    return slot->maxSize / 12;
+}
+
+// Adds a payload of an extended message. Payloads are kept in a window (a ring of
+// 12 byte slots in the slot data) ahead of the next payload to stream, and streamed
+// as soon as they are next in order; payloads beyond the window are dropped, since
+// the sender repeats them.
+static PayloadResult blecast_addStreamPayload(BLECastMessage *message, BLECastSlot *slot, uint16_t index, uint8_t indexByte, uint8_t *data) {
+    uint8_t window = blecast_getStreamWindow(slot);
+
+    // Extended payloads are always tagged, so disagreeing with the message in progress
+    // only discards it once confirmed (see blecast_confirm)
+    uint16_t signature = PENDING_STREAM | slot->session;
+
+    // The last payload; an extended message always has more than one payload, and this
+    // must agree with any total already known and the payloads already streamed
+    bool partial = (indexByte & 0x40) ? true: false;
+    if (indexByte & 0x80) {
+        if (index == 0 || index < slot->streamIndex || (slot->streamTotal &&
+          (slot->streamTotal != index + 1 || slot->lastPayloadPartial != partial))) {
+            return blecast_conflict(message, slot, true, signature);
+        }
+    }
+
+    // A stray payload from another message
+    if (slot->streamTotal && index >= slot->streamTotal) {
+        return blecast_conflict(message, slot, true, signature);
+    }
+
+    if (indexByte & 0x80) {
+        slot->streamTotal = index + 1;
+        slot->lastPayloadPartial = partial;
+    }
+    blecast_agree(message);
+
+    // Already streamed, or too far ahead to keep
+    if (index < slot->streamIndex) {
+        blecast_count(message, duplicates);
+        return PayloadResultAccepted;
+    }
+    if (index - slot->streamIndex >= window) { return PayloadResultAccepted; }
+
+    uint8_t position = index % window;
+    if (blecast_hasPayload(slot, position)) {
+        blecast_count(message, duplicates);
+        return PayloadResultAccepted;
+    }
+
+    memcpy(&slot->data[12 * position], data, 12);
+    blecast_setPayload(slot, position);
+
+    // Stream every payload now in order
+    while (blecast_hasPayload(slot, position = slot->streamIndex % window)) {
+        uint8_t *chunk = &slot->data[12 * position];
+        uint8_t length = 12;
+
+        // The first payload begins with the message CRC
+        if (slot->streamIndex == 0) {
+            memcpy(slot->messageCrc, chunk, 3);
+            chunk += 3;
+            length -= 3;
+        }
+
+        // The last payload may be partial (its length is in its last byte)
+        bool last = (slot->streamIndex + 1 == slot->streamTotal);
+        if (last && slot->lastPayloadPartial) {
+            if (chunk[11] >= 12) {
+                blecast_discard(message, slot);
+                return PayloadResultAccepted;
+            }
+            length = chunk[11];
+        }
+
+        slot->streamCrc = crc24_update(slot->streamCrc, chunk, length);
+        message->streamCallback(message->streamContext, chunk, length);
+        message->streamLength += length;
+
+        slot->foundPayloads[position >> 3] &= ~(1 << (position & 0x07));
+        slot->streamIndex++;
+
+        if (!last) { continue; }
+
+        uint32_t messageCrc = ((uint32_t)(slot->messageCrc[0]) << 16) | ((uint32_t)(slot->messageCrc[1]) << 8) | (slot->messageCrc[2]);
+        if (slot->streamCrc != messageCrc) {
+            blecast_count(message, messageCrcFailures);
+            blecast_discard(message, slot);
+            return PayloadResultAccepted;
+        }
+
+        message->id = messageCrc;
+        message->size = 0;
+
+        return PayloadResultComplete;
+    }
+
+    return PayloadResultAccepted;
+}
+
+#endif
+
+
+#if BLECAST_SESSIONS
+
+// Whether session a is newer than session b (sessions increment, wrapping at 16)
+static bool session_isNewer(uint8_t a, uint8_t b) {
+    return (uint8_t)(((a - b) & 0x0f) - 1) < 7;
+}
+
+// The session tag is 4 bits of the XOR'd CRC tag (0 for an untagged sender)
+#define SESSION_TAG_MASK           (0xf000)
+#define SESSION_TAG_SHIFT          (12)
+
+// Returns the slot to place a payload with the given session into, or NULL if the
+// payload should be dropped; it is from a session older than one we are tracking
+// (a stale payload), or from a new session while every slot is busy.
+//
+// A busy slot is only given up once a second payload of the new session arrives, so
+// a lone payload (e.g. noise that passed the 20 bit CRC) cannot discard a message in
+// progress. Untagged messages are given up last, as a tagged payload is more likely
+// an outlier than a sender that stopped tagging.
+static BLECastSlot* blecast_getSlot(BLECastMessage *message, uint8_t session) {
+    BLECastSlot *empty = NULL, *oldest = NULL;
+
+    for (uint8_t i = 0; i < BLECAST_SESSION_SLOTS; i++) {
+        BLECastSlot *slot = &message->slots[i];
+
+        if (blecast_isEmpty(slot)) {
+            if (empty == NULL) { empty = slot; }
+            continue;
+        }
+
+        if (slot->session == session) { return slot; }
+
+        // A newer tagged session is in progress; drop this payload
+        if (session && slot->session && session_isNewer(slot->session, session)) {
+            blecast_count(message, staleSessions);
+            return NULL;
+        }
+
+        if (oldest == NULL || oldest->session == 0 ||
+          (slot->session && session_isNewer(oldest->session, slot->session))) {
+            oldest = slot;
+        }
+    }
+
+    BLECastSlot *slot = empty;
+    if (slot == NULL) {
+        // The first payload of a new session; wait for another before evicting
+        if (!blecast_confirm(message, PENDING_SESSION | session)) { return NULL; }
+
+        slot = oldest;
+        blecast_discard(message, slot);
+    }
+
+    slot->session = session;
+
+    return slot;
+}
+
+#else
+
+#if BLECAST_SESSION_SLOTS != 1
+#error BLECAST_SESSION_SLOTS greater than 1 requires BLECAST_SESSIONS
+#endif
+
+// Without sessions every payload belongs to the one slot
+static BLECastSlot* blecast_getSlot(BLECastMessage *message, uint8_t session) {
+    (void)session;
+    return &message->slots[0];
+}
+
+#endif
+
+
+static void blecast_decrypt(BLECastMessage *message, uint8_t *data) {
+#if BLECAST_AES_KEY_SCHEDULE
+    aes128_decrypt(data, message->aesKeySchedule);
+#else
+    // The on-the-fly key schedule consumes the key, so work on a copy
+    uint8_t aesKey[AES128_KEY_SIZE];
+    memcpy(aesKey, message->aesKey, AES128_KEY_SIZE);
+    aes128_otfks_decrypt(data, aesKey);
+#endif
+}
+
+static PayloadResult blecast_addPayload(BLECastMessage *message, uint8_t *data) {
     // Already done
-    if (message->size >= 0) { return false; }
+    if (message->size >= 0) { return PayloadResultRejected; }
 
-    // Decrypt the payload
-    aes128_otfks_decrypt_start_key(message->aesKey);
-    aes128_otfks_decrypt(data, message->aesKey);
+    blecast_decrypt(message, data);
 
     // This is the CRC to match
     uint32_t payloadCrc = ((uint32_t)data[0] << 16) | ((uint32_t)data[1] << 8) | data[2];
@@ -537,123 +1347,393 @@ bool blecast_addPayload(BLECastMessage *message, uint8_t *data) {
     }
 
     // Compute the CRC (while removing the noise applied during shrink-wrapping)
-    uint32_t computedPayloadCrc = computeCrc24(&data[3], 13);
+    uint32_t computedPayloadCrc = crc24_compute(&data[3], 13);
 
-    // Check the CRC (either not for us of data transmission error)
-    if (payloadCrc != computedPayloadCrc) { return false; }
+    // Any difference is the tag (the session, compression, and the parity details for parity payloads)
+    uint32_t tag = payloadCrc ^ computedPayloadCrc;
+
+    // Whether the payload only passed the CRC by its tag (see BLECAST_TAGS)
+    bool tagged = (tag != 0);
+
+#if BLECAST_SESSIONS
+    uint8_t session = (tag & SESSION_TAG_MASK) >> SESSION_TAG_SHIFT;
+    tag &= ~(uint32_t)SESSION_TAG_MASK;
+#else
+    uint8_t session = 0;
+#endif
 
-    // Done with the CRC; strip it
-    data += 3;
+#if BLECAST_COMPRESSION
+    bool compressed = (tag & COMPRESSED_TAG) ? true: false;
+    tag &= ~(uint32_t)COMPRESSED_TAG;
+#endif
 
     // The index byte; [terminal1] [partial1] [index6]
-    uint8_t index = data[0];
-    data++;
+    uint8_t index = data[3];
+
+#if BLECAST_STREAMING
+    // An extended payload (never a parity payload); the rest of its index is in the tag
+    uint16_t extendedIndex = 0;
+    bool extended = ((index & 0xc0) != 0x40 && (tag & ~(uint32_t)0xff) == EXTENDED_TAG_MARKER);
+    if (extended) {
+        if (message->streamCallback == NULL) { return PayloadResultRejected; }
+#if BLECAST_COMPRESSION
+        // Compressed messages are expanded once complete, which a stream cannot be
+        if (compressed) { return PayloadResultRejected; }
+#endif
+        extendedIndex = ((tag & 0xff) << 6) | (index & 0x3f);
+        tag = 0;
+    }
+#endif
 
-    // This message is too big! Reset and hope things are better in the future
-    uint8_t blockIndex = (index & 0x3f);
-    if (blockIndex * 13 > message->maxSize) {
-        _blecast_init(message);
-        return false;
+#if BLECAST_ERASURE_CODING
+    bool isParity = ((index & 0xc0) == 0x40);
+    if (isParity) {
+        if ((tag & ~(uint32_t)(PARITY_TAG_MARKER - 1)) != PARITY_TAG_MARKER) {
+            blecast_count(message, crcFailures);
+            return PayloadResultRejected;
+        }
+    } else
+#endif
+    // Check the CRC (either not for us of data transmission error)
+    if (tag) {
+        blecast_count(message, crcFailures);
+        return PayloadResultRejected;
     }
 
-    // Already have this block
-    if (message->data[blockIndex * 13]) {
-        return false;
+    // A stale payload from an older session (or the first of a new session while every
+    // slot is busy); drop it (it is still ours though)
+    BLECastSlot *slot = blecast_getSlot(message, session);
+    if (slot == NULL) { return PayloadResultAccepted; }
+
+#if BLECAST_COMPRESSION
+    // A payload from a different message (compressed vs. not); start over with it
+    if (slot->compressed != compressed) {
+        if (!blecast_isEmpty(slot)) {
+            if (tagged && !blecast_confirm(message, PENDING_COMPRESSED | session)) { return PayloadResultAccepted; }
+            blecast_discard(message, slot);
+            slot->session = session;
+        }
+        slot->compressed = compressed;
     }
+#endif
 
-    // Add the data (mark it as found and keep the partial and final bits)
-    message->data[blockIndex * 13] = index | 0x01;
-    memcpy(&message->data[blockIndex * 13 + 1], data, 12);
+#if BLECAST_STREAMING
+    if (slot->extended != extended) {
+        if (!blecast_isEmpty(slot)) {
+            if (tagged && !blecast_confirm(message, PENDING_EXTENDED | session)) { return PayloadResultAccepted; }
+            blecast_discard(message, slot);
+            slot->session = session;
+        }
+        slot->extended = extended;
+    }
 
-    message->discoveredPayloadCount++;
+    if (extended) {
+        // Only one message may stream at a time
+        for (uint8_t i = 0; i < BLECAST_SESSION_SLOTS; i++) {
+            BLECastSlot *other = &message->slots[i];
+            if (other == slot || !other->extended) { continue; }
+            if (!blecast_confirm(message, PENDING_OTHER_STREAM | session)) { return PayloadResultAccepted; }
+            blecast_discard(message, other);
+        }
 
-    // Last payload for this message
-    if ((index & 0x80) && message->totalPayloadCount == -1) {
-        message->totalPayloadCount = blockIndex + 1;
+        return blecast_addStreamPayload(message, slot, extendedIndex, index, &data[4]);
     }
+#endif
 
-    // This can happen when switching between messages; stray payloads
-    // got picked up from a previous message without the terminal.
-    if (message->totalPayloadCount != -1 && message->totalPayloadCount < message->discoveredPayloadCount) {
-        _blecast_init(message);
-        return false;
-    }
+    PayloadResult result = PayloadResultAccepted;
 
+#if BLECAST_ERASURE_CODING
+    if (isParity) {
+        result = blecast_addParity(message, slot, index, tag, &data[4]);
 
-    // Message complete!
-    if (message->totalPayloadCount == message->discoveredPayloadCount) {
+    } else
+#endif
+    {
+        // Done with the CRC and index; strip them
+        data += 4;
 
-        // Conpute size
+        // Data payloads disagreeing with the message in progress (see blecast_conflict)
+        uint16_t signature = PENDING_DATA | session;
 
-        // A partial payload (the length is in the last payload content slot)
-        uint8_t lastIndex = 13 * (message->totalPayloadCount - 1);
-        if (message->data[lastIndex] & 0x40) {
-            message->size = (message->totalPayloadCount - 1) * 12 + message->data[lastIndex + 12];
+        // This message is too big! Reset and hope things are better in the future
+        uint8_t blockIndex = (index & 0x3f);
+        if (12 * (uint16_t)(blockIndex + 1) - 3 > blecast_getCapacity(slot)) {
+            return blecast_conflict(message, slot, tagged, signature);
+        }
 
-        } else {
-            message->size = message->totalPayloadCount * 12;
+        // Already have this block
+        if (blecast_hasPayload(slot, blockIndex)) {
+            blecast_count(message, duplicates);
+            return PayloadResultAccepted;
         }
 
-        // If the message is more than 1 block, if contains an additional message CRC prefix
-        //uint8_t *outputPtr = output;
-        if (message->size > 12) {
+        bool terminal = (index & 0x80) ? true: false;
+        bool partial = (index & 0x40) ? true: false;
 
-            uint32_t messageCrc = ((uint32_t)(message->data[1]) << 16) | ((uint32_t)(message->data[2]) << 8) | (message->data[3]);
+        // A stray payload from another message; beyond the count we already have, or a
+        // terminal disagreeing with it
+        bool stray = (slot->totalPayloadCount != -1 && (blockIndex >= slot->totalPayloadCount ||
+          (terminal && (slot->totalPayloadCount != blockIndex + 1 || slot->lastPayloadPartial != partial))));
 
-            for (uint8_t i = 0; i < message->totalPayloadCount; i++) {
-                uint8_t targetOffset = i * 12, sourceOffset = 1 + i * 13;
-                for (uint8_t j = 0; j < 12; j++) {
-                    message->data[targetOffset + j] = message->data[sourceOffset + j];
-                }
-            }
+#if BLECAST_ERASURE_CODING
+        // Unless only parity payloads gave the count; they give way instead
+        if (stray && !blecast_hasPayload(slot, slot->totalPayloadCount - 1)) {
+            blecast_dropParity(slot);
+            stray = false;
+        }
+#endif
 
-            message->size -= 3;
+        if (stray) { return blecast_conflict(message, slot, tagged, signature); }
 
-            for (uint8_t i = 0; i < message->size; i++) {
-                message->data[i] = message->data[i + 3];
-            }
+        // This can happen when switching between messages; stray payloads
+        // got picked up from a previous message without the terminal (only
+        // possible for untagged senders).
+        if (terminal && slot->totalPayloadCount == -1 && blecast_hasPayloadFrom(slot, blockIndex + 1)) {
+            return blecast_conflict(message, slot, tagged, signature);
+        }
 
-            uint32_t computedMessageCrc = computeCrc24(message->data, message->size);
+        // Place the data directly at its final position
+        if (blockIndex == 0) {
+            memcpy(slot->messageCrc, data, 3);
+            memcpy(slot->data, &data[3], 9);
+        } else {
+            memcpy(blecast_getPayloadByte(slot, blockIndex, 0), data, 12);
+        }
 
-            if (computedMessageCrc != messageCrc) {
-                _blecast_init(message);
-                return false;
-            }
+        blecast_setPayload(slot, blockIndex);
+        slot->discoveredPayloadCount++;
 
-            message->id = messageCrc;
+        // Last payload for this message
+        if (terminal) {
+            slot->totalPayloadCount = blockIndex + 1;
+            slot->lastPayloadPartial = partial;
+        }
+        blecast_agree(message);
+    }
 
-        } else {
-            for (uint8_t i = 0; i < 12; i++) {
-                message->data[i] = message->data[i + 1];
-            }
+    if (slot->totalPayloadCount == -1) { return result; }
 
-            message->id = payloadCrc;
+    // Message complete!
+    if (slot->totalPayloadCount == slot->discoveredPayloadCount) {
+        int16_t size = blecast_getSize(message, slot);
+        if (size < 0) {
+            blecast_discard(message, slot);
+            return PayloadResultAccepted;
         }
+        return blecast_complete(message, slot, size);
+    }
 
-        blecast_dump(message);
-
-        return true;
+#if BLECAST_ERASURE_CODING
+    // Enough payloads to recover the rest
+    if (slot->parityPayloadCount != -1 &&
+      slot->discoveredPayloadCount + slot->discoveredParityCount >= slot->totalPayloadCount) {
+        uint8_t foundPayloads[sizeof(slot->foundPayloads)];
+        memcpy(foundPayloads, slot->foundPayloads, sizeof(foundPayloads));
+        int8_t discoveredPayloadCount = slot->discoveredPayloadCount;
+
+        if (blecast_recover(slot)) {
+            int16_t size = blecast_getSize(message, slot);
+            if (size >= 0) { return blecast_complete(message, slot, size); }
+
+            // A parity payload from another message (see blecast_dropParity) recovers
+            // garbage; forget it and what it recovered, and wait for the rest
+            memcpy(slot->foundPayloads, foundPayloads, sizeof(foundPayloads));
+            slot->discoveredPayloadCount = discoveredPayloadCount;
+            blecast_dropParity(slot);
+        }
     }
+#endif
 
-    return false;
+    return result;
 }
 
-// Pre-computed whiten mask for each channel (byte[0] and byte[13:13 + 16]
+
+// Pre-computed whiten mask for each channel (byte[0] and byte[13:13 + 16]), stored bit
+// reversed so that de-whitening and reversing a received byte is a single lookup; since
+// reverse(b) ^ mask == reverse(b ^ reverse(mask)), the byte is reverseBits[b ^ mask].
 const uint8_t whitenMask[] PROGMEM = {
-//const uint8_t whitenMask[] = {
     // Channel 37
-    0x8d, 0x77, 0xf8, 0xe3, 0x46, 0xe9, 0xab, 0xd0, 0x9e,
-    0x53, 0x33, 0xd8, 0xba, 0x98, 0x08, 0x24, 0xcb,
+    0xb1, 0xee, 0x1f, 0xc7, 0x62, 0x97, 0xd5, 0x0b, 0x79,
+    0xca, 0xcc, 0x1b, 0x5d, 0x19, 0x10, 0x24, 0xd3,
 
     // Channel 38
-    0xd6, 0x4e, 0xcd, 0x60, 0xeb, 0x62, 0x22, 0x90, 0x2c,
-    0xef, 0xf0, 0xc7, 0x8d, 0xd2, 0x57, 0xa1, 0x3d,
+    0x6b, 0x72, 0xb3, 0x06, 0xd7, 0x46, 0x44, 0x09, 0x34,
+    0xf7, 0x0f, 0xe3, 0xb1, 0x4b, 0xea, 0x85, 0xbc,
 
     // Channel 39
-    0x1f, 0x59, 0xde, 0xe1, 0x8f, 0x1b, 0xa5, 0xaf, 0x42,
-    0x7b, 0x4e, 0xcd, 0x60, 0xeb, 0x62, 0x22, 0x90
+    0xf8, 0x9a, 0x7b, 0x87, 0xf1, 0xd8, 0xa5, 0xf5, 0x42,
+    0xde, 0x72, 0xb3, 0x06, 0xd7, 0x46, 0x44, 0x09
+};
+
+// The PDU type must be ADV_NONCONN_IND (E.7.7.65.13); this is the PDU type bit reversed,
+// so a raw (whitened) byte can be compared against the first byte of the whiten mask
+#define PDU_TYPE_ADV_NONCONN_IND_REVERSED    (0x02)
+
+
+#if BLECAST_ADAPTIVE_CHANNELS
+
+// Chooses the channel for the next poll, given the number of valid payloads the
+// current channel yielded during this poll.
+//
+// Each channel keeps a score of recent valid payloads, which decays by a quarter
+// each time it is listened to. A channel remains selected while it keeps yielding
+// payloads (up to BLECAST_MAX_DWELL polls), after which the highest scoring
+// channel not yet visited this round is chosen. So every channel is still
+// listened to at least once per round, in case the sender moves.
+static uint8_t blecast_nextChannel(BLECastMessage *message, uint8_t validCount) {
+    uint8_t channel = message->radioChannel;
+
+    uint16_t score = message->channelScore[channel];
+    score -= (score >> 2);
+    score += (uint16_t)validCount * CHANNEL_SCORE_STEP;
+    message->channelScore[channel] = (score > 0xff) ? 0xff: score;
+
+    // Still productive; stay here
+    if (validCount && ++message->channelDwell < BLECAST_MAX_DWELL) {
+        return channel;
+    }
+
+    message->channelDwell = 0;
+
+    // Every channel has been visited; start a new round
+    if (message->channelVisited == 0x07) { message->channelVisited = (1 << channel); }
+
+    // Pick the best scoring unvisited channel (ties go to the next in order)
+    int8_t best = -1;
+    for (uint8_t i = 1; i <= 2; i++) {
+        uint8_t candidate = channel + i;
+        if (candidate > 2) { candidate -= 3; }
+        if (message->channelVisited & (1 << candidate)) { continue; }
+        if (best == -1 || message->channelScore[candidate] > message->channelScore[best]) {
+            best = candidate;
+        }
+    }
+
+    message->channelVisited |= (1 << best);
+
+    return best;
+}
+
+#else
+
+// Round-robin through the advertising channels
+static uint8_t blecast_nextChannel(BLECastMessage *message, uint8_t validCount) {
+    (void)validCount;
+
+    uint8_t channel = message->radioChannel + 1;
+    if (channel > 2) { channel = 0; }
+    return channel;
+}
+
+#endif
+
+
+#if BLECAST_ACK_BEACON
+
+// Every acknowledgment beacon has this XOR'd into its CRC, so it is never mistaken
+// for a payload
+#define ACK_TAG                    (0x400)
+
+// The beacon flags; the message is complete, the message is extended
+#define ACK_FLAG_COMPLETE          (0x80)
+#define ACK_FLAG_EXTENDED          (0x40)
+
+// The BLE advertising packet of a beacon, before the beacon itself; ADV_NONCONN_IND
+// (random address), the length, a random static address, the flags and the header
+// of a 128-bit service UUID (the beacon), in the same layout as the payloads
+const uint8_t ackHeader[] PROGMEM = {
+    0x42, 27,
+    0x74, 0x73, 0x61, 0x43, 0x45, 0xcc,
+    0x02, 0x01, 0x06,
+    0x11, 0x07
 };
 
+// Broadcasts the payloads received for the most recent message in progress (or the
+// complete message) so the sender can skip them. The beacon (16 bytes):
+//   [ CRC-24 XOR ACK_TAG 3 ] [ complete 1 ] [ extended 1 ] [ 2 unused ] [ session 4 ]
+//   [ total payload count (0xff if unknown) 1 ] [ payload bit-set 8 ]
+//   [ parity bit-set 1 ] [ 0 2 ]
+// or for an extended message, the window of payloads kept ahead of the stream:
+//   [ window size 1 ] [ window bit-set (by index % window size) 8 ]
+//   [ next payload to stream 2 ] [ 0 1 ]
+// This is sealed with AES-128 decryption (the only direction the receiver has); the
+// sender opens it by encrypting.
+static void blecast_sendAck(BLECastMessage *message, bool complete) {
+    BLECastSlot *slot = NULL;
+    for (uint8_t i = 0; i < BLECAST_SESSION_SLOTS; i++) {
+        BLECastSlot *candidate = &message->slots[i];
+
+        if (complete) {
+            if (candidate->totalPayloadCount == candidate->discoveredPayloadCount) { slot = candidate; }
+#if BLECAST_STREAMING
+            if (candidate->extended && candidate->streamTotal && candidate->streamIndex == candidate->streamTotal) { slot = candidate; }
+#endif
+            continue;
+        }
+
+        if (blecast_isEmpty(candidate)) { continue; }
+#if BLECAST_SESSIONS
+        if (slot != NULL && !session_isNewer(candidate->session, slot->session)) { continue; }
+#endif
+        slot = candidate;
+    }
+
+    if (slot == NULL) { return; }
+
+    uint8_t packet[ACK_PACKET_SIZE];
+    for (uint8_t i = 0; i < sizeof(ackHeader); i++) {
+        packet[i] = pgm_read_byte(&ackHeader[i]);
+    }
+
+    uint8_t *beacon = &packet[sizeof(ackHeader)];
+    beacon[3] = slot->session | (complete ? ACK_FLAG_COMPLETE: 0);
+    beacon[4] = slot->totalPayloadCount;
+    memcpy(&beacon[5], slot->foundPayloads, 8);
+#if BLECAST_ERASURE_CODING
+    beacon[13] = slot->foundParity;
+#else
+    beacon[13] = 0;
+#endif
+    beacon[14] = 0;
+    beacon[15] = 0;
+
+#if BLECAST_STREAMING
+    if (slot->extended) {
+        beacon[3] |= ACK_FLAG_EXTENDED;
+        beacon[4] = blecast_getStreamWindow(slot);
+        beacon[13] = slot->streamIndex >> 8;
+        beacon[14] = slot->streamIndex;
+    }
+#endif
+
+    uint32_t crc = crc24_compute(&beacon[3], 13) ^ ACK_TAG;
+    beacon[0] = crc >> 16;
+    beacon[1] = crc >> 8;
+    beacon[2] = crc;
+
+    blecast_decrypt(message, beacon);
+
+    crc24_ble(packet, ACK_PACKET_SIZE - 3, &packet[ACK_PACKET_SIZE - 3]);
+
+    // Whiten (see whitenMask) and reverse the bits, since the radio sends MSB first
+    uint8_t lfsr = pgm_read_byte(&reverseBits[37 + message->radioChannel]) | 0x02;
+    for (uint8_t i = 0; i < ACK_PACKET_SIZE; i++) {
+        uint8_t mask = 0;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            if (lfsr & 0x80) {
+                lfsr ^= 0x11;
+                mask |= (1 << bit);
+            }
+            lfsr <<= 1;
+        }
+        packet[i] = pgm_read_byte(&reverseBits[packet[i] ^ mask]);
+    }
+
+    radio_send_packet(message, packet);
+}
+
+#endif
+
 
 bool blecast_poll(BLECastMessage *message) {
 
@@ -662,6 +1742,9 @@ bool blecast_poll(BLECastMessage *message) {
 
     bool success = false;
 
+    // The number of valid payloads found during this poll
+    uint8_t validCount = 0;
+
     radio_startListening(message);
 
     uint8_t buffer[BLECAST_PACKET_SIZE];
@@ -669,42 +1752,42 @@ bool blecast_poll(BLECastMessage *message) {
     while (radio_available(message)) {
         radio_read_packet(message, buffer);
 
-        uint8_t *data = buffer;
-        //uint8_t whitenIndex = whitenMask + getFrequencyIndex(radio_getChannel(message) - 37) * 17;
-        uint8_t whitenIndex = whitenMask + radio_getChannel(message) * 17;
-        //uint8_t *whiten = whitenMask[getFrequencyIndex(message->radio->getChannel() - 37) * 17];
+        blecast_count(message, packets[message->radioChannel]);
 
-        uint8_t b = *data;
-        // @TODO: Pre-compute this and just do a comparison instead of the below 0x40
-        b = reverse(b);
-        b ^= pgm_read_byte(whitenIndex++);
-        //b ^= *(whiten++);
+        const uint8_t *whiten = &whitenMask[message->radioChannel * BLECAST_PACKET_SIZE];
 
-        // PDU type must be ADV_NONCONN_IND (E.7.7.65.13)
-        if (b != 0x40) { continue; }
+        // Reject anything that is not ADV_NONCONN_IND before doing any other work
+        if (buffer[0] != (pgm_read_byte(whiten++) ^ PDU_TYPE_ADV_NONCONN_IND_REVERSED)) {
+            blecast_count(message, pduRejects);
+            continue;
+        }
 
-        data += 1;
+        // De-whiten and reverse the bits
+        uint8_t *data = &buffer[1];
         for (uint8_t index = 0; index < 16; index++) {
-            uint8_t b = *data;
-
-            // Reverse the bits
-            // https://graphics.stanford.edu/~seander/bithacks.html#ReverseByteWith32Bits
-            b = reverse(b);
-
-            // De-whiten
-            b ^= pgm_read_byte(whitenIndex++);
-            //b ^= *(whiten++);
-
-            *(data++) = b;
+            *data = pgm_read_byte(&reverseBits[*data ^ pgm_read_byte(whiten++)]);
+            data++;
         }
 
-        bool complete = blecast_addPayload(message, &buffer[1]);
-        if (complete) { success = true; }
+        PayloadResult result = blecast_addPayload(message, &buffer[1]);
+        if (result == PayloadResultComplete) { success = true; }
+        if (result != PayloadResultRejected && validCount != 0xff) { validCount++; }
     }
 
     radio_stopListening(message);
 
-    radio_setChannel(message, NEXT_CHANNEL);
+#if BLECAST_ACK_BEACON
+    if (success || ++message->ackPolls >= BLECAST_ACK_INTERVAL) {
+        message->ackPolls = 0;
+        blecast_sendAck(message, success);
+    }
+#endif
+
+    uint8_t channel = blecast_nextChannel(message, validCount);
+    if (channel != message->radioChannel) {
+        message->radioChannel = channel;
+        radio_setChannel(message, channel);
+    }
 
     return success;
 }
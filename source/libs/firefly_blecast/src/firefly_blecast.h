@@ -26,7 +26,18 @@
 #define _FIREFLY_BLECAST_H_
 
 
+// If non-zero, the radio functions are provided externally (by the host simulator in
+// extras) instead of driving an nRF24L01+ over SPI, so the library builds on a computer
+#ifndef BLECAST_MOCK_RADIO
+#define BLECAST_MOCK_RADIO           0
+#endif
+
+#if BLECAST_MOCK_RADIO
+#include <stdbool.h>
+#include <string.h>
+#else
 #include <Arduino.h>
+#endif
 
 #include <stdint.h>
 
@@ -35,14 +46,222 @@
 
 #define BLECAST_MINIMUM_BUFFER    96
 
-typedef struct BLECastMessage {
+// The payload index is 6 bits; payloads are placed directly in the message data, so a
+// buffer of (12 * BLECAST_MAX_PAYLOADS - 3) bytes holds the largest message
+#define BLECAST_MAX_PAYLOADS      64
+
+
+// If non-zero, the radio dwells on advertising channels that are yielding valid
+// payloads and visits the most productive channels first. If zero, the channels
+// are visited in a fixed round-robin order (37, 38, 39), which is deterministic
+// and useful for testing.
+#ifndef BLECAST_ADAPTIVE_CHANNELS
+#define BLECAST_ADAPTIVE_CHANNELS    1
+#endif
+
+// The maximum number of consecutive polls to remain on a productive channel
+#ifndef BLECAST_MAX_DWELL
+#define BLECAST_MAX_DWELL            4
+#endif
+
+// If non-zero, the full AES-128 decryption key schedule (176 bytes) is kept in
+// the message so payloads decrypt without any key scheduling. Otherwise only the
+// decryption start key (16 bytes) is kept and the schedule is computed on the fly.
+#ifndef BLECAST_AES_KEY_SCHEDULE
+#define BLECAST_AES_KEY_SCHEDULE     0
+#endif
+
+// If non-zero, parity payloads (Reed-Solomon over GF(256)) are accepted, so that a
+// message completes as soon as any K of its N payloads have been received. Up to
+// BLECAST_MAX_PARITY (8 or less) parity payloads are kept, which reserves that many
+// 12 byte slots at the end of the message data. This requires the
+// firefly_qrcode library (for its Reed-Solomon functions).
+#ifndef BLECAST_ERASURE_CODING
+#define BLECAST_ERASURE_CODING       0
+#endif
+
+#ifndef BLECAST_MAX_PARITY
+#define BLECAST_MAX_PARITY           4
+#endif
+
+// If non-zero, payloads tagged with a session are accepted, and payloads from an older
+// session are dropped rather than disrupting the current message. The session takes 4
+// bits of the payload CRC-24, leaving 20 bits to reject noise and foreign payloads, so
+// without this the whole CRC is checked and tagged payloads are rejected.
+#ifndef BLECAST_SESSIONS
+#define BLECAST_SESSIONS             0
+#endif
+
+// The number of messages (sessions) reassembled at once (more than 1 requires
+// BLECAST_SESSIONS). With 2 slots, a message in progress is kept while a newer one
+// arrives (whichever completes first wins), but each slot only has half of the
+// message data buffer.
+#ifndef BLECAST_SESSION_SLOTS
+#define BLECAST_SESSION_SLOTS        1
+#endif
+
+// If non-zero, compressed messages are accepted; runs of zero bytes (common in RLP
+// and ABI encoded data) are sent as a 2 byte run, so fewer payloads are needed. The
+// message is expanded in place once complete, so message->size is the expanded size.
+// Receivers without this reject compressed payloads (they carry a distinct tag).
+#ifndef BLECAST_COMPRESSION
+#define BLECAST_COMPRESSION          0
+#endif
+
+// If both are defined, the radio CE and CSN pins are bound at compile time to a port
+// register and bit (e.g. PORTB and 1 for Arduino pin 9 on the ATmega328P), and the
+// radioPinCE and radioPinCSN of the message are ignored. This assumes the ATmega328P
+// register layout (each DDRx directly below its PORTx, both in the low I/O space),
+// where each toggle compiles to a single sbi/cbi instead of a digitalWrite (about 2
+// cycles rather than an estimated 50 to 100; not measured on hardware). Other AVRs
+// must be checked against their datasheet before enabling this.
+//#define BLECAST_PIN_CE_PORT          PORTB
+//#define BLECAST_PIN_CE_BIT           1
+//#define BLECAST_PIN_CSN_PORT         PORTB
+//#define BLECAST_PIN_CSN_BIT          2
+
+// If non-zero, the receiver broadcasts an encrypted acknowledgment beacon (a bitmap
+// of the payloads it has) every BLECAST_ACK_INTERVAL polls while a message is in
+// progress, and once complete, so a cooperating sender can skip those payloads (see
+// blecast_encoder_acknowledge). Each beacon takes about 2.5ms of radio time.
+#ifndef BLECAST_ACK_BEACON
+#define BLECAST_ACK_BEACON           0
+#endif
+
+#ifndef BLECAST_ACK_INTERVAL
+#define BLECAST_ACK_INTERVAL         8
+#endif
+
+// If non-zero, extended messages (up to 16384 payloads, about 192kb) are accepted
+// and streamed, in order, to the callback set with blecast_setStream rather than
+// buffered; the message data holds a window of the payloads that arrived ahead of
+// the stream. The message CRC is only checked at the end, so a consumer must not
+// act on the data until blecast_poll returns true (a callback with NULL data means
+// the stream was abandoned and the consumer should start over).
+#ifndef BLECAST_STREAMING
+#define BLECAST_STREAMING            0
+#endif
+
+// If non-zero, the message keeps counters of what the receiver saw since blecast_init,
+// to help tune the radio (see BLECastStats)
+#ifndef BLECAST_STATS
+#define BLECAST_STATS                0
+#endif
+
+// Sessions, compression, parity and extended payloads are each marked by a tag XOR'd
+// into the 24 bit payload CRC, so each widens the set of CRC values accepted. A
+// payload from another sender (or noise) passes with a probability of:
+//   - 2^-24 with none of these
+//   - 16 times that with BLECAST_SESSIONS (any session), and twice that again with
+//     BLECAST_COMPRESSION (compressed or not)
+//   - for a data payload, 257 times that with BLECAST_STREAMING (the untagged value
+//     and 256 extended index tags)
+//   - for a parity payload (a quarter of index bytes mark one), 512 times that with
+//     BLECAST_ERASURE_CODING (512 parity tags, and no untagged value)
+// which is about 2^-11 (1 in 1600) with all of them. Such a payload cannot complete a
+// message (the message CRC is checked), and one that disagrees with the message in
+// progress is dropped rather than discarding it, unless the next one disagrees in the
+// same way; parity payloads (which pass by their tag alone) also give way to the data
+// payloads, and any they recovered is dropped if the message CRC fails.
+#define BLECAST_TAGS                 (BLECAST_SESSIONS || BLECAST_COMPRESSION || \
+                                      BLECAST_STREAMING || BLECAST_ERASURE_CODING)
+
+
+// Receive counters (these wrap around)
+typedef struct BLECastStats {
+    // Packets read from the radio on each channel (0 => 37, 1 => 38, 2 => 39)
+    uint16_t packets[3];
+
+    // Packets that were not ADV_NONCONN_IND
+    uint16_t pduRejects;
+
+    // Payloads that failed the CRC (not for us, or corrupt)
+    uint16_t crcFailures;
+
+    // Payloads we already had
+    uint16_t duplicates;
+
+    // Payloads from an older session (dropped)
+    uint16_t staleSessions;
+
+    // Complete messages that failed the message CRC
+    uint16_t messageCrcFailures;
+
+    // Complete compressed messages that could not be expanded
+    uint16_t decompressFailures;
+
+    // Messages in progress that were discarded
+    uint16_t resets;
+} BLECastStats;
+
+
+// Receives each run of an extended message's data, in order (see BLECAST_STREAMING);
+// data is NULL if the stream was abandoned
+typedef void (*BLECastStreamCallback)(void *context, const uint8_t *data, uint16_t length);
+
+
+// The reassembly state of a single message (session)
+typedef struct BLECastSlot {
     // Total payload counts and unique discovered payload counts
     int8_t discoveredPayloadCount;
     int8_t totalPayloadCount;
 
+    // The session tag of this message (0 for untagged senders)
+    uint8_t session;
+
+    // Bit-set of the payloads received (by index)
+    uint8_t foundPayloads[BLECAST_MAX_PAYLOADS / 8];
+
+    // Whether the last payload is partial (its length is in its last data byte)
+    bool lastPayloadPartial;
+
+    // The first 3 bytes of the first payload (the message CRC, for multi-payload messages)
+    uint8_t messageCrc[3];
+
+#if BLECAST_COMPRESSION
+    // Whether the payloads of this message are compressed
+    bool compressed;
+#endif
+
+#if BLECAST_STREAMING
+    // Whether this is an extended (streamed) message
+    bool extended;
+
+    // The next payload to stream, and the total payload count (0 if unknown)
+    uint16_t streamIndex;
+    uint16_t streamTotal;
+
+    // The CRC of the data streamed so far
+    uint32_t streamCrc;
+#endif
+
+#if BLECAST_ERASURE_CODING
+    // Total parity payload count (-1 if unknown) and unique discovered parity payloads
+    int8_t parityPayloadCount;
+    int8_t discoveredParityCount;
+
+    // Bit-set of the parity payloads kept
+    uint8_t foundParity;
+#endif
+
+    // The portion of the message data this message is reassembled into
+    uint8_t *data;
+    uint16_t maxSize;
+} BLECastSlot;
+
+typedef struct BLECastMessage {
     // Total number of bytes of the message (-1 if the message is incomplete)
     int16_t size;
 
+    // The messages (sessions) being reassembled
+    BLECastSlot slots[BLECAST_SESSION_SLOTS];
+
+#if BLECAST_TAGS
+    // A tagged payload that disagreed with the message in progress (see BLECAST_TAGS);
+    // the message is only given up once a second payload disagrees in the same way
+    uint16_t pending;
+#endif
+
     // This is used to store the message as payloads arrive
     uint8_t *data;
     uint16_t maxSize;
@@ -50,12 +269,48 @@ typedef struct BLECastMessage {
     // An ID for this message (BLECAST_INVALID_ID until message is valid)
     uint32_t id;
 
-    // The AES context initialized with the key
+#if BLECAST_AES_KEY_SCHEDULE
+    // The expanded AES-128 key schedule (AES128_KEY_SCHEDULE_SIZE)
+    uint8_t aesKeySchedule[176];
+#else
+    // The AES-128 decryption start key (the last round key of the key schedule)
     uint8_t aesKey[16];
+#endif
 
-    // Radio State
+    // Radio State (unused if the pins are bound at compile time; see BLECAST_PIN_CE_PORT)
     uint8_t radioPinCE;
     uint8_t radioPinCSN;
+
+    // The current advertising channel (0 => 37, 1 => 38, 2 => 39)
+    uint8_t radioChannel;
+
+#if BLECAST_STATS
+    BLECastStats stats;
+#endif
+
+#if BLECAST_STREAMING
+    BLECastStreamCallback streamCallback;
+    void *streamContext;
+
+    // The length of a completed extended message (its size is 0, as nothing is buffered)
+    uint32_t streamLength;
+#endif
+
+#if BLECAST_ACK_BEACON
+    // Polls since the last acknowledgment beacon
+    uint8_t ackPolls;
+#endif
+
+#if BLECAST_ADAPTIVE_CHANNELS
+    // A decaying score of valid payloads found on each channel
+    uint8_t channelScore[3];
+
+    // How many consecutive polls we have remained on the current channel
+    uint8_t channelDwell;
+
+    // Bit-set of the channels visited during the current round
+    uint8_t channelVisited;
+#endif
 } BLECastMessage;
 
 
@@ -70,6 +325,11 @@ bool blecast_poll(BLECastMessage *message);
 
 void blecast_reset(BLECastMessage *message);
 
+#if BLECAST_STREAMING
+// Sets the callback that extended messages are streamed to (NULL to reject them)
+void blecast_setStream(BLECastMessage *message, BLECastStreamCallback callback, void *context);
+#endif
+
 //void blecast_free(BLECastMessage *message);
 void blecast_shutdown(BLECastMessage *message);
 
@@ -0,0 +1,403 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018 Richard Moore <me@ricmoo.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "firefly_blecast_encoder.h"
+
+#include "aes.h"
+#include "crc24.h"
+
+#if BLECAST_ERASURE_CODING
+#include <firefly_qrcode.h>
+#endif
+
+
+// The BLE PDU header byte the receiver expects (before whitening)
+#define PDU_HEADER                 (0x40)
+
+// The offset of the payload within the BLE packet (after the PDU header, length,
+// advertiser address and the advertising data headers)
+#define PAYLOAD_OFFSET             (13)
+
+// See the receiver (firefly_blecast.c) for the parity and session tags
+#define PARITY_TAG_MARKER          (0x200)
+#define PARITY_TAG_PARTIAL         (0x100)
+#define SESSION_TAG_SHIFT          (12)
+#define COMPRESSED_TAG             (0x800)
+#define ACK_TAG                    (0x400)
+#define EXTENDED_TAG_MARKER        (0x100)
+#define ACK_FLAG_COMPLETE          (0x80)
+#define ACK_FLAG_EXTENDED          (0x40)
+
+
+static uint8_t reverse(uint8_t b) {
+    b = (b & 0xf0) >> 4 | (b & 0x0f) << 4;
+    b = (b & 0xcc) >> 2 | (b & 0x33) << 2;
+    b = (b & 0xaa) >> 1 | (b & 0x55) << 1;
+    return b;
+}
+
+// Whether the last data payload is partial
+static bool blecast_encoder_isPartial(BLECastEncoder *encoder) {
+    uint32_t length = encoder->length + ((encoder->length > 12) ? 3: 0);
+    return (length == 0 || (length % 12) != 0);
+}
+
+// The 12 data bytes of a data payload (the message CRC prefix, message data and
+// for a partial payload, its length in the last byte)
+static void blecast_encoder_getData(BLECastEncoder *encoder, uint16_t index, uint8_t *data) {
+    memset(data, 0, 12);
+
+    uint8_t prefix = (encoder->length > 12) ? 3: 0;
+    uint8_t length = 0;
+    for (uint8_t i = 0; i < 12; i++) {
+        int32_t offset = 12 * (int32_t)index + i - prefix;
+        if (offset < 0) {
+            data[i] = encoder->messageCrc >> (8 * (2 - i));
+        } else if ((uint32_t)offset < encoder->length) {
+            data[i] = encoder->message[offset];
+        } else {
+            break;
+        }
+        length++;
+    }
+
+    if (length < 12) { data[11] = length; }
+}
+
+// Computes the 16 byte plaintext (CRC, index and data) and shrink-wraps it
+static void blecast_encoder_wrap(uint8_t *payload, uint8_t index, const uint8_t *data, uint32_t tag) {
+    payload[3] = index;
+    memcpy(&payload[4], data, 12);
+
+    uint32_t crc = crc24_compute(&payload[3], 13) ^ tag;
+    payload[0] = crc >> 16;
+    payload[1] = crc >> 8;
+    payload[2] = crc;
+
+    // Extend the CRC across each byte (the receiver removes this noise)
+    for (uint8_t i = 3; i < 16; i++) {
+        payload[i] ^= (uint8_t)(crc >> (i - 3));
+    }
+}
+
+
+bool blecast_encoder_init(BLECastEncoder *encoder, const uint8_t *key, const uint8_t *message, uint32_t length, uint8_t session, uint8_t parityCount) {
+    if (length > BLECAST_ENCODER_MAX_EXTENDED_LENGTH || session > 0x0f) { return false; }
+    if (length > BLECAST_ENCODER_MAX_LENGTH && parityCount) { return false; }
+
+#if BLECAST_ERASURE_CODING
+    if (parityCount > BLECAST_ENCODER_MAX_PARITY) { return false; }
+#else
+    if (parityCount) { return false; }
+#endif
+
+    encoder->message = message;
+    encoder->length = length;
+    encoder->session = session;
+    encoder->parityCount = parityCount;
+    encoder->compressed = false;
+    encoder->extended = (length > BLECAST_ENCODER_MAX_LENGTH);
+    memset(encoder->acknowledged, 0, sizeof(encoder->acknowledged));
+    encoder->streamIndex = 0;
+    encoder->streamWindow = BLECAST_ENCODER_STREAM_WINDOW;
+    encoder->cursor = 0;
+    encoder->sweepStart = 0;
+    encoder->sweepRepeat = 0;
+    memcpy(encoder->aesKey, key, 16);
+
+    // Messages over 12 bytes are prefixed with the message CRC
+    encoder->messageCrc = 0;
+    uint32_t totalLength = length;
+    if (length > 12) {
+        // In runs, since an extended message may exceed the 16 bit CRC-24 length
+        uint32_t crc = CRC24_INIT;
+        for (uint32_t offset = 0; offset < length; offset += 0x8000) {
+            uint32_t run = length - offset;
+            crc = crc24_update(crc, &message[offset], (run > 0x8000) ? 0x8000: run);
+        }
+        encoder->messageCrc = crc;
+        totalLength += 3;
+    }
+
+    encoder->payloadCount = (totalLength + 11) / 12;
+    if (encoder->payloadCount == 0) { encoder->payloadCount = 1; }
+
+    return true;
+}
+
+bool blecast_encoder_initCompressed(BLECastEncoder *encoder, const uint8_t *key, const uint8_t *compressed, uint16_t length, uint8_t session, uint8_t parityCount) {
+    if (length > BLECAST_ENCODER_MAX_LENGTH) { return false; }
+    if (!blecast_encoder_init(encoder, key, compressed, length, session, parityCount)) { return false; }
+    encoder->compressed = true;
+    return true;
+}
+
+uint16_t blecast_encoder_compress(const uint8_t *data, uint16_t length, uint8_t *output, uint16_t maxLength) {
+    // The receiver expands in place from the end of its buffer, so the expanded data
+    // must never overtake the compressed data not yet read; track the closest it gets
+    int16_t closest = 0;
+
+    uint16_t offset = 0;
+    for (uint16_t i = 0; i < length; i++) {
+        if (offset == maxLength) { return 0; }
+
+        if (data[i]) {
+            output[offset++] = data[i];
+            continue;
+        }
+
+        // A run of zeros (up to 255)
+        uint8_t run = 1;
+        while (run < 255 && i + run < length && data[i + run] == 0) { run++; }
+        i += run - 1;
+
+        if (offset + 2 > maxLength) { return 0; }
+        output[offset++] = 0;
+        output[offset++] = run;
+
+        if ((int16_t)offset - (int16_t)(i + 1) < closest) { closest = (int16_t)offset - (int16_t)(i + 1); }
+    }
+
+    if (offset - closest > maxLength) { return 0; }
+
+    return offset;
+}
+
+bool blecast_encoder_acknowledge(BLECastEncoder *encoder, const uint8_t *beacon) {
+    uint8_t data[BLECAST_ENCODER_PAYLOAD_SIZE];
+    memcpy(data, beacon, sizeof(data));
+
+    // The receiver seals the beacon with AES decryption, so encrypting opens it
+    uint8_t aesKey[16];
+    memcpy(aesKey, encoder->aesKey, 16);
+    aes128_otfks_encrypt(data, aesKey);
+
+    uint32_t crc = ((uint32_t)data[0] << 16) | ((uint32_t)data[1] << 8) | data[2];
+    if ((crc24_compute(&data[3], 13) ^ ACK_TAG) != crc) { return false; }
+
+    // A beacon for a different message
+    if ((data[3] & 0x0f) != encoder->session) { return false; }
+    if (((data[3] & ACK_FLAG_EXTENDED) ? true: false) != encoder->extended) { return false; }
+
+    if (encoder->extended) {
+        // [ window 1 ] [ window bit-set (by index % window) 8 ] [ stream index 2 ]
+        uint16_t streamIndex = ((uint16_t)data[13] << 8) | data[14];
+        if (data[4] == 0 || data[4] > 64 || streamIndex > encoder->payloadCount) { return false; }
+
+        if (data[3] & ACK_FLAG_COMPLETE) { streamIndex = encoder->payloadCount; }
+
+        // An older beacon than one already applied
+        if (streamIndex < encoder->streamIndex) { return true; }
+
+        encoder->streamIndex = streamIndex;
+        encoder->streamWindow = data[4];
+        memcpy(encoder->acknowledged, &data[5], 8);
+
+        return true;
+    }
+
+    if (data[4] != 0xff && data[4] != encoder->payloadCount) { return false; }
+
+    if (data[3] & ACK_FLAG_COMPLETE) {
+        memset(encoder->acknowledged, 0xff, sizeof(encoder->acknowledged));
+        return true;
+    }
+
+    for (uint8_t i = 0; i < encoder->payloadCount; i++) {
+        if (data[5 + (i >> 3)] & (1 << (i & 0x07))) {
+            encoder->acknowledged[i >> 3] |= (1 << (i & 0x07));
+        }
+    }
+
+    for (uint8_t i = 0; i < 8 && i < encoder->parityCount; i++) {
+        if (data[13] & (1 << i)) {
+            uint8_t index = encoder->payloadCount + i;
+            encoder->acknowledged[index >> 3] |= (1 << (index & 0x07));
+        }
+    }
+
+    return true;
+}
+
+bool blecast_encoder_readAck(BLECastEncoder *encoder, const uint8_t *packet, uint8_t channel) {
+    // De-whiten (see blecast_encoder_getPacket)
+    uint8_t pdu[BLECAST_ENCODER_ACK_PACKET_SIZE];
+    uint8_t lfsr = reverse(37 + channel) | 0x02;
+    for (uint8_t i = 0; i < BLECAST_ENCODER_ACK_PACKET_SIZE; i++) {
+        uint8_t mask = 0;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            if (lfsr & 0x80) {
+                lfsr ^= 0x11;
+                mask |= (1 << bit);
+            }
+            lfsr <<= 1;
+        }
+        pdu[i] = reverse(packet[i]) ^ mask;
+    }
+
+    // ADV_NONCONN_IND of the expected length with a valid BLE CRC
+    if ((pdu[0] & 0x0f) != 0x02 || pdu[1] != BLECAST_ENCODER_ACK_PACKET_SIZE - 5) { return false; }
+
+    uint8_t crc[3];
+    crc24_ble(pdu, BLECAST_ENCODER_ACK_PACKET_SIZE - 3, crc);
+    if (memcmp(crc, &pdu[BLECAST_ENCODER_ACK_PACKET_SIZE - 3], 3)) { return false; }
+
+    return blecast_encoder_acknowledge(encoder, &pdu[PAYLOAD_OFFSET]);
+}
+
+bool blecast_encoder_isAcknowledged(BLECastEncoder *encoder, uint16_t index) {
+    if (encoder->extended) {
+        if (index < encoder->streamIndex) { return true; }
+        if (index - encoder->streamIndex >= encoder->streamWindow) { return false; }
+        index %= encoder->streamWindow;
+    }
+
+    if (index >= 8 * sizeof(encoder->acknowledged)) { return false; }
+    return (encoder->acknowledged[index >> 3] & (1 << (index & 0x07))) ? true: false;
+}
+
+uint16_t blecast_encoder_nextPayload(BLECastEncoder *encoder) {
+    uint16_t count = blecast_encoder_getPayloadCount(encoder);
+
+    if (!encoder->extended) {
+        for (uint16_t i = 0; i < count; i++) {
+            uint16_t index = (encoder->cursor++) % count;
+            if (!blecast_encoder_isAcknowledged(encoder, index)) { return index; }
+        }
+        return 0xffff;
+    }
+
+    if (encoder->streamIndex >= count) { return 0xffff; }
+
+    uint8_t window = encoder->streamWindow;
+
+    // The receiver has streamed past this sweep; catch up
+    if (encoder->sweepStart < encoder->streamIndex) {
+        encoder->sweepStart = encoder->streamIndex;
+        encoder->sweepRepeat = 0;
+        encoder->cursor = 0;
+    }
+
+    while (true) {
+        // Finished this window; repeat it, or slide ahead by half a window (back to
+        // the receiver's stream once past the end)
+        if (encoder->cursor == window || encoder->sweepStart + encoder->cursor >= count) {
+            encoder->cursor = 0;
+            if (++encoder->sweepRepeat == BLECAST_ENCODER_STREAM_REPEAT) {
+                encoder->sweepRepeat = 0;
+                encoder->sweepStart += (window + 1) / 2;
+                if (encoder->sweepStart >= count) { encoder->sweepStart = encoder->streamIndex; }
+            }
+        }
+
+        uint16_t index = encoder->sweepStart + (encoder->cursor++);
+        if (!blecast_encoder_isAcknowledged(encoder, index)) { return index; }
+    }
+}
+
+uint16_t blecast_encoder_getPayloadCount(BLECastEncoder *encoder) {
+    return encoder->payloadCount + encoder->parityCount;
+}
+
+void blecast_encoder_getPayload(BLECastEncoder *encoder, uint16_t index, uint8_t *payload) {
+    uint32_t tag = (uint32_t)encoder->session << SESSION_TAG_SHIFT;
+    if (encoder->compressed) { tag |= COMPRESSED_TAG; }
+    uint8_t data[12];
+
+    if (index < encoder->payloadCount) {
+        blecast_encoder_getData(encoder, index, data);
+
+        // The index byte; [terminal1] [partial1] [index6] (an extended message has
+        // the rest of the index in the tag)
+        uint8_t indexByte = index & 0x3f;
+        if (encoder->extended) { tag |= EXTENDED_TAG_MARKER | (index >> 6); }
+        if (index == encoder->payloadCount - 1) {
+            indexByte |= 0x80;
+            if (blecast_encoder_isPartial(encoder)) { indexByte |= 0x40; }
+        }
+
+        blecast_encoder_wrap(payload, indexByte, data, tag);
+
+#if BLECAST_ERASURE_CODING
+    } else {
+        uint8_t parityIndex = index - encoder->payloadCount;
+
+        uint8_t coeff[BLECAST_ENCODER_MAX_PARITY];
+        rs_init(encoder->parityCount, coeff);
+
+        // Each column of the data payloads is a Reed-Solomon message; the
+        // parity payloads are the remainders
+        uint8_t remainder[12][BLECAST_ENCODER_MAX_PARITY];
+        memset(remainder, 0, sizeof(remainder));
+        for (uint8_t i = 0; i < encoder->payloadCount; i++) {
+            blecast_encoder_getData(encoder, i, data);
+            for (uint8_t j = 0; j < 12; j++) {
+                rs_getRemainder(encoder->parityCount, coeff, &data[j], 1, remainder[j], 1);
+            }
+        }
+
+        for (uint8_t j = 0; j < 12; j++) {
+            data[j] = remainder[j][parityIndex];
+        }
+
+        tag |= PARITY_TAG_MARKER | ((encoder->parityCount - 1) << 4) | parityIndex;
+        if (blecast_encoder_isPartial(encoder)) { tag |= PARITY_TAG_PARTIAL; }
+
+        blecast_encoder_wrap(payload, 0x40 | (encoder->payloadCount - 1), data, tag);
+#endif
+    }
+
+    uint8_t aesKey[16];
+    memcpy(aesKey, encoder->aesKey, 16);
+    aes128_otfks_encrypt(payload, aesKey);
+}
+
+void blecast_encoder_getPacket(BLECastEncoder *encoder, uint16_t index, uint8_t channel, uint8_t *packet) {
+    uint8_t payload[BLECAST_ENCODER_PAYLOAD_SIZE];
+    blecast_encoder_getPayload(encoder, index, payload);
+
+    // BLE data whitening (Core Specification B.3.2); a 7-bit LFSR (x^7 + x^4 + 1)
+    // seeded with the channel index, with bits sent LSB first. The radio reads the
+    // bits MSB first, so each over-the-air byte is bit reversed.
+    uint8_t lfsr = reverse(37 + channel) | 0x02;
+
+    for (uint8_t i = 0; i < PAYLOAD_OFFSET + BLECAST_ENCODER_PAYLOAD_SIZE; i++) {
+        uint8_t mask = 0;
+        for (uint8_t bit = 0; bit < 8; bit++) {
+            if (lfsr & 0x80) {
+                lfsr ^= 0x11;
+                mask |= (1 << bit);
+            }
+            lfsr <<= 1;
+        }
+
+        if (i == 0) {
+            packet[0] = reverse(PDU_HEADER ^ mask);
+        } else if (i >= PAYLOAD_OFFSET) {
+            packet[1 + i - PAYLOAD_OFFSET] = reverse(payload[i - PAYLOAD_OFFSET] ^ mask);
+        }
+    }
+}
@@ -0,0 +1,168 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018 Richard Moore <me@ricmoo.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ *  BLECast Encoder
+ *
+ *  A portable (no Arduino dependencies) reference encoder, which produces the
+ *  payloads a sender broadcasts, and the over-the-air packets as read by the
+ *  receiver's radio (as consumed by blecast_poll).
+ */
+
+#ifndef _FIREFLY_BLECAST_ENCODER_H_
+#define _FIREFLY_BLECAST_ENCODER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// The encrypted payload (the 128-bit service UUID)
+#define BLECAST_ENCODER_PAYLOAD_SIZE    16
+
+// A packet as read from the radio; the PDU header and the payload
+#define BLECAST_ENCODER_PACKET_SIZE     (1 + 16)
+
+// The largest message (64 payloads, less the 3 byte message CRC)
+#define BLECAST_ENCODER_MAX_LENGTH      765
+
+// The largest extended message (16384 payloads, less the 3 byte message CRC); longer
+// messages than BLECAST_ENCODER_MAX_LENGTH are extended, which the receiver must be
+// built with BLECAST_STREAMING to accept
+#define BLECAST_ENCODER_MAX_EXTENDED_LENGTH    196605
+
+// The most parity payloads the payload index and tag can describe
+#define BLECAST_ENCODER_MAX_PARITY      16
+
+// The receiver window assumed for extended messages until a beacon says otherwise
+// (a 765 byte buffer split between 2 session slots holds 31 payloads)
+#define BLECAST_ENCODER_STREAM_WINDOW   31
+
+// How many times each window of an extended message is sent before sliding ahead
+// by half a window (so each payload is sent twice as often as this)
+#define BLECAST_ENCODER_STREAM_REPEAT   3
+
+// An acknowledgment beacon as read from the radio (a complete BLE advertising packet)
+#define BLECAST_ENCODER_ACK_PACKET_SIZE 32
+
+// Parity payloads need the Reed-Solomon functions of firefly_qrcode
+#ifndef BLECAST_ERASURE_CODING
+#define BLECAST_ERASURE_CODING          0
+#endif
+
+
+typedef struct BLECastEncoder {
+    // The message (not copied; must remain valid while encoding)
+    const uint8_t *message;
+    uint32_t length;
+
+    // The number of data payloads and parity payloads
+    uint16_t payloadCount;
+    uint8_t parityCount;
+
+    // Whether the message is extended (over BLECAST_ENCODER_MAX_LENGTH)
+    bool extended;
+
+    // The session tag (0 for untagged)
+    uint8_t session;
+
+    // Whether the message is compressed (see blecast_encoder_compress)
+    bool compressed;
+
+    // The AES-128 key
+    uint8_t aesKey[16];
+
+    // The message CRC (prefixed to messages over 12 bytes)
+    uint32_t messageCrc;
+
+    // Bit-set of the payloads the receiver has acknowledged (data then parity); for
+    // an extended message, the receiver's window (by index % streamWindow)
+    uint8_t acknowledged[(64 + BLECAST_ENCODER_MAX_PARITY) / 8];
+
+    // For an extended message, the next payload the receiver will stream and the
+    // number of payloads it keeps ahead of that (from its beacons)
+    uint16_t streamIndex;
+    uint8_t streamWindow;
+
+    // The send schedule (see blecast_encoder_nextPayload)
+    uint32_t cursor;
+    uint16_t sweepStart;
+    uint8_t sweepRepeat;
+} BLECastEncoder;
+
+
+#ifdef __cplusplus
+extern "C"{
+#endif  /* __cplusplus */
+
+
+// Prepares to encode message; returns false if the message is too long, the
+// session is not 4 bits or parity is requested but not supported (extended
+// messages cannot have parity)
+bool blecast_encoder_init(BLECastEncoder *encoder, const uint8_t *key, const uint8_t *message, uint32_t length, uint8_t session, uint8_t parityCount);
+
+// Prepares to encode an already compressed message (see blecast_encoder_compress);
+// the receiver must be built with BLECAST_COMPRESSION (and it cannot be extended)
+bool blecast_encoder_initCompressed(BLECastEncoder *encoder, const uint8_t *key, const uint8_t *compressed, uint16_t length, uint8_t session, uint8_t parityCount);
+
+// Compresses data into output (runs of zero bytes become a zero and the run length),
+// returning the compressed length, or 0 if it would exceed maxLength or could not be
+// expanded in place by a receiver with a maxLength buffer (BLECAST_ENCODER_MAX_LENGTH
+// matches the Firefly wallet)
+uint16_t blecast_encoder_compress(const uint8_t *data, uint16_t length, uint8_t *output, uint16_t maxLength);
+
+// The total number of payloads (the data payloads followed by the parity payloads)
+uint16_t blecast_encoder_getPayloadCount(BLECastEncoder *encoder);
+
+// Applies an acknowledgment beacon (the 16 byte service UUID) from a receiver built
+// with BLECAST_ACK_BEACON; returns false if it is not a valid beacon for this message.
+// Beacons only identify a message by its session, so senders should tag sessions.
+bool blecast_encoder_acknowledge(BLECastEncoder *encoder, const uint8_t *beacon);
+
+// Applies an acknowledgment beacon packet as read from the radio on channel (0 => 37,
+// 1 => 38, 2 => 39); returns false if it is not a valid beacon for this message
+bool blecast_encoder_readAck(BLECastEncoder *encoder, const uint8_t *packet, uint8_t channel);
+
+// Whether the receiver has acknowledged the payload at index (it need not be sent)
+bool blecast_encoder_isAcknowledged(BLECastEncoder *encoder, uint16_t index);
+
+// Returns the index of the next payload to send, skipping acknowledged payloads, or
+// 0xffff once the receiver has acknowledged the entire message. Payloads cycle in
+// order, except for extended messages; those sweep through the message a window at
+// a time (as the receiver only keeps a window of payloads ahead of its stream).
+uint16_t blecast_encoder_nextPayload(BLECastEncoder *encoder);
+
+// Computes the encrypted payload at index
+void blecast_encoder_getPayload(BLECastEncoder *encoder, uint16_t index, uint8_t *payload);
+
+// Computes the packet at index as it is read from the radio on channel (0 => 37,
+// 1 => 38, 2 => 39); whitened and bit reversed
+void blecast_encoder_getPacket(BLECastEncoder *encoder, uint16_t index, uint8_t channel, uint8_t *packet);
+
+
+#ifdef __cplusplus
+}
+#endif  /* __cplusplus */
+
+
+#endif
@@ -0,0 +1,51 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Richard Moore <me@ricmoo.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ *  The options the Firefly firmware builds its libraries with.
+ *
+ *  The Arduino IDE cannot pass -D flags to the libraries a sketch uses, but once the
+ *  sketch includes this header, its folder is on the include path of every library
+ *  too; so a library includes this header (if it is there) before its own defaults.
+ *  Host builds (see each library's extras) do not have it, so get the library
+ *  defaults, or whatever their -D flags pick.
+ */
+
+#ifndef __FIREFLY_CONFIG_H_
+#define __FIREFLY_CONFIG_H_
+
+
+// The QR code library supports versions 1 to 4, so the signature is a single version 4
+// QR code (see Available Trade-offs in firefly.ino); the address and pairing QR codes
+// are still version 3
+#ifndef LOCK_VERSION
+#define LOCK_VERSION       0
+#endif
+
+#ifndef QR_MAX_VERSION
+#define QR_MAX_VERSION     4
+#endif
+
+
+#endif  /* __FIREFLY_CONFIG_H_ */
@@ -0,0 +1,179 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018 Richard Moore <me@ricmoo.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/**
+ *  qrcode_segments - reports the bits saved by splitting text into numeric,
+ *  alphanumeric and byte segments (QR_SEGMENTATION), over encoding it in the one
+ *  mode that fits all of it, for a corpus of text.
+ *
+ *  For each section of the corpus it reports the total bits each way (at the
+ *  smallest version each fits without segments, with low error correction), and
+ *  how many entries fit a smaller version, or failing that a higher error
+ *  correction level at the same version.
+ *
+ *  Build (from this folder):
+ *    cc -O2 -DLOCK_VERSION=0 -DQR_MAX_VERSION=40 -I../src qrcode_segments.c \
+ *        ../src/firefly_qrcode.c \
+ *        -o qrcode_segments
+ *
+ *  Usage:
+ *    qrcode_segments < CORPUS
+ *
+ *    The corpus is one text per line (see uris.txt); a line starting with # begins
+ *    a new section, named by the rest of the line.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "firefly_qrcode.h"
+
+
+#if !QR_SEGMENTATION
+#error qrcode_segments requires QR_SEGMENTATION
+#endif
+
+// The error correction levels, lowest to highest
+static const uint8_t eccLevels[] = { ECC_LOW, ECC_MEDIUM, ECC_QUARTILE, ECC_HIGH };
+
+
+typedef struct Totals {
+    int count;
+    long singleBits, segmentedBits;
+    int smallerVersion, higherEcc, tooLong;
+} Totals;
+
+
+// The one mode that fits all of text (as chosen without QR_SEGMENTATION)
+static uint8_t getSingleMode(const char *text, int length) {
+    const char *symbols = " $%*+-./:";
+    uint8_t mode = MODE_NUMERIC;
+    for (int i = 0; i < length; i++) {
+        char c = text[i];
+        if (c >= '0' && c <= '9') { continue; }
+        if ((c >= 'A' && c <= 'Z') || strchr(symbols, c)) {
+            mode = MODE_ALPHANUMERIC;
+            continue;
+        }
+        return MODE_BYTE;
+    }
+    return mode;
+}
+
+// The bits of text in the one mode that fits all of it
+static long getSingleBits(const char *text, int length, int version) {
+    static const int countBits[3][3] = { { 10, 12, 14 }, { 9, 11, 13 }, { 8, 16, 16 } };
+    uint8_t mode = getSingleMode(text, length);
+    long bits = 4 + countBits[mode][(version <= 9) ? 0: ((version <= 26) ? 1: 2)];
+    switch (mode) {
+        case MODE_NUMERIC:
+            return bits + length / 3 * 10 + ((length % 3) ? ((length % 3) * 3 + 1): 0);
+        case MODE_ALPHANUMERIC:
+            return bits + length / 2 * 11 + (length % 2) * 6;
+    }
+    return bits + length * 8;
+}
+
+// The smallest version text fits without segments, at ecc (or 0)
+static int getSingleVersion(const char *text, int length, uint8_t ecc) {
+    uint8_t mode = getSingleMode(text, length);
+    for (int version = 1; version <= QR_MAX_VERSION; version++) {
+        if (length <= qrcode_getCapacity(version, ecc, mode)) { return version; }
+    }
+    return 0;
+}
+
+// The highest error correction level (index in eccLevels) that fits text at version, or -1
+static int getHighestEcc(const char *text, int length, int version, int segmented) {
+    int highest = -1;
+    for (int i = 0; i < 4; i++) {
+        int smallest = segmented ? qrcode_getMinimumVersion(eccLevels[i], (const uint8_t*)text, length):
+          getSingleVersion(text, length, eccLevels[i]);
+        if (smallest == 0 || smallest > version) { break; }
+        highest = i;
+    }
+    return highest;
+}
+
+static void printTotals(const char *name, Totals *totals) {
+    if (totals->count == 0) { return; }
+    printf("%-52s %5d %9ld %9ld %6.1f%% %7d %7d\n", name, totals->count, totals->singleBits,
+      totals->segmentedBits, 100.0 * (totals->singleBits - totals->segmentedBits) / totals->singleBits,
+      totals->smallerVersion, totals->higherEcc);
+    if (totals->tooLong) { printf("  (%d entries do not fit version %d)\n", totals->tooLong, QR_MAX_VERSION); }
+}
+
+static void addText(Totals *totals, const char *text, int length) {
+    int singleVersion = getSingleVersion(text, length, ECC_LOW);
+    int segmentedVersion = qrcode_getMinimumVersion(ECC_LOW, (const uint8_t*)text, length);
+    if (singleVersion == 0 || segmentedVersion == 0) {
+        totals->tooLong++;
+        return;
+    }
+
+    totals->count++;
+    totals->singleBits += getSingleBits(text, length, singleVersion);
+    totals->segmentedBits += qrcode_getDataBits(singleVersion, (const uint8_t*)text, length);
+
+    if (segmentedVersion < singleVersion) {
+        totals->smallerVersion++;
+    } else if (getHighestEcc(text, length, singleVersion, 1) > getHighestEcc(text, length, singleVersion, 0)) {
+        totals->higherEcc++;
+    }
+}
+
+int main(void) {
+    Totals section, all;
+    memset(&section, 0, sizeof(section));
+    memset(&all, 0, sizeof(all));
+
+    char name[128] = "(corpus)";
+    char line[4096];
+
+    printf("%-52s %5s %9s %9s %7s %7s %7s\n", "section", "texts", "single", "segmented",
+      "saved", "smaller", "ecc-up");
+
+    while (fgets(line, sizeof(line), stdin)) {
+        int length = strlen(line);
+        while (length && (line[length - 1] == '\n' || line[length - 1] == '\r')) { line[--length] = 0; }
+        if (length == 0) { continue; }
+
+        if (line[0] == '#') {
+            // Only the comment directly before entries names a section
+            if (section.count || section.tooLong) {
+                printTotals(name, &section);
+                memset(&section, 0, sizeof(section));
+            }
+            snprintf(name, sizeof(name), "%s", &line[(line[1] == ' ') ? 2: 1]);
+            continue;
+        }
+
+        addText(&section, line, length);
+        addText(&all, line, length);
+    }
+
+    printTotals(name, &section);
+    printTotals("(all)", &all);
+
+    return 0;
+}
@@ -0,0 +1,298 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2017 Richard Moore <me@ricmoo.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ *  qrcode_test - host tests for the QR code encoder.
+ *
+ *  A fixed corpus (a corpus file, such as uris.txt, and generated numeric,
+ *  alphanumeric, hex and byte text of many lengths) is encoded at every version
+ *  this build supports and every error correction level, and for each text:
+ *    - the streamed QR code (qrcode_getStripe) matches the module grid
+ *    - qrcode_getDataBits is the bits of the one mode that fits all of the text
+ *      without QR_SEGMENTATION, and no more with it
+ *
+ *  and qrcode_base45Encode is checked against the examples of RFC 9285.
+ *
+ *  A digest of every module grid and mask is printed, so the output of builds with
+ *  the flash tables (QR_MASK_TABLES, QR_FUNCTION_TABLES, RS_LOG_TABLES and
+ *  RS_GENERATOR_TABLES) on and off can be compared (see the Makefile). Without
+ *  QR_SEGMENTATION, it must also be the digest of the original encoder (before the
+ *  packed penalty scoring, the tables and in-place error correction; see below).
+ *
+ *  Build (from this folder; or run: make test):
+ *    cc -O2 -I../src qrcode_test.c ../src/firefly_qrcode.c -o qrcode_test
+ *
+ *  Usage:
+ *    qrcode_test CORPUS
+ *
+ *    The corpus is one text per line; lines starting with # are skipped. Prints
+ *    each failure and the digest; exits with 1 if anything failed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "firefly_qrcode.h"
+
+
+// The digest of the original encoder (bit by bit penalty scoring, masks and function
+// patterns drawn for each QR code) for the corpus in uris.txt, for the LOCK_VERSION 3
+// build and the LOCK_VERSION 0 build with QR_MAX_VERSION 10 (as the Makefile builds)
+#define ORIGINAL_DIGEST_LOCKED     0x7390fb6e
+#define ORIGINAL_DIGEST_VERSIONS   0x3a88cc26
+
+// The generated text for each kind of character
+#define GENERATED_COUNT            (60)
+
+// Longer than any text the versions tested hold
+#define MAX_TEXT_LENGTH            (400)
+
+// The largest module grid and codewords
+#define MAX_BUFFER_SIZE            (4096)
+
+
+static int failures = 0;
+
+#define check(condition, ...)  do { \
+        if (!(condition)) { \
+            failures++; \
+            printf("FAIL %s:%d: ", __func__, __LINE__); \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+        } \
+    } while (0)
+
+
+// FNV-1a, so the digest is the same on any host
+static uint32_t digest = 0x811c9dc5;
+
+static void addDigest(uint8_t value) {
+    digest = (digest ^ value) * 0x01000193;
+}
+
+
+// A small deterministic generator, so the corpus is the same on any host
+static uint32_t seed = 1;
+
+static uint32_t nextRandom() {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+
+static const char alphanumeric[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ $%*+-./:";
+
+static bool isAlphanumericChar(char c) {
+    return (c != 0 && strchr(alphanumeric, c) != NULL);
+}
+
+// The bits of text in the one mode that fits all of it (less the terminator and padding)
+static uint32_t getSingleModeBits(const char *text, uint16_t length, uint8_t version) {
+    bool numeric = true, alpha = true;
+    for (uint16_t i = 0; i < length; i++) {
+        if (text[i] < '0' || text[i] > '9') { numeric = false; }
+        if (!isAlphanumericChar(text[i])) { alpha = false; }
+    }
+
+    // The character count bits (versions 1-9, 10-26 and 27-40)
+    uint8_t range = (version <= 9) ? 0: ((version <= 26) ? 1: 2);
+    if (numeric) {
+        const uint8_t countBits[] = { 10, 12, 14 };
+        return 4 + countBits[range] + 10 * (length / 3) + ((length % 3 == 2) ? 7: ((length % 3 == 1) ? 4: 0));
+    }
+    if (alpha) {
+        const uint8_t countBits[] = { 9, 11, 13 };
+        return 4 + countBits[range] + 11 * (length / 2) + 6 * (length % 2);
+    }
+    const uint8_t countBits[] = { 8, 16, 16 };
+    return 4 + countBits[range] + 8 * length;
+}
+
+static void testText(const char *text) {
+    static uint8_t modules[MAX_BUFFER_SIZE], codewords[MAX_BUFFER_SIZE], stripe[MAX_BUFFER_SIZE];
+
+    uint16_t length = strlen(text);
+
+#if LOCK_VERSION == 0
+    for (uint8_t version = 1; version <= QR_MAX_VERSION; version++) {
+#else
+    for (uint8_t version = LOCK_VERSION; version <= LOCK_VERSION; version++) {
+#endif
+        uint32_t bits = qrcode_getDataBits(version, (const uint8_t*)text, length);
+        uint32_t singleModeBits = getSingleModeBits(text, length, version);
+#if QR_SEGMENTATION
+        check(bits <= singleModeBits, "segmented bits=%u single=%u version=%d text=%s", bits, singleModeBits, version, text);
+#else
+        check(bits == singleModeBits, "bits=%u single=%u version=%d text=%s", bits, singleModeBits, version, text);
+#endif
+
+        for (uint8_t ecc = 0; ecc < 4; ecc++) {
+            QRCode qrcode;
+            int8_t result = qrcode_initText(&qrcode, modules, version, ecc, text);
+
+            QRCode streamed;
+            int8_t streamedResult = qrcode_initStreamedText(&streamed, codewords, version, ecc, text);
+            check(result == streamedResult, "result=%d streamed=%d version=%d ecc=%d", result, streamedResult, version, ecc);
+
+            addDigest(version);
+            addDigest(ecc);
+            addDigest(result);
+            if (result < 0) { continue; }
+            addDigest(qrcode.mask);
+
+            for (uint8_t y = 0; y < qrcode.size; y++) {
+                uint8_t row = 0;
+                for (uint8_t x = 0; x < qrcode.size; x++) {
+                    row = (row << 1) | (qrcode_getModule(&qrcode, x, y) ? 1: 0);
+                    if ((x & 0x07) == 0x07) { addDigest(row); }
+                }
+                addDigest(row);
+            }
+
+            if (streamedResult < 0) { continue; }
+            check(qrcode.mask == streamed.mask, "mask=%d streamed=%d version=%d ecc=%d", qrcode.mask, streamed.mask, version, ecc);
+
+            // Stripes of 8 rows, as the display draws them
+            for (uint8_t top = 0; top < qrcode.size; top += 8) {
+                uint8_t rows = (qrcode.size - top < 8) ? (qrcode.size - top): 8;
+                qrcode_getStripe(&streamed, top, rows, stripe);
+
+                uint16_t offset = 0;
+                for (uint8_t y = top; y < top + rows; y++) {
+                    for (uint8_t x = 0; x < qrcode.size; x++, offset++) {
+                        bool module = (stripe[offset >> 3] & (0x80 >> (offset & 0x07))) ? true: false;
+                        if (module == qrcode_getModule(&qrcode, x, y)) { continue; }
+                        check(false, "stripe module x=%d y=%d version=%d ecc=%d text=%s", x, y, version, ecc, text);
+                        return;
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void testCorpus(const char *filename) {
+    FILE *file = fopen(filename, "r");
+    check(file != NULL, "cannot open %s", filename);
+    if (file == NULL) { return; }
+
+    char line[MAX_TEXT_LENGTH + 2];
+    while (fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\r\n")] = 0;
+        if (line[0] == '#' || line[0] == 0) { continue; }
+        testText(line);
+    }
+
+    fclose(file);
+}
+
+// Numeric, alphanumeric, upper-case hex and byte (any printable or high) text, of every
+// length up to past what the largest version tested holds
+static void testGenerated() {
+    const char *characters[] = { "0123456789", alphanumeric, "0123456789ABCDEF:/x", NULL };
+
+    char text[MAX_TEXT_LENGTH + 1];
+    for (uint8_t kind = 0; kind < 4; kind++) {
+        for (uint16_t i = 0; i < GENERATED_COUNT; i++) {
+            uint16_t length = 1 + nextRandom() % (kind == 0 ? MAX_TEXT_LENGTH: MAX_TEXT_LENGTH / 2);
+            for (uint16_t j = 0; j < length; j++) {
+                if (characters[kind]) {
+                    text[j] = characters[kind][nextRandom() % strlen(characters[kind])];
+                } else {
+                    text[j] = 32 + nextRandom() % 224;
+                }
+            }
+            text[length] = 0;
+            testText(text);
+        }
+    }
+}
+
+// The examples of RFC 9285 (section 4.3), the largest and smallest pairs and odd bytes, and
+// a signature sized input; nothing is written past the Base45 text
+static void testBase45() {
+    const struct { const char *data; uint16_t length; const char *base45; } vectors[] = {
+        { "AB", 2, "BB8" },
+        { "Hello!!", 7, "%69 VD92EX0" },
+        { "base-45", 7, "UJCLQE7W581" },
+        { "ietf!", 5, "QED8WEX0" },
+        { "\xff\xff", 2, "FGW" },
+        { "\xff\xff\xff\xff\xff", 5, "FGWFGWU5" },
+        { "\x00\x00", 2, "000" },
+        { "\x00", 1, "00" },
+        { "", 0, "" },
+    };
+
+    for (uint8_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+        char text[32];
+        memset(text, '#', sizeof(text));
+        qrcode_base45Encode((const uint8_t*)vectors[i].data, vectors[i].length, text);
+
+        uint16_t length = strlen(vectors[i].base45);
+        check(memcmp(text, vectors[i].base45, length) == 0 && text[length] == '#',
+              "base45 of vector %d is %.*s, not %s", i, length, text, vectors[i].base45);
+    }
+
+    // Every character is Alphanumeric, and the length is 3 per pair (2 for an odd byte)
+    uint8_t data[65];
+    char text[3 * sizeof(data) / 2 + 2];
+    for (uint8_t i = 0; i < sizeof(data); i++) { data[i] = nextRandom(); }
+    for (uint8_t length = 63; length <= 65; length++) {
+        memset(text, 0, sizeof(text));
+        qrcode_base45Encode(data, length, text);
+        uint16_t expected = 3 * (length / 2) + 2 * (length % 2);
+        check(strlen(text) == expected, "base45 of %d bytes is %d characters", length, (int)strlen(text));
+        for (uint16_t j = 0; j < expected; j++) {
+            check(isAlphanumericChar(text[j]), "base45 character %d is 0x%02x", j, text[j]);
+        }
+    }
+}
+
+
+int main(int argc, char **argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s CORPUS\n", argv[0]);
+        return 1;
+    }
+
+    testCorpus(argv[1]);
+    testGenerated();
+    testBase45();
+
+#if !QR_SEGMENTATION
+#if LOCK_VERSION == 3
+    check(digest == ORIGINAL_DIGEST_LOCKED, "digest does not match the original encoder");
+#elif LOCK_VERSION == 0 && QR_MAX_VERSION == 10
+    check(digest == ORIGINAL_DIGEST_VERSIONS, "digest does not match the original encoder");
+#endif
+#endif
+
+    printf("digest: %08x\n", digest);
+    printf("%s\n", failures ? "FAILED": "passed");
+
+    return failures ? 1: 0;
+}
@@ -0,0 +1,285 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018 Richard Moore <me@ricmoo.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+/**
+ *  qrfountain_simulate - a host simulator and reference decoder for animated QR
+ *  codes (see firefly_qrcode_fountain.h).
+ *
+ *  Random payloads are sent as frames from the fountain, each caught by the
+ *  receiver unless lost (a blurred or skipped camera frame). The receiver solves
+ *  the frames it catches by Gaussian elimination over GF(2) as they arrive, and
+ *  once it has every block checks the payload against the frame checksum.
+ *
+ *  For each payload length it reports the distribution of frames shown until the
+ *  payload is decoded, the frames caught beyond the number of blocks, and the
+ *  throughput (payload bytes per second) if a new frame is shown every PERIOD.
+ *
+ *  It exits with 1 if any trial fails to decode; `make test` (in this folder)
+ *  runs it at a fixed loss rate.
+ *
+ *  Build (from this folder):
+ *    cc -O2 -I../src qrfountain_simulate.c ../src/firefly_qrcode_fountain.c \
+ *        -o qrfountain_simulate
+ *
+ *  Usage:
+ *    qrfountain_simulate [-n TRIALS] [-l LOSS] [-f FRAME] [-p PERIOD]
+ *        [-b LENGTH] [-x SEED]
+ *
+ *    -n TRIALS     Trials per payload length (default: 200)
+ *    -l LOSS       Probability a frame is lost (default: 0.2)
+ *    -f FRAME      Frame size in bytes, including the 6 byte header (default: 72;
+ *                  a version 4 QR code, or 48 for version 3)
+ *    -p PERIOD     Milliseconds each frame is shown (default: 250)
+ *    -b LENGTH     Only simulate payloads of LENGTH bytes (default: 64, 256,
+ *                  1024, 4096 and 16384)
+ *    -x SEED       Random seed (default: 1)
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "firefly_qrcode_fountain.h"
+
+
+#define MAX_LENGTH      65535
+
+// Give up on a trial after this many frames per block
+#define TIMEOUT         (50)
+
+
+static double lossRate = 0.2;
+
+static uint8_t payload[MAX_LENGTH];
+
+
+static double randomUnit() {
+    return (double)rand() / ((double)RAND_MAX + 1.0);
+}
+
+static void readPayload(void *context, uint16_t offset, uint8_t *buffer, uint8_t length) {
+    memcpy(buffer, &((uint8_t*)context)[offset], length);
+}
+
+
+// Reference decoder; rows[p] (if present) is an equation whose lowest block is p
+
+typedef struct Decoder {
+    uint16_t blockCount;
+    uint8_t blockSize;
+    uint16_t length;
+    uint16_t checksum;
+
+    uint16_t coeffSize;
+    uint8_t *coeffs;
+    uint8_t *data;
+    uint8_t *present;
+    uint16_t rank;
+} Decoder;
+
+static void decoder_init(Decoder *decoder, uint16_t length, uint16_t checksum, uint8_t blockSize) {
+    decoder->blockSize = blockSize;
+    decoder->length = length;
+    decoder->checksum = checksum;
+    decoder->blockCount = (length + blockSize - 1) / blockSize;
+    decoder->coeffSize = (decoder->blockCount + 7) / 8;
+    decoder->coeffs = calloc(decoder->blockCount, decoder->coeffSize);
+    decoder->data = calloc(decoder->blockCount, blockSize);
+    decoder->present = calloc(decoder->blockCount, 1);
+    decoder->rank = 0;
+}
+
+static void decoder_free(Decoder *decoder) {
+    free(decoder->coeffs);
+    free(decoder->data);
+    free(decoder->present);
+}
+
+static void xorBytes(uint8_t *a, const uint8_t *b, uint16_t length) {
+    for (uint16_t i = 0; i < length; i++) { a[i] ^= b[i]; }
+}
+
+// Adds a frame; returns true once every block is known
+static bool decoder_addFrame(Decoder *decoder, const uint8_t *frame, uint16_t frameSize) {
+    uint16_t index = (frame[0] << 8) | frame[1];
+    uint16_t length = (frame[2] << 8) | frame[3];
+    uint16_t checksum = (frame[4] << 8) | frame[5];
+
+    // A frame of some other payload
+    if (length != decoder->length || checksum != decoder->checksum) { return false; }
+    if (frameSize != QRFOUNTAIN_HEADER_SIZE + decoder->blockSize) { return false; }
+
+    uint16_t coeffSize = decoder->coeffSize;
+    uint8_t coeff[coeffSize], data[decoder->blockSize];
+    memset(coeff, 0, coeffSize);
+    memcpy(data, &frame[QRFOUNTAIN_HEADER_SIZE], decoder->blockSize);
+
+    QRFountainBlocks blocks;
+    qrfountain_beginBlocks(&blocks, checksum, index, decoder->blockCount);
+    uint16_t block;
+    while ((block = qrfountain_nextBlock(&blocks)) != QRFOUNTAIN_NO_BLOCK) {
+        coeff[block / 8] |= (1 << (block % 8));
+    }
+
+    // Eliminate each block already with a row, lowest first
+    int32_t pivot = -1;
+    for (uint16_t p = 0; p < decoder->blockCount; p++) {
+        if (!(coeff[p / 8] & (1 << (p % 8)))) { continue; }
+        if (!decoder->present[p]) {
+            if (pivot == -1) { pivot = p; }
+            continue;
+        }
+        xorBytes(coeff, &decoder->coeffs[p * coeffSize], coeffSize);
+        xorBytes(data, &decoder->data[p * decoder->blockSize], decoder->blockSize);
+    }
+
+    // Nothing new
+    if (pivot == -1) { return false; }
+
+    // The lowest block may have been eliminated after it was picked
+    while (!(coeff[pivot / 8] & (1 << (pivot % 8)))) { pivot++; }
+
+    memcpy(&decoder->coeffs[pivot * coeffSize], coeff, coeffSize);
+    memcpy(&decoder->data[pivot * decoder->blockSize], data, decoder->blockSize);
+    decoder->present[pivot] = 1;
+    decoder->rank++;
+
+    if (decoder->rank < decoder->blockCount) { return false; }
+
+    // Back substitute, highest first, so each row ends up with only its own block
+    for (int32_t p = decoder->blockCount - 1; p >= 0; p--) {
+        uint8_t *row = &decoder->coeffs[p * coeffSize];
+        for (uint16_t q = p + 1; q < decoder->blockCount; q++) {
+            if (!(row[q / 8] & (1 << (q % 8)))) { continue; }
+            xorBytes(row, &decoder->coeffs[q * coeffSize], coeffSize);
+            xorBytes(&decoder->data[p * decoder->blockSize], &decoder->data[q * decoder->blockSize], decoder->blockSize);
+        }
+    }
+
+    return true;
+}
+
+static int compareInts(const void *a, const void *b) {
+    return *(const int*)a - *(const int*)b;
+}
+
+static int simulate(uint16_t length, uint8_t frameSize, int trials, uint32_t period) {
+    int *shown = malloc(trials * sizeof(int));
+    uint8_t frame[256];
+    long caughtTotal = 0;
+    int failures = 0, blockCount = 0;
+
+    for (int trial = 0; trial < trials; trial++) {
+        for (uint16_t i = 0; i < length; i++) { payload[i] = rand(); }
+
+        QRFountain fountain;
+        if (!qrfountain_init(&fountain, readPayload, payload, length, frameSize)) {
+            fprintf(stderr, "Invalid payload length or frame size\n");
+            exit(1);
+        }
+        blockCount = fountain.blockCount;
+
+        // The receiver starts watching partway through the animation
+        fountain.index = rand() % (2 * blockCount);
+
+        Decoder decoder;
+        decoder_init(&decoder, length, fountain.checksum, fountain.blockSize);
+
+        int frames = 0, caught = 0;
+        bool done = false;
+        while (!done && frames < TIMEOUT * blockCount) {
+            qrfountain_nextFrame(&fountain, frame);
+            frames++;
+            if (randomUnit() < lossRate) { continue; }
+            caught++;
+            done = decoder_addFrame(&decoder, frame, frameSize);
+        }
+
+        if (!done || memcmp(decoder.data, payload, length) ||
+          qrfountain_checksum(0, decoder.data, length) != fountain.checksum) {
+            failures++;
+        }
+
+        shown[trial] = frames;
+        caughtTotal += caught - blockCount;
+        decoder_free(&decoder);
+    }
+
+    qsort(shown, trials, sizeof(int), compareInts);
+    double mean = 0;
+    for (int i = 0; i < trials; i++) { mean += shown[i]; }
+    mean /= trials;
+
+    printf("%6d  %6d  %8.1f  %6d  %6d  %6d  %8.2f  %10.1f  %d\n", length, blockCount, mean,
+      shown[trials / 2], shown[trials * 95 / 100], shown[trials - 1],
+      (double)caughtTotal / trials, length / (mean * period / 1000.0), failures);
+
+    free(shown);
+    return failures;
+}
+
+int main(int argc, char **argv) {
+    int trials = 200, option;
+    int frameSize = 72, length = 0;
+    uint32_t period = 250;
+    unsigned int seed = 1;
+
+    while ((option = getopt(argc, argv, "n:l:f:p:b:x:")) != -1) {
+        switch (option) {
+            case 'n': trials = atoi(optarg); break;
+            case 'l': lossRate = atof(optarg); break;
+            case 'f': frameSize = atoi(optarg); break;
+            case 'p': period = atoi(optarg); break;
+            case 'b': length = atoi(optarg); break;
+            case 'x': seed = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-n TRIALS] [-l LOSS] [-f FRAME] [-p PERIOD] [-b LENGTH] [-x SEED]\n", argv[0]);
+                return 1;
+        }
+    }
+
+    if (trials < 1 || period < 1 || frameSize <= QRFOUNTAIN_HEADER_SIZE || frameSize > 255 ||
+      length < 0 || length > MAX_LENGTH || lossRate < 0 || lossRate >= 1) {
+        fprintf(stderr, "Invalid option\n");
+        return 1;
+    }
+
+    srand(seed);
+
+    printf("loss=%.2f frame=%d bytes period=%ums trials=%d\n", lossRate, frameSize, period, trials);
+    printf("length  blocks  mean-frm  median     p95     max  overhead  bytes/sec  failures\n");
+
+    int failures = 0;
+    if (length) {
+        failures += simulate(length, frameSize, trials, period);
+    } else {
+        const uint16_t lengths[] = { 64, 256, 1024, 4096, 16384 };
+        for (uint8_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+            failures += simulate(lengths[i], frameSize, trials, period);
+        }
+    }
+
+    return failures ? 1: 0;
+}
@@ -34,36 +34,135 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef __AVR__
+#include <avr/pgmspace.h>
+#else
+#define PROGMEM
+#define pgm_read_byte(addr)    (*(const uint8_t*)(addr))
+#endif
+
 #pragma mark - Error Correction Lookup tables
 
 #if LOCK_VERSION == 0
 
-static const uint16_t NUM_ERROR_CORRECTION_CODEWORDS[4][40] = {
-    // 1,  2,  3,  4,  5,   6,   7,   8,   9,  10,  11,  12,  13,  14,  15,  16,  17,  18,  19,  20,  21,  22,  23,  24,   25,   26,   27,   28,   29,   30,   31,   32,   33,   34,   35,   36,   37,   38,   39,   40    Error correction level
-    { 10, 16, 26, 36, 48,  64,  72,  88, 110, 130, 150, 176, 198, 216, 240, 280, 308, 338, 364, 416, 442, 476, 504, 560,  588,  644,  700,  728,  784,  812,  868,  924,  980, 1036, 1064, 1120, 1204, 1260, 1316, 1372},  // Medium
-    {  7, 10, 15, 20, 26,  36,  40,  48,  60,  72,  80,  96, 104, 120, 132, 144, 168, 180, 196, 224, 224, 252, 270, 300,  312,  336,  360,  390,  420,  450,  480,  510,  540,  570,  570,  600,  630,  660,  720,  750},  // Low
-    { 17, 28, 44, 64, 88, 112, 130, 156, 192, 224, 264, 308, 352, 384, 432, 480, 532, 588, 650, 700, 750, 816, 900, 960, 1050, 1110, 1200, 1260, 1350, 1440, 1530, 1620, 1710, 1800, 1890, 1980, 2100, 2220, 2310, 2430},  // High
-    { 13, 22, 36, 52, 72,  96, 108, 132, 160, 192, 224, 260, 288, 320, 360, 408, 448, 504, 546, 600, 644, 690, 750, 810,  870,  952, 1020, 1050, 1140, 1200, 1290, 1350, 1440, 1530, 1590, 1680, 1770, 1860, 1950, 2040},  // Quartile
-};
+#if QR_MAX_VERSION < 1 || QR_MAX_VERSION > 40
+#error QR_MAX_VERSION must be 1 through 40
+#endif
 
-static const uint8_t NUM_ERROR_CORRECTION_BLOCKS[4][40] = {
-    // Version: (note that index 0 is for padding, and is set to an illegal value)
-    // 1, 2, 3, 4, 5, 6, 7, 8, 9,10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40    Error correction level
-    {  1, 1, 1, 2, 2, 4, 4, 4, 5, 5,  5,  8,  9,  9, 10, 10, 11, 13, 14, 16, 17, 17, 18, 20, 21, 23, 25, 26, 28, 29, 31, 33, 35, 37, 38, 40, 43, 45, 47, 49},  // Medium
-    {  1, 1, 1, 1, 1, 2, 2, 2, 2, 4,  4,  4,  4,  4,  6,  6,  6,  6,  7,  8,  8,  9,  9, 10, 12, 12, 12, 13, 14, 15, 16, 17, 18, 19, 19, 20, 21, 22, 24, 25},  // Low
-    {  1, 1, 2, 4, 4, 4, 5, 6, 8, 8, 11, 11, 16, 16, 18, 16, 19, 21, 25, 25, 25, 34, 30, 32, 35, 37, 40, 42, 45, 48, 51, 54, 57, 60, 63, 66, 70, 74, 77, 81},  // High
-    {  1, 1, 2, 2, 4, 4, 6, 6, 8, 8,  8, 10, 12, 16, 12, 17, 16, 18, 21, 20, 23, 23, 25, 27, 29, 34, 34, 35, 38, 40, 43, 45, 48, 51, 53, 56, 59, 62, 65, 68},  // Quartile
+// The error correction codewords in each block, by version and error correction format bits
+static const uint8_t ECC_CODEWORDS_PER_BLOCK[][4] PROGMEM = {
+    // Medium, Low, High, Quartile    Version
+    { 10,  7, 17, 13 },  // 1
+    { 16, 10, 28, 22 },  // 2
+    { 26, 15, 22, 18 },  // 3
+    { 18, 20, 16, 26 },  // 4
+    { 24, 26, 22, 18 },  // 5
+    { 16, 18, 28, 24 },  // 6
+    { 18, 20, 26, 18 },  // 7
+    { 22, 24, 26, 22 },  // 8
+    { 22, 30, 24, 20 },  // 9
+    { 26, 18, 28, 24 },  // 10
+#if QR_MAX_VERSION > 10
+    { 30, 20, 24, 28 },  // 11
+    { 22, 24, 28, 26 },  // 12
+    { 22, 26, 22, 24 },  // 13
+    { 24, 30, 24, 20 },  // 14
+    { 24, 22, 24, 30 },  // 15
+    { 28, 24, 30, 24 },  // 16
+    { 28, 28, 28, 28 },  // 17
+    { 26, 30, 28, 28 },  // 18
+    { 26, 28, 26, 26 },  // 19
+    { 26, 28, 28, 30 },  // 20
+#endif
+#if QR_MAX_VERSION > 20
+    { 26, 28, 30, 28 },  // 21
+    { 28, 28, 24, 30 },  // 22
+    { 28, 30, 30, 30 },  // 23
+    { 28, 30, 30, 30 },  // 24
+    { 28, 26, 30, 30 },  // 25
+    { 28, 28, 30, 28 },  // 26
+    { 28, 30, 30, 30 },  // 27
+    { 28, 30, 30, 30 },  // 28
+    { 28, 30, 30, 30 },  // 29
+    { 28, 30, 30, 30 },  // 30
+#endif
+#if QR_MAX_VERSION > 30
+    { 28, 30, 30, 30 },  // 31
+    { 28, 30, 30, 30 },  // 32
+    { 28, 30, 30, 30 },  // 33
+    { 28, 30, 30, 30 },  // 34
+    { 28, 30, 30, 30 },  // 35
+    { 28, 30, 30, 30 },  // 36
+    { 28, 30, 30, 30 },  // 37
+    { 28, 30, 30, 30 },  // 38
+    { 28, 30, 30, 30 },  // 39
+    { 28, 30, 30, 30 },  // 40
+#endif
 };
 
-static const uint16_t NUM_RAW_DATA_MODULES[40] = {
-    //  1,   2,   3,   4,    5,    6,    7,    8,    9,   10,   11,   12,   13,   14,   15,   16,   17,
-      208, 359, 567, 807, 1079, 1383, 1568, 1936, 2336, 2768, 3232, 3728, 4256, 4651, 5243, 5867, 6523,
-    //   18,   19,   20,   21,    22,    23,    24,    25,   26,    27,     28,    29,    30,    31,
-       7211, 7931, 8683, 9252, 10068, 10916, 11796, 12708, 13652, 14628, 15371, 16411, 17483, 18587,
-    //    32,    33,    34,    35,    36,    37,    38,    39,    40
-       19723, 20891, 22091, 23008, 24272, 25568, 26896, 28256, 29648
+// The number of error correction blocks, by version and error correction format bits
+static const uint8_t NUM_ERROR_CORRECTION_BLOCKS[][4] PROGMEM = {
+    // Medium, Low, High, Quartile    Version
+    {  1,  1,  1,  1 },  // 1
+    {  1,  1,  1,  1 },  // 2
+    {  1,  1,  2,  2 },  // 3
+    {  2,  1,  4,  2 },  // 4
+    {  2,  1,  4,  4 },  // 5
+    {  4,  2,  4,  4 },  // 6
+    {  4,  2,  5,  6 },  // 7
+    {  4,  2,  6,  6 },  // 8
+    {  5,  2,  8,  8 },  // 9
+    {  5,  4,  8,  8 },  // 10
+#if QR_MAX_VERSION > 10
+    {  5,  4, 11,  8 },  // 11
+    {  8,  4, 11, 10 },  // 12
+    {  9,  4, 16, 12 },  // 13
+    {  9,  4, 16, 16 },  // 14
+    { 10,  6, 18, 12 },  // 15
+    { 10,  6, 16, 17 },  // 16
+    { 11,  6, 19, 16 },  // 17
+    { 13,  6, 21, 18 },  // 18
+    { 14,  7, 25, 21 },  // 19
+    { 16,  8, 25, 20 },  // 20
+#endif
+#if QR_MAX_VERSION > 20
+    { 17,  8, 25, 23 },  // 21
+    { 17,  9, 34, 23 },  // 22
+    { 18,  9, 30, 25 },  // 23
+    { 20, 10, 32, 27 },  // 24
+    { 21, 12, 35, 29 },  // 25
+    { 23, 12, 37, 34 },  // 26
+    { 25, 12, 40, 34 },  // 27
+    { 26, 13, 42, 35 },  // 28
+    { 28, 14, 45, 38 },  // 29
+    { 29, 15, 48, 40 },  // 30
+#endif
+#if QR_MAX_VERSION > 30
+    { 31, 16, 51, 43 },  // 31
+    { 33, 17, 54, 45 },  // 32
+    { 35, 18, 57, 48 },  // 33
+    { 37, 19, 60, 51 },  // 34
+    { 38, 19, 63, 53 },  // 35
+    { 40, 20, 66, 56 },  // 36
+    { 43, 21, 70, 59 },  // 37
+    { 45, 22, 74, 62 },  // 38
+    { 47, 24, 77, 65 },  // 39
+    { 49, 25, 81, 68 },  // 40
+#endif
 };
 
+// The number of data modules (codeword bits, including remainder bits) of a version; all
+// the modules, less the function patterns
+static uint16_t getNumRawDataModules(uint8_t version) {
+    uint16_t result = (16 * version + 128) * version + 64;
+    if (version >= 2) {
+        uint8_t alignCount = version / 7 + 2;
+        result -= (25 * alignCount - 10) * alignCount - 55;
+        if (version >= 7) { result -= 36; }
+    }
+    return result;
+}
+
 // @TODO: Put other LOCK_VERSIONS here
 #elif LOCK_VERSION == 3
 
@@ -83,6 +182,18 @@ static const uint16_t NUM_RAW_DATA_MODULES = 567;
 
 #endif
 
+// The number of data codewords of a version at an error correction level (format bits)
+static uint16_t getDataCapacity(uint8_t version, uint8_t ecc) {
+#if LOCK_VERSION == 0
+    uint8_t numBlocks = pgm_read_byte(&NUM_ERROR_CORRECTION_BLOCKS[version - 1][ecc]);
+    return getNumRawDataModules(version) / 8 - pgm_read_byte(&ECC_CODEWORDS_PER_BLOCK[version - 1][ecc]) * numBlocks;
+#else
+    return NUM_RAW_DATA_MODULES / 8 - NUM_ERROR_CORRECTION_CODEWORDS[ecc];
+#endif
+}
+
+
+#if !QR_FUNCTION_TABLES
 
 static int max(int a, int b) {
     if (a > b) { return a; }
@@ -96,6 +207,8 @@ static int abs(int value) {
 }
 */
 
+#endif
+
 
 #pragma mark - Mode testing and conversion
 
@@ -135,6 +248,18 @@ static bool isNumeric(const char *text, uint16_t length) {
     return true;
 }
 
+// The Alphanumeric characters past "0-9A-Z" (values 36 to 44)
+static const char ALPHANUMERIC_SYMBOLS[] PROGMEM = {
+    ' ', '$', '%', '*', '+', '-', '.', '/', ':'
+};
+
+// The Alphanumeric character of value (0 to 44); the reverse of getAlphanumeric
+static char getAlphanumericChar(uint8_t value) {
+    if (value <= 9) { return '0' + value; }
+    if (value <= 35) { return 'A' + (value - 10); }
+    return pgm_read_byte(&ALPHANUMERIC_SYMBOLS[value - 36]);
+}
+
 
 #pragma mark - Counting
 
@@ -148,11 +273,11 @@ static char getModeBits(uint8_t version, uint8_t mode) {
     // hex(int("".join(reversed([('00' + bin(x - 8)[2:])[-3:] for x in [10, 9, 8, 12, 11, 15, 14, 13, 15]])), 2))
     uint32_t modeInfo = 0x7bbb80a;
     
-#if LOCK_VERSION == 0 || LOCK_VERSION > 9
+#if (LOCK_VERSION == 0 && QR_MAX_VERSION > 9) || LOCK_VERSION > 9
     if (version > 9) { modeInfo >>= 9; }
 #endif
     
-#if LOCK_VERSION == 0 || LOCK_VERSION > 26
+#if (LOCK_VERSION == 0 && QR_MAX_VERSION > 26) || LOCK_VERSION > 26
     if (version > 26) { modeInfo >>= 9; }
 #endif
     
@@ -169,6 +294,10 @@ typedef struct BitBucket {
     uint32_t bitOffsetOrWidth;
     uint16_t capacityBytes;
     uint8_t *data;
+
+    // For grids, the rows held (a stripe holds only some of the rows; see qrcode_getStripe)
+    uint8_t top;
+    uint8_t rows;
 } BitBucket;
 
 /*
@@ -202,6 +331,19 @@ static void bb_initGrid(BitBucket *bitGrid, uint8_t *data, uint8_t size) {
     bitGrid->bitOffsetOrWidth = size;
     bitGrid->capacityBytes = bb_getGridSizeBytes(size);
     bitGrid->data = data;
+    bitGrid->top = 0;
+    bitGrid->rows = size;
+
+    memset(data, 0, bitGrid->capacityBytes);
+}
+
+// A grid holding only rows top through top + rows - 1; bits set outside them are dropped
+static void bb_initStripe(BitBucket *bitGrid, uint8_t *data, uint8_t size, uint8_t top, uint8_t rows) {
+    bitGrid->bitOffsetOrWidth = size;
+    bitGrid->capacityBytes = bb_getBufferSizeBytes(rows * size);
+    bitGrid->data = data;
+    bitGrid->top = top;
+    bitGrid->rows = rows;
 
     memset(data, 0, bitGrid->capacityBytes);
 }
@@ -221,7 +363,10 @@ void bb_setBits(BitBucket *bitBuffer, uint32_t val, int offset, uint8_t length)
 }
 */
 static void bb_setBit(BitBucket *bitGrid, uint8_t x, uint8_t y, bool on) {
-    uint32_t offset = y * bitGrid->bitOffsetOrWidth + x;
+    uint8_t row = y - bitGrid->top;
+    if (row >= bitGrid->rows) { return; }
+
+    uint32_t offset = row * bitGrid->bitOffsetOrWidth + x;
     uint8_t mask = 1 << (7 - (offset & 0x07));
     if (on) {
         bitGrid->data[offset >> 3] |= mask;
@@ -230,57 +375,256 @@ static void bb_setBit(BitBucket *bitGrid, uint8_t x, uint8_t y, bool on) {
     }
 }
 
-static void bb_invertBit(BitBucket *bitGrid, uint8_t x, uint8_t y, bool invert) {
-    uint32_t offset = y * bitGrid->bitOffsetOrWidth + x;
-    uint8_t mask = 1 << (7 - (offset & 0x07));
-    bool on = ((bitGrid->data[offset >> 3] & (1 << (7 - (offset & 0x07)))) != 0);
-    if (on ^ invert) {
-        bitGrid->data[offset >> 3] |= mask;
-    } else {
-        bitGrid->data[offset >> 3] &= ~mask;
+// With QR_FUNCTION_TABLES, the function module grid is read from flash (FUNCTION_MASK)
+#if QR_FUNCTION_TABLES
+#define bb_readFunctionByte(grid, index)    pgm_read_byte(&(grid)->data[index])
+#else
+#define bb_readFunctionByte(grid, index)    ((grid)->data[index])
+#endif
+
+static bool bb_isFunction(BitBucket *isFunction, uint8_t x, uint8_t y) {
+    uint32_t offset = y * isFunction->bitOffsetOrWidth + x;
+    return (bb_readFunctionByte(isFunction, offset >> 3) & (1 << (7 - (offset & 0x07)))) != 0;
+}
+
+
+#pragma mark - Drawing Patterns
+
+#if QR_FUNCTION_TABLES
+
+#if LOCK_VERSION != 3
+#error QR_FUNCTION_TABLES requires LOCK_VERSION 3
+#endif
+
+// The function patterns of version 3 (finders, separators, timing and alignment), as
+// drawn by drawFunctionPatterns (the format bits are redrawn for each QR code)
+static const uint8_t FUNCTION_MODULES[106] PROGMEM = {
+    0xfe, 0x00, 0x03, 0xfc, 0x14, 0x00, 0x10, 0x6e, 0x80, 0x00, 0xbb, 0x74, 0x00, 0x05, 0xdb, 0xa8,
+    0x00, 0x2e, 0xc1, 0x00, 0x01, 0x07, 0xfa, 0xaa, 0xaf, 0xe0, 0x00, 0x00, 0x00, 0xaa, 0x00, 0x00,
+    0x90, 0x00, 0x00, 0x00, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x20, 0x00, 0xf8, 0x00, 0x40, 0x04, 0x43,
+    0xf8, 0x00, 0x2a, 0x10, 0x40, 0x01, 0x10, 0xba, 0x80, 0x0f, 0x85, 0xd0, 0x00, 0x00, 0x2e, 0xa0,
+    0x00, 0x01, 0x04, 0x00, 0x00, 0x0f, 0xe8, 0x00, 0x00, 0x00,
+};
+
+// The function modules of version 3; the isFunction grid of drawFunctionPatterns
+static const uint8_t FUNCTION_MASK[106] PROGMEM = {
+    0xff, 0x80, 0x07, 0xff, 0xfc, 0x00, 0x3f, 0xff, 0xe0, 0x01, 0xff, 0xff, 0x00, 0x0f, 0xff, 0xf8,
+    0x00, 0x7f, 0xff, 0xc0, 0x03, 0xff, 0xff, 0xff, 0xff, 0xff, 0xf0, 0x00, 0xff, 0xff, 0x80, 0x07,
+    0xf8, 0x10, 0x00, 0x00, 0x00, 0x80, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x01,
+    0x00, 0x00, 0x00, 0x08, 0x00, 0x00, 0x00, 0x40, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x10, 0x00,
+    0x00, 0x00, 0x80, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x20, 0x00, 0xf8, 0x7f, 0xc0, 0x07, 0xc3,
+    0xfe, 0x00, 0x3e, 0x1f, 0xf0, 0x01, 0xf0, 0xff, 0x80, 0x0f, 0x87, 0xfc, 0x00, 0x00, 0x3f, 0xe0,
+    0x00, 0x01, 0xff, 0x00, 0x00, 0x0f, 0xf8, 0x00, 0x00, 0x00,
+};
+
+#endif
+
+#if QR_MASK_TABLES
+
+#if LOCK_VERSION != 3
+#error QR_MASK_TABLES requires LOCK_VERSION 3
+#endif
+
+// The modules each of the 8 mask patterns inverts for version 3, as computed by
+// getMaskPattern without QR_MASK_TABLES (the function modules do not depend on the
+// error correction level or data)
+static const uint8_t MASK_PATTERNS[8][106] PROGMEM = {
+    {
+        0x00, 0x2a, 0xa8, 0x00, 0x02, 0xaa, 0x80, 0x00, 0x0a, 0xaa, 0x00, 0x00, 0xaa, 0xa0, 0x00, 0x02,
+        0xaa, 0x80, 0x00, 0x2a, 0xa8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0a, 0xaa, 0x00, 0x00, 0x2a, 0xa8,
+        0x02, 0xaa, 0xaa, 0xaa, 0xaa, 0x2a, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x8a, 0xaa, 0xaa, 0xaa,
+        0xaa, 0xaa, 0xaa, 0xa2, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xa8, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa,
+        0xaa, 0xaa, 0x2a, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0xaa, 0x8a, 0xaa, 0x02, 0x80, 0x2a, 0xa8, 0x28,
+        0x00, 0xaa, 0x80, 0xa0, 0x0a, 0xaa, 0x0a, 0x00, 0x2a, 0xa0, 0x28, 0x02, 0xaa, 0xaa, 0x80, 0x0a,
+        0xaa, 0xaa, 0x00, 0xaa, 0xaa, 0xa0, 0x02, 0xaa, 0xaa, 0x80,
+    },
+    {
+        0x00, 0x7f, 0xf8, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1f, 0xfe, 0x00, 0x00, 0x00, 0x00, 0x00, 0x07,
+        0xff, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x7f, 0xf8,
+        0x00, 0x00, 0x00, 0x00, 0x3f, 0x7f, 0xff, 0xfe, 0x00, 0x00, 0x00, 0x0f, 0xdf, 0xff, 0xff, 0x80,
+        0x00, 0x00, 0x03, 0xf7, 0xff, 0xff, 0xe0, 0x00, 0x00, 0x00, 0xfd, 0xff, 0xff, 0xf8, 0x00, 0x00,
+        0x00, 0x3f, 0x7f, 0xff, 0xfe, 0x00, 0x00, 0x00, 0x0f, 0xdf, 0xff, 0x07, 0x80, 0x00, 0x00, 0x00,
+        0x01, 0xff, 0xc1, 0xe0, 0x00, 0x00, 0x00, 0x00, 0x7f, 0xf0, 0x78, 0x00, 0x00, 0x00, 0x00, 0x1f,
+        0xff, 0xfe, 0x00, 0x00, 0x00, 0x00, 0x07, 0xff, 0xff, 0x80,
+    },
+    {
+        0x00, 0x49, 0x20, 0x00, 0x02, 0x49, 0x00, 0x00, 0x12, 0x48, 0x00, 0x00, 0x92, 0x40, 0x00, 0x04,
+        0x92, 0x00, 0x00, 0x24, 0x90, 0x00, 0x00, 0x00, 0x00, 0x00, 0x09, 0x24, 0x00, 0x00, 0x49, 0x20,
+        0x04, 0x82, 0x49, 0x24, 0xa4, 0x12, 0x49, 0x25, 0x20, 0x92, 0x49, 0x29, 0x04, 0x92, 0x49, 0x48,
+        0x24, 0x92, 0x4a, 0x41, 0x24, 0x92, 0x52, 0x09, 0x24, 0x92, 0x90, 0x49, 0x24, 0x94, 0x82, 0x49,
+        0x24, 0xa4, 0x12, 0x49, 0x25, 0x20, 0x92, 0x49, 0x29, 0x04, 0x92, 0x01, 0x00, 0x24, 0x90, 0x08,
+        0x01, 0x24, 0x80, 0x40, 0x09, 0x24, 0x02, 0x00, 0x49, 0x20, 0x10, 0x02, 0x49, 0x24, 0x80, 0x12,
+        0x49, 0x24, 0x00, 0x92, 0x49, 0x20, 0x04, 0x92, 0x49, 0x00,
+    },
+    {
+        0x00, 0x49, 0x20, 0x00, 0x00, 0x92, 0x40, 0x00, 0x09, 0x24, 0x00, 0x00, 0x92, 0x40, 0x00, 0x01,
+        0x24, 0x80, 0x00, 0x12, 0x48, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x49, 0x00, 0x00, 0x24, 0x90,
+        0x04, 0x82, 0x49, 0x24, 0x89, 0x24, 0x92, 0x48, 0x92, 0x49, 0x24, 0x99, 0x04, 0x92, 0x49, 0x12,
+        0x49, 0x24, 0x91, 0x24, 0x92, 0x49, 0x32, 0x09, 0x24, 0x92, 0x24, 0x92, 0x49, 0x22, 0x49, 0x24,
+        0x92, 0x64, 0x12, 0x49, 0x24, 0x49, 0x24, 0x92, 0x44, 0x92, 0x49, 0x04, 0x80, 0x24, 0x90, 0x08,
+        0x00, 0x49, 0x00, 0x80, 0x04, 0x92, 0x09, 0x00, 0x49, 0x20, 0x10, 0x00, 0x92, 0x49, 0x00, 0x09,
+        0x24, 0x92, 0x00, 0x92, 0x49, 0x20, 0x01, 0x24, 0x92, 0x00,
+    },
+    {
+        0x00, 0x0e, 0x38, 0x00, 0x00, 0x71, 0xc0, 0x00, 0x1c, 0x70, 0x00, 0x00, 0xe3, 0x80, 0x00, 0x00,
+        0xe3, 0x80, 0x00, 0x07, 0x1c, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0e, 0x38, 0x00, 0x00, 0x0e, 0x38,
+        0x07, 0x0c, 0x71, 0xc7, 0x07, 0x1c, 0x71, 0xc6, 0x38, 0xe3, 0x8e, 0x3e, 0x18, 0xe3, 0x8e, 0x70,
+        0xc7, 0x1c, 0x70, 0x71, 0xc7, 0x1c, 0x63, 0x8e, 0x38, 0xe3, 0xe1, 0x8e, 0x38, 0xe7, 0x0c, 0x71,
+        0xc7, 0x07, 0x1c, 0x71, 0xc6, 0x38, 0xe3, 0x8e, 0x3e, 0x18, 0xe3, 0x06, 0x00, 0x07, 0x18, 0x30,
+        0x01, 0xc7, 0x00, 0x60, 0x0e, 0x38, 0x03, 0x00, 0x0e, 0x30, 0x60, 0x00, 0x71, 0xc7, 0x00, 0x1c,
+        0x71, 0xc6, 0x00, 0xe3, 0x8e, 0x30, 0x00, 0xe3, 0x8e, 0x00,
+    },
+    {
+        0x00, 0x7f, 0xf8, 0x00, 0x00, 0x41, 0x00, 0x00, 0x12, 0x48, 0x00, 0x00, 0x55, 0x50, 0x00, 0x04,
+        0x92, 0x00, 0x00, 0x04, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x04, 0x00, 0x00, 0x49, 0x20,
+        0x05, 0x45, 0x55, 0x55, 0x64, 0x12, 0x49, 0x25, 0x00, 0x10, 0x41, 0x0f, 0xdf, 0xff, 0xff, 0xc0,
+        0x04, 0x10, 0x42, 0x41, 0x24, 0x92, 0x55, 0x15, 0x55, 0x55, 0x90, 0x49, 0x24, 0x94, 0x00, 0x41,
+        0x04, 0x3f, 0x7f, 0xff, 0xff, 0x00, 0x10, 0x41, 0x09, 0x04, 0x92, 0x01, 0x00, 0x15, 0x50, 0x14,
+        0x01, 0x24, 0x80, 0x40, 0x01, 0x04, 0x00, 0x00, 0x7f, 0xf0, 0x78, 0x00, 0x41, 0x04, 0x00, 0x12,
+        0x49, 0x24, 0x00, 0x55, 0x55, 0x50, 0x04, 0x92, 0x49, 0x00,
+    },
+    {
+        0x00, 0x7f, 0xf8, 0x00, 0x00, 0x71, 0xc0, 0x00, 0x1b, 0x6c, 0x00, 0x00, 0x55, 0x50, 0x00, 0x05,
+        0xb6, 0x80, 0x00, 0x1c, 0x70, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0xc7, 0x00, 0x00, 0x6d, 0xb0,
+        0x05, 0x45, 0x55, 0x55, 0x6d, 0x36, 0xdb, 0x6d, 0x18, 0x71, 0xc7, 0x1f, 0xdf, 0xff, 0xff, 0xf0,
+        0xc7, 0x1c, 0x73, 0x65, 0xb6, 0xdb, 0x75, 0x15, 0x55, 0x55, 0xb4, 0xdb, 0x6d, 0xb4, 0x61, 0xc7,
+        0x1c, 0x7f, 0x7f, 0xff, 0xff, 0xc3, 0x1c, 0x71, 0xcd, 0x96, 0xdb, 0x05, 0x80, 0x15, 0x50, 0x14,
+        0x01, 0x6d, 0x80, 0xc0, 0x07, 0x1c, 0x01, 0x00, 0x7f, 0xf0, 0x78, 0x00, 0x71, 0xc7, 0x00, 0x1b,
+        0x6d, 0xb6, 0x00, 0x55, 0x55, 0x50, 0x05, 0xb6, 0xdb, 0x00,
+    },
+    {
+        0x00, 0x2a, 0xa8, 0x00, 0x03, 0x8e, 0x00, 0x00, 0x0e, 0x38, 0x00, 0x00, 0xaa, 0xa0, 0x00, 0x00,
+        0xe3, 0x80, 0x00, 0x23, 0x8c, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0e, 0x38, 0x00, 0x00, 0x38, 0xe0,
+        0x02, 0xaa, 0xaa, 0xaa, 0xb8, 0x63, 0x8e, 0x38, 0xe3, 0x8e, 0x38, 0xea, 0x8a, 0xaa, 0xaa, 0x8e,
+        0x38, 0xe3, 0x8e, 0x30, 0xe3, 0x8e, 0x2a, 0xaa, 0xaa, 0xaa, 0xe1, 0x8e, 0x38, 0xe3, 0x8e, 0x38,
+        0xe3, 0xaa, 0x2a, 0xaa, 0xaa, 0x38, 0xe3, 0x8e, 0x38, 0xc3, 0x8e, 0x00, 0x80, 0x2a, 0xa8, 0x28,
+        0x00, 0x38, 0xc1, 0x80, 0x08, 0xe2, 0x0e, 0x00, 0x2a, 0xa0, 0x28, 0x03, 0x8e, 0x38, 0xc0, 0x0e,
+        0x38, 0xe2, 0x00, 0xaa, 0xaa, 0xa0, 0x00, 0xe3, 0x8e, 0x00,
+    },
+};
+
+#else
+// Whether the mask formula holds at (x, y), given the remainders x3 (x % 3) and y3 (y % 3)
+// and xThirds (x / 3), which are tracked by the caller, as division is slow on AVR
+static bool isMasked(uint8_t mask, uint8_t x, uint8_t y, uint8_t x3, uint8_t y3, uint8_t xThirds) {
+    uint8_t sum3 = x3 + y3;
+    if (sum3 >= 3) { sum3 -= 3; }
+
+    uint8_t product3 = x3 * y3;
+    if (product3 >= 3) { product3 -= 3; }
+
+    uint8_t product2 = x & y & 1;
+
+    switch (mask) {
+        case 0:  return ((x + y) & 1) == 0;
+        case 1:  return (y & 1) == 0;
+        case 2:  return x3 == 0;
+        case 3:  return sum3 == 0;
+        case 4:  return ((xThirds + (y >> 1)) & 1) == 0;
+        case 5:  return product2 + product3 == 0;
+        case 6:  return ((product2 + product3) & 1) == 0;
+        case 7:  return ((((x + y) & 1) + product3) & 1) == 0;
     }
+    return false;
 }
 
-static bool bb_getBit(BitBucket *bitGrid, uint8_t x, uint8_t y) {
-    uint32_t offset = y * bitGrid->bitOffsetOrWidth + x;
-    return (bitGrid->data[offset >> 3] & (1 << (7 - (offset & 0x07)))) != 0;
+#endif
+// Computes the modules the given mask pattern inverts; every data module (those that are
+// not function modules) where the mask formula holds, packed the same as the grid. With
+// QR_MASK_TABLES, these are read from flash instead and pattern is not used.
+static const uint8_t* getMaskPattern(BitBucket *isFunction, uint8_t mask, uint8_t *pattern) {
+#if QR_MASK_TABLES
+    return MASK_PATTERNS[mask];
+#else
+    uint8_t size = isFunction->bitOffsetOrWidth;
+
+    memset(pattern, 0, isFunction->capacityBytes);
+
+    uint16_t offset = 0;
+    for (uint8_t y = 0, y3 = 0; y < size; y++) {
+        for (uint8_t x = 0, x3 = 0, xThirds = 0; x < size; x++, offset++) {
+            uint8_t bit = 0x80 >> (offset & 0x07);
+            if (!(bb_readFunctionByte(isFunction, offset >> 3) & bit) && isMasked(mask, x, y, x3, y3, xThirds)) {
+                pattern[offset >> 3] |= bit;
+            }
+
+            if (++x3 == 3) { x3 = 0; xThirds++; }
+        }
+
+        if (++y3 == 3) { y3 = 0; }
+    }
+
+    return pattern;
+#endif
 }
 
+// With QR_MASK_TABLES, the mask patterns are read from flash
+#if QR_MASK_TABLES
+#define readMaskByte(pattern, index)    pgm_read_byte(&(pattern)[index])
+#else
+#define readMaskByte(pattern, index)    ((pattern)[index])
+#endif
+
+// XORs the data modules in this QR Code with the given mask pattern (see getMaskPattern).
+// Due to XOR's mathematical properties, applying the same mask twice is equivalent to no
+// change at all. This means it is possible to apply a mask, undo it, and try another mask.
+// Note that a final well-formed QR Code symbol needs exactly one mask applied (not zero,
+// not two, etc.). Only the rows of a stripe are masked.
+static void applyMask(BitBucket *modules, const uint8_t *pattern) {
+    uint8_t *data = modules->data;
+    uint16_t offset = modules->top * modules->bitOffsetOrWidth;
+
+    // A stripe that starts mid-byte of the pattern is masked a bit at a time
+    if (offset & 0x07) {
+        uint16_t count = modules->rows * modules->bitOffsetOrWidth;
+        for (uint16_t i = 0; i < count; i++, offset++) {
+            if (readMaskByte(pattern, offset >> 3) & (0x80 >> (offset & 0x07))) {
+                data[i >> 3] ^= 0x80 >> (i & 0x07);
+            }
+        }
+        return;
+    }
 
-#pragma mark - Drawing Patterns
+    pattern += offset >> 3;
+    for (uint16_t i = 0; i < modules->capacityBytes; i++) {
+        data[i] ^= readMaskByte(pattern, i);
+    }
+}
 
-// XORs the data modules in this QR Code with the given mask pattern. Due to XOR's mathematical
-// properties, calling applyMask(m) twice with the same value is equivalent to no change at all.
-// This means it is possible to apply a mask, undo it, and try another mask. Note that a final
-// well-formed QR Code symbol needs exactly one mask applied (not zero, not two, etc.).
-static void applyMask(BitBucket *modules, BitBucket *isFunction, uint8_t mask) {
+#if QR_FUNCTION_TABLES && !QR_MASK_TABLES
+// XORs the data modules in the rows of a stripe with the mask formula, module by module,
+// so that a stripe never needs a full mask pattern (see getMaskPattern)
+static void applyStripeMask(BitBucket *modules, BitBucket *isFunction, uint8_t mask) {
     uint8_t size = modules->bitOffsetOrWidth;
-    
-    for (uint8_t y = 0; y < size; y++) {
-        for (uint8_t x = 0; x < size; x++) {
-            if (bb_getBit(isFunction, x, y)) { continue; }
-            
-            bool invert = 0;
-            switch (mask) {
-                case 0:  invert = (x + y) % 2 == 0;                    break;
-                case 1:  invert = y % 2 == 0;                          break;
-                case 2:  invert = x % 3 == 0;                          break;
-                case 3:  invert = (x + y) % 3 == 0;                    break;
-                case 4:  invert = (x / 3 + y / 2) % 2 == 0;            break;
-                case 5:  invert = x * y % 2 + x * y % 3 == 0;          break;
-                case 6:  invert = (x * y % 2 + x * y % 3) % 2 == 0;    break;
-                case 7:  invert = ((x + y) % 2 + x * y % 3) % 2 == 0;  break;
+    uint8_t top = modules->top;
+
+    uint16_t offset = top * size;
+    uint16_t i = 0;
+    for (uint8_t y = top, y3 = top % 3; y < top + modules->rows; y++) {
+        for (uint8_t x = 0, x3 = 0, xThirds = 0; x < size; x++, offset++, i++) {
+            if (!(bb_readFunctionByte(isFunction, offset >> 3) & (0x80 >> (offset & 0x07))) && isMasked(mask, x, y, x3, y3, xThirds)) {
+                modules->data[i >> 3] ^= 0x80 >> (i & 0x07);
             }
-            bb_invertBit(modules, x, y, invert);
+
+            if (++x3 == 3) { x3 = 0; xThirds++; }
         }
+
+        if (++y3 == 3) { y3 = 0; }
     }
 }
+#endif
 
 static void setFunctionModule(BitBucket *modules, BitBucket *isFunction, uint8_t x, uint8_t y, bool on) {
     bb_setBit(modules, x, y, on);
+#if !QR_FUNCTION_TABLES
     bb_setBit(isFunction, x, y, true);
+#endif
 }
 
+#if !QR_FUNCTION_TABLES
+
 // Draws a 9*9 finder pattern including the border separator, with the center module at (x, y).
 static void drawFinderPattern(BitBucket *modules, BitBucket *isFunction, uint8_t x, uint8_t y) {
     uint8_t size = modules->bitOffsetOrWidth;
@@ -305,6 +649,8 @@ static void drawAlignmentPattern(BitBucket *modules, BitBucket *isFunction, uint
     }
 }
 
+#endif
+
 // Draws two copies of the format bits (with its own error correction code)
 // based on the given mask and this object's error correction level field.
 static void drawFormatBits(BitBucket *modules, BitBucket *isFunction, uint8_t ecc, uint8_t mask) {
@@ -347,6 +693,8 @@ static void drawFormatBits(BitBucket *modules, BitBucket *isFunction, uint8_t ec
 }
 
 
+#if !QR_FUNCTION_TABLES
+
 // Draws two copies of the version bits (with its own error correction code),
 // based on this object's version field (which only has an effect for 7 <= version <= 40).
 static void drawVersion(BitBucket *modules, BitBucket *isFunction, uint8_t version) {
@@ -435,6 +783,8 @@ static void drawFunctionPatterns(BitBucket *modules, BitBucket *isFunction, uint
     drawVersion(modules, isFunction, version);
 }
 
+#endif
+
 
 // Draws the given sequence of 8-bit codewords (data and error correction) onto the entire
 // data area of this QR Code symbol. Function modules need to be marked off before this is called.
@@ -457,7 +807,7 @@ static void drawCodewords(BitBucket *modules, BitBucket *isFunction, BitBucket *
                 uint8_t x = right - j;  // Actual x coordinate
                 bool upwards = ((right & 2) == 0) ^ (x < 6);
                 uint8_t y = upwards ? size - 1 - vert : vert;  // Actual y coordinate
-                if (!bb_getBit(isFunction, x, y) && i < bitLength) {
+                if (!bb_isFunction(isFunction, x, y) && i < bitLength) {
                     bb_setBit(modules, x, y, ((data[i >> 3] >> (7 - (i & 7))) & 1) != 0);
                     i++;
                 }
@@ -477,87 +827,135 @@ static void drawCodewords(BitBucket *modules, BitBucket *isFunction, BitBucket *
 #define PENALTY_N3     40
 #define PENALTY_N4     10
 
-// Calculates and returns the penalty score based on state of this QR Code's current modules.
-// This is used by the automatic mask choice algorithm to find the mask pattern that yields the lowest score.
-// @TODO: This can be optimized by working with the bytes instead of bits.
-static uint32_t getPenaltyScore(BitBucket *modules) {
-    uint32_t result = 0;
-    
+// The number of set bits in a byte
+static uint8_t popcount(uint8_t value) {
+    value = value - ((value >> 1) & 0x55);
+    value = (value & 0x33) + ((value >> 2) & 0x33);
+    return (value + (value >> 4)) & 0x0f;
+}
+
+// Copies row y of the grid into row, packed MSB first (the same as the grid) but
+// starting on a byte boundary; any bits past the end of the row are cleared
+static void getRow(BitBucket *modules, uint8_t y, uint8_t *row) {
     uint8_t size = modules->bitOffsetOrWidth;
-    
-    // Adjacent modules in row having same color
-    for (uint8_t y = 0; y < size; y++) {
-        
-        bool colorX = bb_getBit(modules, 0, y);
-        for (uint8_t x = 1, runX = 1; x < size; x++) {
-            bool cx = bb_getBit(modules, x, y);
-            if (cx != colorX) {
-                colorX = cx;
-                runX = 1;
-                
-            } else {
-                runX++;
-                if (runX == 5) {
-                    result += PENALTY_N1;
-                } else if (runX > 5) {
-                    result++;
-                }
-            }
-        }
+    uint16_t offset = y * size;
+    uint16_t last = offset + size - 1;
+    uint8_t shift = offset & 0x07;
+
+    for (uint8_t x = 0; x < size; x += 8, offset += 8) {
+        uint16_t word = modules->data[offset >> 3] << 8;
+        if ((offset >> 3) < (last >> 3)) { word |= modules->data[(offset >> 3) + 1]; }
+        *row++ = word >> (8 - shift);
     }
-    
-    // Adjacent modules in column having same color
-    for (uint8_t x = 0; x < size; x++) {
-        bool colorY = bb_getBit(modules, x, 0);
-        for (uint8_t y = 1, runY = 1; y < size; y++) {
-            bool cy = bb_getBit(modules, x, y);
-            if (cy != colorY) {
-                colorY = cy;
-                runY = 1;
-            } else {
-                runY++;
-                if (runY == 5) {
-                    result += PENALTY_N1;
-                } else if (runY > 5) {
-                    result++;
-                }
+
+    if (size & 0x07) { row[-1] &= 0xff << (8 - (size & 0x07)); }
+}
+
+// Calculates the penalty of the runs and finder-like patterns along a line (a row or
+// column) of modules, packed MSB first. Each byte is scored at once, with the modules
+// before it shifted in above it; bit 7 - j of the low byte is module x + j and bit
+// 8 + k is the module k + 1 before module x.
+static uint32_t getLinePenalty(const uint8_t *line, uint8_t size) {
+    uint32_t result = 0;
+
+    // Pretend the module before the line differs from the first, so the first run
+    // starts at the edge (the patterns never look that far back)
+    uint32_t bits = (line[0] & 0x80) ? 0: 0xffff;
+
+    for (uint8_t x = 0; x < size; x += 8) {
+        bits = (bits << 8) | *line++;
+
+        // The modules in the line, and those with 4 and 10 modules before them
+        uint8_t valid = 0xff;
+        if (size - x < 8) { valid <<= 8 - (size - x); }
+        uint8_t validRun = valid, validFinder = valid;
+        if (x == 0) {
+            validRun &= 0x0f;
+            validFinder = 0;
+        } else if (x == 8) {
+            validFinder &= 0x3f;
+        }
+
+        // Modules the same color as the module before them
+        uint32_t same = ~(bits ^ (bits >> 1));
+
+        // Modules ending 5 (or more) in a row having the same color; the first of each
+        // run scores PENALTY_N1 and each additional module scores 1
+        uint8_t run = same & (same >> 1) & (same >> 2) & (same >> 3) & validRun;
+        uint8_t runStart = run & ~(same >> 4);
+        result += popcount(run) + (PENALTY_N1 - 1) * popcount(runStart);
+
+        // Finder-like patterns ending at each module
+        uint32_t window = bits;
+        for (uint8_t mask = 0x01; mask; mask <<= 1, window >>= 1) {
+            if (!(validFinder & mask)) { continue; }
+            uint16_t pattern = window & 0x7ff;
+            if (pattern == 0x05D || pattern == 0x5D0) {
+                result += PENALTY_N3;
             }
         }
     }
+
+    return result;
+}
+
+// Calculates and returns the penalty score based on state of this QR Code's current modules.
+// This is used by the automatic mask choice algorithm to find the mask pattern that yields the lowest score.
+// Rows are scored a byte at a time as they are copied out of the grid, and packed into
+// the columns, which are then scored the same way.
+static uint32_t getPenaltyScore(BitBucket *modules) {
+    uint32_t result = 0;
     
+    uint8_t size = modules->bitOffsetOrWidth;
+    uint8_t lineBytes = (size + 7) / 8;
+
+    uint8_t row[lineBytes], lastRow[lineBytes];
+
+    uint8_t columns[size * lineBytes];
+    memset(columns, 0, sizeof(columns));
+
     uint16_t black = 0;
     for (uint8_t y = 0; y < size; y++) {
-        uint16_t bitsRow = 0, bitsCol = 0;
-        for (uint8_t x = 0; x < size; x++) {
-            bool color = bb_getBit(modules, x, y);
-
-            // 2*2 blocks of modules having same color
-            if (x > 0 && y > 0) {
-                bool colorUL = bb_getBit(modules, x - 1, y - 1);
-                bool colorUR = bb_getBit(modules, x, y - 1);
-                bool colorL = bb_getBit(modules, x - 1, y);
-                if (color == colorUL && color == colorUR && color == colorL) {
-                    result += PENALTY_N2;
-                }
-            }
+        getRow(modules, y, row);
 
-            // Finder-like pattern in rows and columns
-            bitsRow = ((bitsRow << 1) & 0x7FF) | color;
-            bitsCol = ((bitsCol << 1) & 0x7FF) | bb_getBit(modules, y, x);
+        // Adjacent modules in row having same color, and finder-like patterns
+        result += getLinePenalty(row, size);
 
-            // Needs 11 bits accumulated
-            if (x >= 10) {
-                if (bitsRow == 0x05D || bitsRow == 0x5D0) {
-                    result += PENALTY_N3;
-                }
-                if (bitsCol == 0x05D || bitsCol == 0x5D0) {
-                    result += PENALTY_N3;
-                }
+        // 2*2 blocks of modules having same color (bit 0 of the word before is the module
+        // to the left of this byte)
+        if (y > 0) {
+            uint16_t current = 0, above = 0;
+            for (uint8_t i = 0; i < lineBytes; i++) {
+                current = (current << 8) | row[i];
+                above = (above << 8) | lastRow[i];
+
+                uint16_t sameAbove = ~(current ^ above);
+                uint8_t block = sameAbove & (sameAbove >> 1) & ~(current ^ (current >> 1));
+                if (i == 0) { block &= 0x7f; }
+                if (i == lineBytes - 1 && (size & 0x07)) { block &= 0xff << (8 - (size & 0x07)); }
+
+                result += PENALTY_N2 * popcount(block);
             }
+        }
+
+        // Balance of black and white modules, and pack the modules into the columns
+        uint8_t *column = columns;
+        uint8_t columnBit = 0x80 >> (y & 0x07);
+        for (uint8_t i = 0, x = 0; i < lineBytes; i++) {
+            uint8_t value = row[i];
+            black += popcount(value);
 
-            // Balance of black and white modules
-            if (color) { black++; }
+            for (uint8_t mask = 0x80; mask && x < size; mask >>= 1, x++, column += lineBytes) {
+                if (value & mask) { column[y >> 3] |= columnBit; }
+            }
         }
+
+        memcpy(lastRow, row, lineBytes);
+    }
+
+    // Adjacent modules in column having same color, and finder-like patterns
+    for (uint8_t x = 0; x < size; x++) {
+        result += getLinePenalty(&columns[x * lineBytes], size);
     }
 
     // Find smallest k such that (45-5k)% <= dark/total <= (55+5k)%
@@ -572,7 +970,66 @@ static uint32_t getPenaltyScore(BitBucket *modules) {
 
 #pragma mark - Reed-Solomon Generator
 
-static uint8_t rs_multiply(uint8_t x, uint8_t y) {
+#if RS_LOG_TABLES
+
+// The powers of the generator 0x02 in GF(2^8/0x11D); RS_EXP[i] = 2^i (2^255 = 2^0)
+static const uint8_t RS_EXP[256] PROGMEM = {
+    0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1d, 0x3a, 0x74, 0xe8, 0xcd, 0x87, 0x13, 0x26,
+    0x4c, 0x98, 0x2d, 0x5a, 0xb4, 0x75, 0xea, 0xc9, 0x8f, 0x03, 0x06, 0x0c, 0x18, 0x30, 0x60, 0xc0,
+    0x9d, 0x27, 0x4e, 0x9c, 0x25, 0x4a, 0x94, 0x35, 0x6a, 0xd4, 0xb5, 0x77, 0xee, 0xc1, 0x9f, 0x23,
+    0x46, 0x8c, 0x05, 0x0a, 0x14, 0x28, 0x50, 0xa0, 0x5d, 0xba, 0x69, 0xd2, 0xb9, 0x6f, 0xde, 0xa1,
+    0x5f, 0xbe, 0x61, 0xc2, 0x99, 0x2f, 0x5e, 0xbc, 0x65, 0xca, 0x89, 0x0f, 0x1e, 0x3c, 0x78, 0xf0,
+    0xfd, 0xe7, 0xd3, 0xbb, 0x6b, 0xd6, 0xb1, 0x7f, 0xfe, 0xe1, 0xdf, 0xa3, 0x5b, 0xb6, 0x71, 0xe2,
+    0xd9, 0xaf, 0x43, 0x86, 0x11, 0x22, 0x44, 0x88, 0x0d, 0x1a, 0x34, 0x68, 0xd0, 0xbd, 0x67, 0xce,
+    0x81, 0x1f, 0x3e, 0x7c, 0xf8, 0xed, 0xc7, 0x93, 0x3b, 0x76, 0xec, 0xc5, 0x97, 0x33, 0x66, 0xcc,
+    0x85, 0x17, 0x2e, 0x5c, 0xb8, 0x6d, 0xda, 0xa9, 0x4f, 0x9e, 0x21, 0x42, 0x84, 0x15, 0x2a, 0x54,
+    0xa8, 0x4d, 0x9a, 0x29, 0x52, 0xa4, 0x55, 0xaa, 0x49, 0x92, 0x39, 0x72, 0xe4, 0xd5, 0xb7, 0x73,
+    0xe6, 0xd1, 0xbf, 0x63, 0xc6, 0x91, 0x3f, 0x7e, 0xfc, 0xe5, 0xd7, 0xb3, 0x7b, 0xf6, 0xf1, 0xff,
+    0xe3, 0xdb, 0xab, 0x4b, 0x96, 0x31, 0x62, 0xc4, 0x95, 0x37, 0x6e, 0xdc, 0xa5, 0x57, 0xae, 0x41,
+    0x82, 0x19, 0x32, 0x64, 0xc8, 0x8d, 0x07, 0x0e, 0x1c, 0x38, 0x70, 0xe0, 0xdd, 0xa7, 0x53, 0xa6,
+    0x51, 0xa2, 0x59, 0xb2, 0x79, 0xf2, 0xf9, 0xef, 0xc3, 0x9b, 0x2b, 0x56, 0xac, 0x45, 0x8a, 0x09,
+    0x12, 0x24, 0x48, 0x90, 0x3d, 0x7a, 0xf4, 0xf5, 0xf7, 0xf3, 0xfb, 0xeb, 0xcb, 0x8b, 0x0b, 0x16,
+    0x2c, 0x58, 0xb0, 0x7d, 0xfa, 0xe9, 0xcf, 0x83, 0x1b, 0x36, 0x6c, 0xd8, 0xad, 0x47, 0x8e, 0x01,
+};
+
+// The discrete logarithms; RS_LOG[2^i] = i (RS_LOG[0] is undefined)
+static const uint8_t RS_LOG[256] PROGMEM = {
+    0x00, 0x00, 0x01, 0x19, 0x02, 0x32, 0x1a, 0xc6, 0x03, 0xdf, 0x33, 0xee, 0x1b, 0x68, 0xc7, 0x4b,
+    0x04, 0x64, 0xe0, 0x0e, 0x34, 0x8d, 0xef, 0x81, 0x1c, 0xc1, 0x69, 0xf8, 0xc8, 0x08, 0x4c, 0x71,
+    0x05, 0x8a, 0x65, 0x2f, 0xe1, 0x24, 0x0f, 0x21, 0x35, 0x93, 0x8e, 0xda, 0xf0, 0x12, 0x82, 0x45,
+    0x1d, 0xb5, 0xc2, 0x7d, 0x6a, 0x27, 0xf9, 0xb9, 0xc9, 0x9a, 0x09, 0x78, 0x4d, 0xe4, 0x72, 0xa6,
+    0x06, 0xbf, 0x8b, 0x62, 0x66, 0xdd, 0x30, 0xfd, 0xe2, 0x98, 0x25, 0xb3, 0x10, 0x91, 0x22, 0x88,
+    0x36, 0xd0, 0x94, 0xce, 0x8f, 0x96, 0xdb, 0xbd, 0xf1, 0xd2, 0x13, 0x5c, 0x83, 0x38, 0x46, 0x40,
+    0x1e, 0x42, 0xb6, 0xa3, 0xc3, 0x48, 0x7e, 0x6e, 0x6b, 0x3a, 0x28, 0x54, 0xfa, 0x85, 0xba, 0x3d,
+    0xca, 0x5e, 0x9b, 0x9f, 0x0a, 0x15, 0x79, 0x2b, 0x4e, 0xd4, 0xe5, 0xac, 0x73, 0xf3, 0xa7, 0x57,
+    0x07, 0x70, 0xc0, 0xf7, 0x8c, 0x80, 0x63, 0x0d, 0x67, 0x4a, 0xde, 0xed, 0x31, 0xc5, 0xfe, 0x18,
+    0xe3, 0xa5, 0x99, 0x77, 0x26, 0xb8, 0xb4, 0x7c, 0x11, 0x44, 0x92, 0xd9, 0x23, 0x20, 0x89, 0x2e,
+    0x37, 0x3f, 0xd1, 0x5b, 0x95, 0xbc, 0xcf, 0xcd, 0x90, 0x87, 0x97, 0xb2, 0xdc, 0xfc, 0xbe, 0x61,
+    0xf2, 0x56, 0xd3, 0xab, 0x14, 0x2a, 0x5d, 0x9e, 0x84, 0x3c, 0x39, 0x53, 0x47, 0x6d, 0x41, 0xa2,
+    0x1f, 0x2d, 0x43, 0xd8, 0xb7, 0x7b, 0xa4, 0x76, 0xc4, 0x17, 0x49, 0xec, 0x7f, 0x0c, 0x6f, 0xf6,
+    0x6c, 0xa1, 0x3b, 0x52, 0x29, 0x9d, 0x55, 0xaa, 0xfb, 0x60, 0x86, 0xb1, 0xbb, 0xcc, 0x3e, 0x5a,
+    0xcb, 0x59, 0x5f, 0xb0, 0x9c, 0xa9, 0xa0, 0x51, 0x0b, 0xf5, 0x16, 0xeb, 0x7a, 0x75, 0x2c, 0xd7,
+    0x4f, 0xae, 0xd5, 0xe9, 0xe6, 0xe7, 0xad, 0xe8, 0x74, 0xd6, 0xf4, 0xea, 0xa8, 0x50, 0x58, 0xaf,
+};
+
+// Returns 2^power, for a power up to 508 (the sum of two logarithms)
+static uint8_t rs_exp(uint16_t power) {
+    if (power >= 255) { power -= 255; }
+    return pgm_read_byte(&RS_EXP[power]);
+}
+
+uint8_t rs_multiply(uint8_t x, uint8_t y) {
+    if (x == 0 || y == 0) { return 0; }
+    return rs_exp(pgm_read_byte(&RS_LOG[x]) + pgm_read_byte(&RS_LOG[y]));
+}
+
+uint8_t rs_inverse(uint8_t x) {
+    return pgm_read_byte(&RS_EXP[255 - pgm_read_byte(&RS_LOG[x])]);
+}
+
+#else
+
+uint8_t rs_multiply(uint8_t x, uint8_t y) {
     // Russian peasant multiplication
     // See: https://en.wikipedia.org/wiki/Ancient_Egyptian_multiplication
     uint16_t z = 0;
@@ -583,7 +1040,107 @@ static uint8_t rs_multiply(uint8_t x, uint8_t y) {
     return z;
 }
 
-static void rs_init(uint8_t degree, uint8_t *coeff) {
+// Computes x^254 == x^-1 (by square-and-multiply)
+uint8_t rs_inverse(uint8_t x) {
+    uint8_t result = x;
+    for (uint8_t i = 0; i < 6; i++) {
+        result = rs_multiply(rs_multiply(result, result), x);
+    }
+    return rs_multiply(result, result);
+}
+
+#endif
+
+#if RS_GENERATOR_TABLES
+
+// The generator polynomials (as computed by rs_init) for the error correction block
+// lengths of the supported versions; each is its degree followed by its coefficients,
+// and the list ends with a degree of 0. With LOCK_VERSION 0, each is only included
+// from the first version that uses it (versions after 9 add no new lengths).
+static const uint8_t RS_GENERATORS[] PROGMEM = {
+#if LOCK_VERSION == 0
+    7,
+    0x7f, 0x7a, 0x9a, 0xa4, 0x0b, 0x44, 0x75,
+    10,
+    0xd8, 0xc2, 0x9f, 0x6f, 0xc7, 0x5e, 0x5f, 0x71, 0x9d, 0xc1,
+    13,
+    0x89, 0x49, 0xe3, 0x11, 0xb1, 0x11, 0x34, 0x0d, 0x2e, 0x2b, 0x53, 0x84, 0x78,
+#if QR_MAX_VERSION >= 3
+    15,
+    0x1d, 0xc4, 0x6f, 0xa3, 0x70, 0x4a, 0x0a, 0x69, 0x69, 0x8b, 0x84, 0x97, 0x20, 0x86, 0x1a,
+#endif
+#if QR_MAX_VERSION >= 2
+    16,
+    0x3b, 0x0d, 0x68, 0xbd, 0x44, 0xd1, 0x1e, 0x08, 0xa3, 0x41, 0x29, 0xe5, 0x62, 0x32, 0x24, 0x3b,
+#endif
+    17,
+    0x77, 0x42, 0x53, 0x78, 0x77, 0x16, 0xc5, 0x53, 0xf9, 0x29, 0x8f, 0x86, 0x55, 0x35, 0x7d, 0x63,
+    0x4f,
+#if QR_MAX_VERSION >= 3
+    18,
+    0xef, 0xfb, 0xb7, 0x71, 0x95, 0xaf, 0xc7, 0xd7, 0xf0, 0xdc, 0x49, 0x52, 0xad, 0x4b, 0x20, 0x43,
+    0xd9, 0x92,
+#endif
+#if QR_MAX_VERSION >= 4
+    20,
+    0x98, 0xb9, 0xf0, 0x05, 0x6f, 0x63, 0x06, 0xdc, 0x70, 0x96, 0x45, 0x24, 0xbb, 0x16, 0xe4, 0xc6,
+    0x79, 0x79, 0xa5, 0xae,
+#endif
+#if QR_MAX_VERSION >= 2
+    22,
+    0x59, 0xb3, 0x83, 0xb0, 0xb6, 0xf4, 0x13, 0xbd, 0x45, 0x28, 0x1c, 0x89, 0x1d, 0x7b, 0x43, 0xfd,
+    0x56, 0xda, 0xe6, 0x1a, 0x91, 0xf5,
+#endif
+#if QR_MAX_VERSION >= 5
+    24,
+    0x7a, 0x76, 0xa9, 0x46, 0xb2, 0xed, 0xd8, 0x66, 0x73, 0x96, 0xe5, 0x49, 0x82, 0x48, 0x3d, 0x2b,
+    0xce, 0x01, 0xed, 0xf7, 0x7f, 0xd9, 0x90, 0x75,
+#endif
+#if QR_MAX_VERSION >= 3
+    26,
+    0xf6, 0x33, 0xb7, 0x04, 0x88, 0x62, 0xc7, 0x98, 0x4d, 0x38, 0xce, 0x18, 0x91, 0x28, 0xd1, 0x75,
+    0xe9, 0x2a, 0x87, 0x44, 0x46, 0x90, 0x92, 0x4d, 0x2b, 0x5e,
+#endif
+#if QR_MAX_VERSION >= 2
+    28,
+    0xfc, 0x09, 0x1c, 0x0d, 0x12, 0xfb, 0xd0, 0x96, 0x67, 0xae, 0x64, 0x29, 0xa7, 0x0c, 0xf7, 0x38,
+    0x75, 0x77, 0xe9, 0x7f, 0xb5, 0x64, 0x79, 0x93, 0xb0, 0x4a, 0x3a, 0xc5,
+#endif
+#if QR_MAX_VERSION >= 9
+    30,
+    0xd4, 0xf6, 0x4d, 0x49, 0xc3, 0xc0, 0x4b, 0x62, 0x05, 0x46, 0x67, 0xb1, 0x16, 0xd9, 0x8a, 0x33,
+    0xb5, 0xf6, 0x48, 0x19, 0x12, 0x2e, 0xe4, 0x4a, 0xd8, 0xc3, 0x0b, 0x6a, 0x82, 0x96,
+#endif
+#elif LOCK_VERSION == 3
+    15,
+    0x1d, 0xc4, 0x6f, 0xa3, 0x70, 0x4a, 0x0a, 0x69, 0x69, 0x8b, 0x84, 0x97, 0x20, 0x86, 0x1a,
+    18,
+    0xef, 0xfb, 0xb7, 0x71, 0x95, 0xaf, 0xc7, 0xd7, 0xf0, 0xdc, 0x49, 0x52, 0xad, 0x4b, 0x20, 0x43,
+    0xd9, 0x92,
+    22,
+    0x59, 0xb3, 0x83, 0xb0, 0xb6, 0xf4, 0x13, 0xbd, 0x45, 0x28, 0x1c, 0x89, 0x1d, 0x7b, 0x43, 0xfd,
+    0x56, 0xda, 0xe6, 0x1a, 0x91, 0xf5,
+    26,
+    0xf6, 0x33, 0xb7, 0x04, 0x88, 0x62, 0xc7, 0x98, 0x4d, 0x38, 0xce, 0x18, 0x91, 0x28, 0xd1, 0x75,
+    0xe9, 0x2a, 0x87, 0x44, 0x46, 0x90, 0x92, 0x4d, 0x2b, 0x5e,
+#endif
+    0
+};
+
+#endif
+
+void rs_init(uint8_t degree, uint8_t *coeff) {
+#if RS_GENERATOR_TABLES
+    const uint8_t *generator = RS_GENERATORS;
+    for (uint8_t length; (length = pgm_read_byte(generator)) != 0; generator += length + 1) {
+        if (length != degree) { continue; }
+        for (uint8_t i = 0; i < degree; i++) {
+            coeff[i] = pgm_read_byte(&generator[i + 1]);
+        }
+        return;
+    }
+#endif
+
     memset(coeff, 0, degree);
     coeff[degree - 1] = 1;
     
@@ -603,7 +1160,7 @@ static void rs_init(uint8_t degree, uint8_t *coeff) {
     }
 }
 
-static void rs_getRemainder(uint8_t degree, uint8_t *coeff, uint8_t *data, uint8_t length, uint8_t *result, uint8_t stride) {
+void rs_getRemainder(uint8_t degree, uint8_t *coeff, uint8_t *data, uint8_t length, uint8_t *result, uint8_t stride) {
 
     // Compute the remainder by performing polynomial division
     for (uint8_t i = 0; i < length; i++) {
@@ -614,9 +1171,19 @@ static void rs_getRemainder(uint8_t degree, uint8_t *coeff, uint8_t *data, uint8
 
         result[(degree - 1) * stride] = 0;
 
+#if RS_LOG_TABLES
+        // Multiplying each coefficient by the same factor only needs its log once
+        if (factor == 0) { continue; }
+        uint8_t logFactor = pgm_read_byte(&RS_LOG[factor]);
+        for (uint8_t j = 0; j < degree; j++) {
+            if (coeff[j] == 0) { continue; }
+            result[j * stride] ^= rs_exp(pgm_read_byte(&RS_LOG[coeff[j]]) + logFactor);
+        }
+#else
         for (uint8_t j = 0; j < degree; j++) {
             result[j * stride] ^= rs_multiply(coeff[j], factor);
         }
+#endif
     }
 }
 
@@ -624,11 +1191,33 @@ static void rs_getRemainder(uint8_t degree, uint8_t *coeff, uint8_t *data, uint8
 
 #pragma mark - QrCode
 
-static int8_t encodeDataCodewords(BitBucket *dataCodewords, const uint8_t *text, uint16_t length, uint8_t version) {
-    int8_t mode = MODE_BYTE;
+// The most compact mode that can encode text
+static uint8_t getMode(const uint8_t *text, uint16_t length) {
+    if (isNumeric((char*)text, length)) { return MODE_NUMERIC; }
+    if (isAlphanumeric((char*)text, length)) { return MODE_ALPHANUMERIC; }
+    return MODE_BYTE;
+}
 
-    if (isNumeric((char*)text, length)) {
-        mode = MODE_NUMERIC;
+// The number of bits encodeDataCodewords appends for length characters in mode
+static uint32_t getEncodedBits(uint8_t mode, uint16_t length, uint8_t version) {
+    uint32_t bits = 4 + getModeBits(version, mode);
+    switch (mode) {
+        case MODE_NUMERIC:
+            bits += (uint32_t)length / 3 * 10;
+            if (length % 3) { bits += (length % 3) * 3 + 1; }
+            break;
+        case MODE_ALPHANUMERIC:
+            bits += (uint32_t)length / 2 * 11 + (length % 2) * 6;
+            break;
+        default:
+            bits += (uint32_t)length * 8;
+    }
+    return bits;
+}
+
+// Appends a segment of length characters of text in mode
+static void appendSegment(BitBucket *dataCodewords, uint8_t mode, const uint8_t *text, uint16_t length, uint8_t version) {
+    if (mode == MODE_NUMERIC) {
         bb_appendBits(dataCodewords, 1 << MODE_NUMERIC, 4);
         bb_appendBits(dataCodewords, length, getModeBits(version, MODE_NUMERIC));
 
@@ -649,8 +1238,7 @@ static int8_t encodeDataCodewords(BitBucket *dataCodewords, const uint8_t *text,
             bb_appendBits(dataCodewords, accumData, accumCount * 3 + 1);
         }
 
-    } else if (isAlphanumeric((char*)text, length)) {
-        mode = MODE_ALPHANUMERIC;
+    } else if (mode == MODE_ALPHANUMERIC) {
         bb_appendBits(dataCodewords, 1 << MODE_ALPHANUMERIC, 4);
         bb_appendBits(dataCodewords, length, getModeBits(version, MODE_ALPHANUMERIC));
 
@@ -677,68 +1265,215 @@ static int8_t encodeDataCodewords(BitBucket *dataCodewords, const uint8_t *text,
             bb_appendBits(dataCodewords, (char)(text[i]), 8);
         }
     }
+}
+
+#if QR_SEGMENTATION
+
+// The states of segmentText; the mode of the open segment, and for numeric and
+// alphanumeric its character count so far (mod 3 and mod 2), as that sets how many bits
+// the next character takes
+#define SEGMENT_BYTE            0
+#define SEGMENT_ALPHANUMERIC_1  1
+#define SEGMENT_ALPHANUMERIC_0  2
+#define SEGMENT_NUMERIC_1       3
+#define SEGMENT_NUMERIC_2       4
+#define SEGMENT_NUMERIC_0       5
+#define SEGMENT_STATES          6
+
+// More bits than any QR code holds (and small enough to add to without overflowing)
+#define SEGMENT_INFINITE        0x40000000
+
+// In each path entry of segmentText; the character begins a new segment
+#define SEGMENT_BEGIN           0x80
+
+// More characters than any QR code this build can produce holds (every module of the
+// largest version, less none for the function patterns, as digits at 10 bits per 3);
+// this bounds the path of segmentText on the stack
+#define SEGMENT_MAX_LENGTH      ((((16UL * QR_LARGEST_VERSION + 128) * QR_LARGEST_VERSION + 64) * 3) / 10)
+
+static uint8_t getSegmentMode(uint8_t state) {
+    if (state == SEGMENT_BYTE) { return MODE_BYTE; }
+    if (state <= SEGMENT_ALPHANUMERIC_0) { return MODE_ALPHANUMERIC; }
+    return MODE_NUMERIC;
+}
+
+// Splits text (at least 1 character) into the numeric, alphanumeric and byte segments that
+// take the fewest bits at version, returning the bits. If path is non-NULL, each entry is set
+// to the mode of its character, with SEGMENT_BEGIN set on the first of each segment.
+//
+// Each character either continues the open segment or begins a new one (after the cheapest
+// way of encoding the characters before it), so only 1 byte per character is needed to walk
+// back through the choices; which state was cheapest before it (bits 4 to 6), and whether the
+// byte, alphanumeric and numeric states began a new segment (bits 0 to 2).
+static uint32_t segmentText(const uint8_t *text, uint16_t length, uint8_t version, uint8_t *path) {
+    uint32_t headerBits[3];
+    for (uint8_t mode = 0; mode < 3; mode++) { headerBits[mode] = 4 + getModeBits(version, mode); }
+
+    uint32_t bits[SEGMENT_STATES];
+    for (uint8_t state = 0; state < SEGMENT_STATES; state++) { bits[state] = SEGMENT_INFINITE; }
+
+    uint8_t best = 0;
+    uint32_t bestBits = 0;
+
+    for (uint16_t i = 0; i < length; i++) {
+        char c = (char)(text[i]);
+
+        uint32_t nextBits[SEGMENT_STATES];
+        uint8_t choice = best << 4;
+
+        nextBits[SEGMENT_BYTE] = bestBits + headerBits[MODE_BYTE] + 8;
+        if (bits[SEGMENT_BYTE] + 8 <= nextBits[SEGMENT_BYTE]) {
+            nextBits[SEGMENT_BYTE] = bits[SEGMENT_BYTE] + 8;
+        } else {
+            choice |= (1 << 0);
+        }
+
+        nextBits[SEGMENT_ALPHANUMERIC_1] = nextBits[SEGMENT_ALPHANUMERIC_0] = SEGMENT_INFINITE;
+        if (getAlphanumeric(c) != -1) {
+            nextBits[SEGMENT_ALPHANUMERIC_1] = bestBits + headerBits[MODE_ALPHANUMERIC] + 6;
+            if (bits[SEGMENT_ALPHANUMERIC_0] + 6 <= nextBits[SEGMENT_ALPHANUMERIC_1]) {
+                nextBits[SEGMENT_ALPHANUMERIC_1] = bits[SEGMENT_ALPHANUMERIC_0] + 6;
+            } else {
+                choice |= (1 << 1);
+            }
+            nextBits[SEGMENT_ALPHANUMERIC_0] = bits[SEGMENT_ALPHANUMERIC_1] + 5;
+        }
+
+        nextBits[SEGMENT_NUMERIC_1] = nextBits[SEGMENT_NUMERIC_2] = nextBits[SEGMENT_NUMERIC_0] = SEGMENT_INFINITE;
+        if (c >= '0' && c <= '9') {
+            nextBits[SEGMENT_NUMERIC_1] = bestBits + headerBits[MODE_NUMERIC] + 4;
+            if (bits[SEGMENT_NUMERIC_0] + 4 <= nextBits[SEGMENT_NUMERIC_1]) {
+                nextBits[SEGMENT_NUMERIC_1] = bits[SEGMENT_NUMERIC_0] + 4;
+            } else {
+                choice |= (1 << 2);
+            }
+            nextBits[SEGMENT_NUMERIC_2] = bits[SEGMENT_NUMERIC_1] + 3;
+            nextBits[SEGMENT_NUMERIC_0] = bits[SEGMENT_NUMERIC_2] + 3;
+        }
+
+        if (path) { path[i] = choice; }
+
+        best = 0;
+        for (uint8_t state = 0; state < SEGMENT_STATES; state++) {
+            bits[state] = nextBits[state];
+            if (bits[state] < bits[best]) { best = state; }
+        }
+        bestBits = bits[best];
+    }
+
+    if (path) {
+        uint8_t state = best;
+        for (uint16_t i = length; i-- > 0; ) {
+            uint8_t choice = path[i];
+            uint8_t previous = choice >> 4;
+            bool begins = false;
+            switch (state) {
+                case SEGMENT_BYTE:
+                    if (choice & (1 << 0)) { begins = true; } else { previous = SEGMENT_BYTE; }
+                    break;
+                case SEGMENT_ALPHANUMERIC_1:
+                    if (choice & (1 << 1)) { begins = true; } else { previous = SEGMENT_ALPHANUMERIC_0; }
+                    break;
+                case SEGMENT_NUMERIC_1:
+                    if (choice & (1 << 2)) { begins = true; } else { previous = SEGMENT_NUMERIC_0; }
+                    break;
+                default:
+                    previous = state - 1;
+            }
+
+            path[i] = getSegmentMode(state) | (begins ? SEGMENT_BEGIN: 0);
+            state = previous;
+        }
+    }
+
+    return bestBits;
+}
+
+#endif
+
+// The number of bits encodeDataCodewords appends for text
+static uint32_t getDataBits(const uint8_t *text, uint16_t length, uint8_t version) {
+    uint8_t mode = getMode(text, length);
+#if QR_SEGMENTATION
+    // Numeric text (or nothing) is always best as one numeric segment
+    if (mode != MODE_NUMERIC) { return segmentText(text, length, version, NULL); }
+#endif
+    return getEncodedBits(mode, length, version);
+}
+
+static int8_t encodeDataCodewords(BitBucket *dataCodewords, const uint8_t *text, uint16_t length, uint8_t version) {
+    int8_t mode = getMode(text, length);
+
+#if QR_SEGMENTATION
+    // (encodeModules has already checked the text fits, so the length check only bounds path)
+    if (mode != MODE_NUMERIC && length <= SEGMENT_MAX_LENGTH) {
+        uint8_t path[length];
+        segmentText(text, length, version, path);
+
+        uint16_t start = 0;
+        for (uint16_t i = 1; i <= length; i++) {
+            if (i < length && !(path[i] & SEGMENT_BEGIN)) { continue; }
+            appendSegment(dataCodewords, path[start] & 0x03, &text[start], i - start, version);
+            start = i;
+        }
+        return mode;
+    }
+#endif
+
+    appendSegment(dataCodewords, mode, text, length, version);
     return mode;
 }
 
+// Returns where the data codeword at index (in block order) goes once the blocks are
+// interleaved; the short blocks come first and the long blocks have one more codeword
+static uint16_t getInterleavedIndex(uint16_t index, uint8_t shortDataBlockLen, uint8_t numBlocks, uint8_t numShortBlocks) {
+    uint8_t blockNum, i;
+    uint16_t shortLength = shortDataBlockLen * numShortBlocks;
+    if (index < shortLength) {
+        blockNum = index / shortDataBlockLen;
+        i = index % shortDataBlockLen;
+    } else {
+        blockNum = numShortBlocks + (index - shortLength) / (shortDataBlockLen + 1);
+        i = (index - shortLength) % (shortDataBlockLen + 1);
+    }
+
+    if (i == shortDataBlockLen) { return shortDataBlockLen * numBlocks + blockNum - numShortBlocks; }
+    return i * numBlocks + blockNum;
+}
+
+// Computes the error correction codewords after the data codewords and interleaves both,
+// in place; data must have room for all the codewords
 static void performErrorCorrection(uint8_t version, uint8_t ecc, BitBucket *data) {
 
     // See: http://www.thonky.com/qr-code-tutorial/structure-final-message
 
 #if LOCK_VERSION == 0
-    uint8_t numBlocks = NUM_ERROR_CORRECTION_BLOCKS[ecc][version - 1];
-    uint16_t totalEcc = NUM_ERROR_CORRECTION_CODEWORDS[ecc][version - 1];
-    uint16_t moduleCount = NUM_RAW_DATA_MODULES[version - 1];
+    uint8_t numBlocks = pgm_read_byte(&NUM_ERROR_CORRECTION_BLOCKS[version - 1][ecc]);
+    uint8_t blockEccLen = pgm_read_byte(&ECC_CODEWORDS_PER_BLOCK[version - 1][ecc]);
+    uint16_t totalEcc = blockEccLen * numBlocks;
+    uint16_t moduleCount = getNumRawDataModules(version);
 #else
     uint8_t numBlocks = NUM_ERROR_CORRECTION_BLOCKS[ecc];
     uint16_t totalEcc = NUM_ERROR_CORRECTION_CODEWORDS[ecc];
     uint16_t moduleCount = NUM_RAW_DATA_MODULES;
+    uint8_t blockEccLen = totalEcc / numBlocks;
 #endif
 
-    uint8_t blockEccLen = totalEcc / numBlocks;
     uint8_t numShortBlocks = numBlocks - moduleCount / 8 % numBlocks;
     uint8_t shortBlockLen = moduleCount / 8 / numBlocks;
 
     uint8_t shortDataBlockLen = shortBlockLen - blockEccLen;
 
-    uint8_t result[data->capacityBytes];
-    memset(result, 0, sizeof(result));
-
     uint8_t coeff[blockEccLen];
     rs_init(blockEccLen, coeff);
 
-    uint16_t offset = 0;
     uint8_t *dataBytes = data->data;
+    uint16_t dataLength = moduleCount / 8 - totalEcc;
 
-    // Interleave all short blocks
-    for (uint8_t i = 0; i < shortDataBlockLen; i++) {
-        uint16_t index = i;
-        uint8_t stride = shortDataBlockLen;
-        for (uint8_t blockNum = 0; blockNum < numBlocks; blockNum++) {
-            result[offset++] = dataBytes[index];
-
-#if LOCK_VERSION == 0 || LOCK_VERSION >= 5
-            if (blockNum == numShortBlocks) { stride++; }
-#endif
-            index += stride;
-        }
-    }
-
-    // Version less than 5 only have short blocks
-#if LOCK_VERSION == 0 || LOCK_VERSION >= 5
-    {
-        // Interleave long blocks
-        uint16_t index = shortDataBlockLen * (numShortBlocks + 1);
-        uint8_t stride = shortDataBlockLen;
-        for (uint8_t blockNum = 0; blockNum < numBlocks - numShortBlocks; blockNum++) {
-            result[offset++] = dataBytes[index];
-
-            if (blockNum == 0) { stride++; }
-            index += stride;
-        }
-    }
-#endif
+    // Add all ecc blocks after the data, interleaved
+    memset(&dataBytes[dataLength], 0, totalEcc);
 
-    // Add all ecc blocks, interleaved
+    uint16_t offset = 0;
     uint8_t blockSize = shortDataBlockLen;
     for (uint8_t blockNum = 0; blockNum < numBlocks; blockNum++) {
 
@@ -746,11 +1481,30 @@ static void performErrorCorrection(uint8_t version, uint8_t ecc, BitBucket *data
         if (blockNum == numShortBlocks) { blockSize++; }
 #endif
 
-        rs_getRemainder(blockEccLen, coeff, dataBytes, blockSize, &result[offset + blockNum], numBlocks);
-        dataBytes += blockSize;
+        rs_getRemainder(blockEccLen, coeff, &dataBytes[offset], blockSize, &dataBytes[dataLength + blockNum], numBlocks);
+        offset += blockSize;
+    }
+
+    // Interleave the data blocks in place; the byte at each index moves to getInterleavedIndex,
+    // so each cycle of that permutation is rotated once (starting from its lowest index)
+    if (numBlocks > 1) {
+        for (uint16_t start = 0; start < dataLength; start++) {
+            uint16_t index = getInterleavedIndex(start, shortDataBlockLen, numBlocks, numShortBlocks);
+            while (index > start) {
+                index = getInterleavedIndex(index, shortDataBlockLen, numBlocks, numShortBlocks);
+            }
+            if (index < start) { continue; }
+
+            uint8_t value = dataBytes[start];
+            do {
+                index = getInterleavedIndex(index, shortDataBlockLen, numBlocks, numShortBlocks);
+                uint8_t tmp = dataBytes[index];
+                dataBytes[index] = value;
+                value = tmp;
+            } while (index != start);
+        }
     }
 
-    memcpy(data->data, result, data->capacityBytes);
     data->bitOffsetOrWidth = moduleCount;
 }
 
@@ -765,34 +1519,130 @@ uint16_t qrcode_getBufferSize(uint8_t version) {
     return bb_getGridSizeBytes(4 * version + 17);
 }
 
-// @TODO: Return error if data is too big.
-int8_t qrcode_initBytes(QRCode *qrcode, uint8_t *modules, uint8_t version, uint8_t ecc, uint8_t *data, uint16_t length) {
-    uint8_t size = version * 4 + 17;
-    qrcode->version = version;
-    qrcode->size = size;
-    qrcode->ecc = ecc;
-    qrcode->modules = modules;
-    
+
+// The number of codeword bits (data and error correction), locking the version if needed
+static uint16_t getModuleCount(uint8_t *version) {
+#if LOCK_VERSION == 0
+    return getNumRawDataModules(*version);
+#else
+    *version = LOCK_VERSION;
+    return NUM_RAW_DATA_MODULES;
+#endif
+}
+
+// Whether this build can produce QR codes of version
+static bool isSupportedVersion(uint8_t version) {
+#if LOCK_VERSION == 0
+    return (version >= 1 && version <= QR_MAX_VERSION);
+#else
+    return (version == LOCK_VERSION);
+#endif
+}
+
+uint8_t qrcode_getMinimumVersion(uint8_t ecc, const uint8_t *data, uint16_t length) {
     uint8_t eccFormatBits = (ECC_FORMAT_BITS >> (2 * ecc)) & 0x03;
-    
+    uint32_t bits = 0;
+
 #if LOCK_VERSION == 0
-    uint16_t moduleCount = NUM_RAW_DATA_MODULES[version - 1];
-    uint16_t dataCapacity = moduleCount / 8 - NUM_ERROR_CORRECTION_CODEWORDS[eccFormatBits][version - 1];
+    uint8_t firstVersion = 1;
+    for (uint8_t version = 1; version <= QR_MAX_VERSION; version++) {
 #else
-    version = LOCK_VERSION;
-    uint16_t moduleCount = NUM_RAW_DATA_MODULES;
-    uint16_t dataCapacity = moduleCount / 8 - NUM_ERROR_CORRECTION_CODEWORDS[eccFormatBits];
+    uint8_t firstVersion = LOCK_VERSION;
+    for (uint8_t version = LOCK_VERSION; version <= LOCK_VERSION; version++) {
 #endif
+        // Versions 1-9, 10-26 and 27-40 count characters with the same number of bits
+        if (version == firstVersion || version == 10 || version == 27) {
+            bits = getDataBits(data, length, version);
+        }
+
+        if (bits <= getDataCapacity(version, eccFormatBits) * 8) {
+            return version;
+        }
+    }
+
+    return 0;
+}
+
+uint16_t qrcode_getCapacity(uint8_t version, uint8_t ecc, uint8_t mode) {
+    if (!isSupportedVersion(version)) { return 0; }
+
+    uint8_t eccFormatBits = (ECC_FORMAT_BITS >> (2 * ecc)) & 0x03;
+
+    // The inverse of getEncodedBits
+    uint16_t bits = getDataCapacity(version, eccFormatBits) * 8 - 4 - getModeBits(version, mode);
+    switch (mode) {
+        case MODE_NUMERIC:
+            return bits / 10 * 3 + ((bits % 10 >= 7) ? 2: ((bits % 10 >= 4) ? 1: 0));
+        case MODE_ALPHANUMERIC:
+            return bits / 11 * 2 + ((bits % 11 >= 6) ? 1: 0);
+    }
+    return bits / 8;
+}
+
+uint32_t qrcode_getDataBits(uint8_t version, const uint8_t *data, uint16_t length) {
+    return getDataBits(data, length, version);
+}
+
+uint16_t qrcode_getCodewordsSize(uint8_t version) {
+#if QR_FUNCTION_TABLES
+    return bb_getBufferSizeBytes(getModuleCount(&version));
+#else
+    // Without the function tables, a stripe would need a full function module grid
+    // anyway, so a streamed QR code keeps its module grid instead
+    return qrcode_getBufferSize(version);
+#endif
+}
+
+// Copies (or draws) the function patterns into the rows of modules and marks the function
+// modules in isFunction; without QR_FUNCTION_TABLES, isFunctionBytes holds a full grid
+static void initFunctionModules(BitBucket *modules, BitBucket *isFunction, uint8_t *isFunctionBytes, uint8_t version, uint8_t eccFormatBits) {
+    uint8_t size = modules->bitOffsetOrWidth;
+
+#if QR_FUNCTION_TABLES
+    // Copy the function patterns, and mark the function modules, from flash
+    uint8_t *data = modules->data;
+    uint16_t offset = modules->top * size;
+    if (offset & 0x07) {
+        uint16_t count = modules->rows * size;
+        for (uint16_t i = 0; i < count; i++, offset++) {
+            if (pgm_read_byte(&FUNCTION_MODULES[offset >> 3]) & (0x80 >> (offset & 0x07))) {
+                data[i >> 3] |= 0x80 >> (i & 0x07);
+            }
+        }
+    } else {
+        for (uint16_t i = 0; i < modules->capacityBytes; i++) {
+            data[i] = pgm_read_byte(&FUNCTION_MODULES[(offset >> 3) + i]);
+        }
+    }
+
+    isFunction->bitOffsetOrWidth = size;
+    isFunction->capacityBytes = sizeof(FUNCTION_MASK);
+    isFunction->data = (uint8_t*)FUNCTION_MASK;
+#else
+    bb_initGrid(isFunction, isFunctionBytes, size);
     
+    // Draw function patterns
+    drawFunctionPatterns(modules, isFunction, version, eccFormatBits);
+#endif
+}
+
+// Encodes data into the codewords buffer (which must hold every data module), then draws
+// the QR code into modules (a full grid) with the best (lowest penalty) mask
+static int8_t encodeModules(QRCode *qrcode, BitBucket *modules, uint8_t *codewordBytes, uint8_t *data, uint16_t length) {
+    uint8_t version = qrcode->version;
+    uint8_t eccFormatBits = (ECC_FORMAT_BITS >> (2 * qrcode->ecc)) & 0x03;
+    
+    uint16_t moduleCount = getModuleCount(&version);
+    uint16_t dataCapacity = getDataCapacity(version, eccFormatBits);
+    
+    // Make sure the data fits
+    if (getDataBits(data, length, version) > dataCapacity * 8) { return -1; }
+
     struct BitBucket codewords;
-    uint8_t codewordBytes[bb_getBufferSizeBytes(moduleCount)];
-    bb_initBuffer(&codewords, codewordBytes, (int32_t)sizeof(codewordBytes));
+    bb_initBuffer(&codewords, codewordBytes, bb_getBufferSizeBytes(moduleCount));
     
     // Place the data code words into the buffer
-    int8_t mode = encodeDataCodewords(&codewords, data, length, version);
-    
-    if (mode < 0) { return -1; }
-    qrcode->mode = mode;
+    qrcode->mode = encodeDataCodewords(&codewords, data, length, version);
     
     // Add terminator and pad up to a byte if applicable
     uint32_t padding = (dataCapacity * 8) - codewords.bitOffsetOrWidth;
@@ -805,46 +1655,151 @@ int8_t qrcode_initBytes(QRCode *qrcode, uint8_t *modules, uint8_t version, uint8
         bb_appendBits(&codewords, padByte, 8);
     }
 
-    BitBucket modulesGrid;
-    bb_initGrid(&modulesGrid, modules, size);
-    
     BitBucket isFunctionGrid;
-    uint8_t isFunctionGridBytes[bb_getGridSizeBytes(size)];
-    bb_initGrid(&isFunctionGrid, isFunctionGridBytes, size);
-    
-    // Draw function patterns, draw all codewords, do masking
-    drawFunctionPatterns(&modulesGrid, &isFunctionGrid, version, eccFormatBits);
+#if QR_FUNCTION_TABLES
+    uint8_t *isFunctionGridBytes = NULL;
+#else
+    uint8_t isFunctionGridBytes[bb_getGridSizeBytes(qrcode->size)];
+#endif
+    initFunctionModules(modules, &isFunctionGrid, isFunctionGridBytes, version, eccFormatBits);
+
+    // Draw all codewords, do masking
     performErrorCorrection(version, eccFormatBits, &codewords);
-    drawCodewords(&modulesGrid, &isFunctionGrid, &codewords);
+    drawCodewords(modules, &isFunctionGrid, &codewords);
     
+    // Each mask pattern is computed once, then applied and undone (unless from flash)
+#if QR_MASK_TABLES
+    uint8_t *maskPattern = NULL;
+#else
+    uint8_t maskPattern[bb_getGridSizeBytes(qrcode->size)];
+#endif
+
     // Find the best (lowest penalty) mask
     uint8_t mask = 0;
     int32_t minPenalty = INT32_MAX;
     for (uint8_t i = 0; i < 8; i++) {
-        drawFormatBits(&modulesGrid, &isFunctionGrid, eccFormatBits, i);
-        applyMask(&modulesGrid, &isFunctionGrid, i);
-        int penalty = getPenaltyScore(&modulesGrid);
+        drawFormatBits(modules, &isFunctionGrid, eccFormatBits, i);
+        const uint8_t *pattern = getMaskPattern(&isFunctionGrid, i, maskPattern);
+        applyMask(modules, pattern);
+        int penalty = getPenaltyScore(modules);
         if (penalty < minPenalty) {
             mask = i;
             minPenalty = penalty;
         }
-        applyMask(&modulesGrid, &isFunctionGrid, i);  // Undoes the mask due to XOR
+        applyMask(modules, pattern);  // Undoes the mask due to XOR
     } 
     qrcode->mask = mask;
     
     // Overwrite old format bits
-    drawFormatBits(&modulesGrid, &isFunctionGrid, eccFormatBits, mask);
+    drawFormatBits(modules, &isFunctionGrid, eccFormatBits, mask);
     
     // Apply the final choice of mask
-    applyMask(&modulesGrid, &isFunctionGrid, mask);
+    applyMask(modules, getMaskPattern(&isFunctionGrid, mask, maskPattern));
 
     return 0;
 }
 
+int8_t qrcode_initBytes(QRCode *qrcode, uint8_t *modules, uint8_t version, uint8_t ecc, uint8_t *data, uint16_t length) {
+    if (!isSupportedVersion(version)) { return -1; }
+
+    uint8_t size = version * 4 + 17;
+    qrcode->version = version;
+    qrcode->size = size;
+    qrcode->ecc = ecc;
+    qrcode->modules = modules;
+    qrcode->streamed = false;
+
+    BitBucket modulesGrid;
+    bb_initGrid(&modulesGrid, modules, size);
+
+    uint8_t codewordBytes[qrcode_getCodewordsSize(version)];
+    return encodeModules(qrcode, &modulesGrid, codewordBytes, data, length);
+}
+
 int8_t qrcode_initText(QRCode *qrcode, uint8_t *modules, uint8_t version, uint8_t ecc, const char *data) {
     return qrcode_initBytes(qrcode, modules, version, ecc, (uint8_t*)data, strlen(data));
 }
 
+int8_t qrcode_initStreamedBytes(QRCode *qrcode, uint8_t *codewords, uint8_t version, uint8_t ecc, uint8_t *data, uint16_t length) {
+#if !QR_FUNCTION_TABLES
+    // codewords holds a full module grid (see qrcode_getCodewordsSize)
+    return qrcode_initBytes(qrcode, codewords, version, ecc, data, length);
+#else
+    if (!isSupportedVersion(version)) { return -1; }
+
+    uint8_t size = version * 4 + 17;
+    qrcode->version = version;
+    qrcode->size = size;
+    qrcode->ecc = ecc;
+    qrcode->modules = codewords;
+    qrcode->streamed = true;
+
+    // The full grid is only needed (on the stack) while scoring the masks
+    BitBucket modulesGrid;
+    uint8_t modules[bb_getGridSizeBytes(size)];
+    bb_initGrid(&modulesGrid, modules, size);
+
+    return encodeModules(qrcode, &modulesGrid, codewords, data, length);
+#endif
+}
+
+int8_t qrcode_initStreamedText(QRCode *qrcode, uint8_t *codewords, uint8_t version, uint8_t ecc, const char *data) {
+    return qrcode_initStreamedBytes(qrcode, codewords, version, ecc, (uint8_t*)data, strlen(data));
+}
+
+void qrcode_getStripe(QRCode *qrcode, uint8_t top, uint8_t rows, uint8_t *stripe) {
+    uint8_t size = qrcode->size;
+    if (top >= size) { return; }
+    if (rows > size - top) { rows = size - top; }
+
+    BitBucket stripeGrid;
+    bb_initStripe(&stripeGrid, stripe, size, top, rows);
+
+    if (!qrcode->streamed) {
+        uint16_t offset = top * size;
+        uint16_t count = rows * size;
+        for (uint16_t i = 0; i < count; i++, offset++) {
+            if (qrcode->modules[offset >> 3] & (0x80 >> (offset & 0x07))) {
+                stripe[i >> 3] |= 0x80 >> (i & 0x07);
+            }
+        }
+        return;
+    }
+
+    // Streamed QR codes only exist with the function tables (see qrcode_getCodewordsSize)
+#if QR_FUNCTION_TABLES
+    uint8_t version = qrcode->version;
+    uint8_t eccFormatBits = (ECC_FORMAT_BITS >> (2 * qrcode->ecc)) & 0x03;
+
+    BitBucket codewords;
+    codewords.bitOffsetOrWidth = getModuleCount(&version);
+    codewords.data = qrcode->modules;
+
+    BitBucket isFunctionGrid;
+    initFunctionModules(&stripeGrid, &isFunctionGrid, NULL, version, eccFormatBits);
+
+    // Only the modules in the stripe's rows are kept, as the codewords zigzag over all of them
+    drawCodewords(&stripeGrid, &isFunctionGrid, &codewords);
+    drawFormatBits(&stripeGrid, &isFunctionGrid, eccFormatBits, qrcode->mask);
+
+#if QR_MASK_TABLES
+    applyMask(&stripeGrid, getMaskPattern(&isFunctionGrid, qrcode->mask, NULL));
+#else
+    applyStripeMask(&stripeGrid, &isFunctionGrid, qrcode->mask);
+#endif
+#endif
+}
+
+void qrcode_initModules(QRCode *qrcode, uint8_t *modules, uint8_t version, uint8_t ecc) {
+    qrcode->version = version;
+    qrcode->size = version * 4 + 17;
+    qrcode->ecc = ecc;
+    qrcode->mode = 0;
+    qrcode->mask = 0;
+    qrcode->modules = modules;
+    qrcode->streamed = false;
+}
+
 bool qrcode_getModule(QRCode *qrcode, uint8_t x, uint8_t y) {
     if (x < 0 || x >= qrcode->size || y < 0 || y >= qrcode->size) {
         return false;
@@ -854,6 +1809,22 @@ bool qrcode_getModule(QRCode *qrcode, uint8_t x, uint8_t y) {
     return (qrcode->modules[offset >> 3] & (1 << (7 - (offset & 0x07)))) != 0;
 }
 
+void qrcode_base45Encode(const uint8_t *data, uint16_t length, char *text) {
+    for (uint16_t i = 0; i < length; i += 2) {
+        // A final odd byte is 2 characters (its value is below 45 * 45)
+        bool pair = (i + 1 < length);
+        uint16_t value = pair ? (((uint16_t)data[i] << 8) | data[i + 1]): data[i];
+        *text++ = getAlphanumericChar(value % 45);
+        value /= 45;
+        if (!pair) {
+            *text++ = getAlphanumericChar(value);
+            break;
+        }
+        *text++ = getAlphanumericChar(value % 45);
+        *text++ = getAlphanumericChar(value / 45);
+    }
+}
+
 /*
 uint8_t qrcode_getHexLength(QRCode *qrcode) {
     return ((qrcode->size * qrcode->size) + 7) / 4;
@@ -863,3 +1834,4 @@ void qrcode_getHex(QRCode *qrcode, char *result) {
     
 }
 */
+
@@ -33,7 +33,7 @@
 #ifndef __ETHERS_QRCODE_H_
 #define __ETHERS_QRCODE_H_
 
-#ifndef __cplusplus
+#if !defined(__cplusplus) && !defined(__bool_true_false_are_defined)
 typedef unsigned char bool;
 static const bool false = 0;
 static const bool true = 1;
@@ -41,6 +41,14 @@ static const bool true = 1;
 
 #include <stdint.h>
 
+// The Firefly sketch picks the options below in its configuration library (see
+// firefly_config.h), when it is on the include path
+#ifdef __has_include
+#if __has_include(<firefly_config.h>)
+#include <firefly_config.h>
+#endif
+#endif
+
 
 // QR Code Format Encoding
 #define MODE_NUMERIC        0
@@ -61,6 +69,66 @@ static const bool true = 1;
 #define LOCK_VERSION       3
 #endif
 
+// With LOCK_VERSION 0, the largest version supported (see qrcode_getMinimumVersion). Each
+// version's error correction tables take 8 bytes of PROGMEM (versions past 10 are added 10
+// at a time), and RS_GENERATOR_TABLES adds the generators of the new block lengths. In all
+// (bytes of PROGMEM by QR_MAX_VERSION, with generators):
+//   1 => 60, 2 => 137, 3 => 207, 4 => 236, 5 => 269, 6 => 277, 7 => 285, 8 => 293,
+//   9 => 332, 10 => 340
+// The largest version the Firefly display can show is 10 (57 modules at 1 pixel each).
+#ifndef QR_MAX_VERSION
+#define QR_MAX_VERSION     10
+#endif
+
+// The largest version this build can produce
+#if LOCK_VERSION == 0
+#define QR_LARGEST_VERSION QR_MAX_VERSION
+#else
+#define QR_LARGEST_VERSION LOCK_VERSION
+#endif
+
+// If non-zero, text is split into the numeric, alphanumeric and byte segments that take the
+// fewest bits (e.g. the digit runs of an address), rather than encoded in the one mode that
+// fits all of it; this needs a byte of stack for each character while encoding (no more
+// than the largest version holds)
+#ifndef QR_SEGMENTATION
+#define QR_SEGMENTATION    1
+#endif
+
+// If non-zero, GF(256) multiplication uses exp/log tables (512 bytes of PROGMEM on
+// AVR) rather than an 8 step shift-and-add multiply
+#ifndef RS_LOG_TABLES
+#define RS_LOG_TABLES      1
+#endif
+
+// If non-zero, the Reed-Solomon generator polynomials for the error correction block
+// lengths of the supported versions are precomputed (81 bytes of PROGMEM for version
+// 3); rs_init computes any others
+#ifndef RS_GENERATOR_TABLES
+#define RS_GENERATOR_TABLES    1
+#endif
+
+// If non-zero, the 8 mask patterns (less the function modules) are read from flash
+// (848 bytes of PROGMEM) rather than computed for each QR code; LOCK_VERSION 3 only
+#ifndef QR_MASK_TABLES
+#if LOCK_VERSION == 3
+#define QR_MASK_TABLES     1
+#else
+#define QR_MASK_TABLES     0
+#endif
+#endif
+
+// If non-zero, the function patterns and the grid marking the function modules are
+// copied and read from flash (212 bytes of PROGMEM) rather than drawn into a second
+// grid on the stack for each QR code; LOCK_VERSION 3 only
+#ifndef QR_FUNCTION_TABLES
+#if LOCK_VERSION == 3
+#define QR_FUNCTION_TABLES 1
+#else
+#define QR_FUNCTION_TABLES 0
+#endif
+#endif
+
 
 typedef struct QRCode {
     uint8_t version;
@@ -69,6 +137,10 @@ typedef struct QRCode {
     uint8_t mode;
     uint8_t mask;
     uint8_t *modules;
+
+    // Whether only the codewords are kept in modules (see qrcode_initStreamedBytes; never
+    // without QR_FUNCTION_TABLES)
+    bool streamed;
 } QRCode;
 
 
@@ -80,11 +152,64 @@ extern "C"{
 
 uint16_t qrcode_getBufferSize(uint8_t version);
 
+// The smallest supported version that can hold data at ecc, or 0 if it is too long
+uint8_t qrcode_getMinimumVersion(uint8_t ecc, const uint8_t *data, uint16_t length);
+
+// The most characters (or bytes) of mode that version can hold at ecc, or 0 if the version
+// is not supported
+uint16_t qrcode_getCapacity(uint8_t version, uint8_t ecc, uint8_t mode);
+
+// The bits data takes in a QR code of version (less the terminator and padding)
+uint32_t qrcode_getDataBits(uint8_t version, const uint8_t *data, uint16_t length);
+
+// Returns -1 if the version is not supported or the data does not fit
 int8_t qrcode_initText(QRCode *qrcode, uint8_t *modules, uint8_t version, uint8_t ecc, const char *data);
 int8_t qrcode_initBytes(QRCode *qrcode, uint8_t *modules, uint8_t version, uint8_t ecc, uint8_t *data, uint16_t length);
 
 bool qrcode_getModule(QRCode *qrcode, uint8_t x, uint8_t y);
 
+// Uses the modules of a QR code generated earlier (a copy of its qrcode_getBufferSize bytes
+// of modules, e.g. kept in storage); the mode and mask are not known, so are 0
+void qrcode_initModules(QRCode *qrcode, uint8_t *modules, uint8_t version, uint8_t ecc);
+
+
+// Streamed QR codes keep only their codewords (qrcode_getCodewordsSize bytes; 71 rather
+// than 106 for version 3), and their modules are generated a stripe of rows at a time
+// with qrcode_getStripe (qrcode_getModule cannot be used). A full module grid is still
+// needed on the stack while initializing, to pick the mask.
+//
+// Generating a stripe needs the function modules of every row, so this requires
+// QR_FUNCTION_TABLES; without them, a streamed QR code keeps its full module grid
+// (qrcode_getCodewordsSize is then qrcode_getBufferSize) and qrcode_getStripe copies
+// its rows, rather than drawing a function module grid on the stack for every stripe.
+
+uint16_t qrcode_getCodewordsSize(uint8_t version);
+
+int8_t qrcode_initStreamedText(QRCode *qrcode, uint8_t *codewords, uint8_t version, uint8_t ecc, const char *data);
+int8_t qrcode_initStreamedBytes(QRCode *qrcode, uint8_t *codewords, uint8_t version, uint8_t ecc, uint8_t *data, uint16_t length);
+
+// Fills stripe with the modules of rows top through top + rows - 1, packed the same as the
+// module grid (so (rows * size + 7) / 8 bytes); works for any QR code
+void qrcode_getStripe(QRCode *qrcode, uint8_t top, uint8_t rows, uint8_t *stripe);
+
+
+// Writes the Base45 (RFC 9285) of data to text (3 characters for each big-endian pair of
+// bytes, least significant first, and 2 for a final odd byte; not null terminated). Every
+// character is Alphanumeric, so 16 bits take 16.5 bits of QR data (hex takes 22).
+void qrcode_base45Encode(const uint8_t *data, uint16_t length, char *text);
+
+
+// Reed-Solomon over GF(2^8/0x11D); also used by the BLECast erasure coding
+
+uint8_t rs_multiply(uint8_t x, uint8_t y);
+
+// The multiplicative inverse of x (x must be non-zero)
+uint8_t rs_inverse(uint8_t x);
+
+void rs_init(uint8_t degree, uint8_t *coeff);
+
+void rs_getRemainder(uint8_t degree, uint8_t *coeff, uint8_t *data, uint8_t length, uint8_t *result, uint8_t stride);
+
 
 
 #ifdef __cplusplus
@@ -0,0 +1,159 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018 Richard Moore <me@ricmoo.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+
+#include "firefly_qrcode_fountain.h"
+
+
+// The payload is read (and XOR'ed into a frame) this many bytes at a time
+#define READ_SIZE       8
+
+
+uint16_t qrfountain_checksum(uint16_t checksum, const uint8_t *data, uint16_t length) {
+    uint8_t sum1 = checksum & 0xff, sum2 = checksum >> 8;
+
+    while (length--) {
+        uint16_t value = sum1 + *data++;
+        sum1 = (value >= 255) ? (value - 255): value;
+        value = sum2 + sum1;
+        sum2 = (value >= 255) ? (value - 255): value;
+    }
+
+    return ((uint16_t)sum2 << 8) | sum1;
+}
+
+bool qrfountain_init(QRFountain *fountain, QRFountainReader reader, void *context, uint16_t length, uint8_t frameSize) {
+    if (length == 0 || frameSize <= QRFOUNTAIN_HEADER_SIZE) { return false; }
+
+    uint8_t blockSize = frameSize - QRFOUNTAIN_HEADER_SIZE;
+    uint32_t blockCount = ((uint32_t)length + blockSize - 1) / blockSize;
+    if (blockCount >= QRFOUNTAIN_NO_BLOCK) { return false; }
+
+    fountain->reader = reader;
+    fountain->context = context;
+    fountain->length = length;
+    fountain->blockSize = blockSize;
+    fountain->blockCount = blockCount;
+    fountain->index = 0;
+
+    uint16_t checksum = 0;
+    uint8_t buffer[READ_SIZE];
+    for (uint16_t offset = 0; offset < length; offset += READ_SIZE) {
+        uint8_t count = (length - offset < READ_SIZE) ? (length - offset): READ_SIZE;
+        reader(context, offset, buffer, count);
+        checksum = qrfountain_checksum(checksum, buffer, count);
+    }
+    fountain->checksum = checksum;
+
+    return true;
+}
+
+// The murmur3 finalizer; the blocks chosen must not be linear over GF(2) in the seed
+// (as with xorshift), or every frame would be a combination of the same 32 equations
+static uint32_t mix32(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x85ebca6b;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35;
+    x ^= x >> 16;
+    return x;
+}
+
+void qrfountain_beginBlocks(QRFountainBlocks *blocks, uint16_t checksum, uint16_t index, uint16_t blockCount) {
+    blocks->block = 0;
+    blocks->blockCount = blockCount;
+    blocks->bits = 0;
+
+    // The first blockCount frames carry just their own block
+    if (index < blockCount) {
+        blocks->random = false;
+        blocks->required = index;
+        return;
+    }
+
+    // Seeded by the checksum, so frames of different payloads never agree
+    blocks->random = true;
+    blocks->state = mix32((((uint32_t)checksum) << 16) | index);
+
+    // A frame of no blocks would be wasted, so one block is always included
+    blocks->required = mix32(blocks->state) % blockCount;
+}
+
+uint16_t qrfountain_nextBlock(QRFountainBlocks *blocks) {
+    while (blocks->block < blocks->blockCount) {
+        uint16_t block = blocks->block++;
+
+        bool included = false;
+        if (blocks->random) {
+            // Each 32 blocks; a Weyl sequence (from the seed) through the mix
+            if ((block & 31) == 0) {
+                blocks->state += 0x9e3779b9;
+                blocks->bits = mix32(blocks->state);
+            }
+            included = blocks->bits & 1;
+            blocks->bits >>= 1;
+        }
+
+        if (included || block == blocks->required) { return block; }
+    }
+
+    return QRFOUNTAIN_NO_BLOCK;
+}
+
+void qrfountain_getFrame(QRFountain *fountain, uint16_t index, uint8_t *frame) {
+    frame[0] = index >> 8;
+    frame[1] = index;
+    frame[2] = fountain->length >> 8;
+    frame[3] = fountain->length;
+    frame[4] = fountain->checksum >> 8;
+    frame[5] = fountain->checksum;
+
+    uint8_t blockSize = fountain->blockSize;
+    uint8_t *data = &frame[QRFOUNTAIN_HEADER_SIZE];
+    memset(data, 0, blockSize);
+
+    // XOR each block in, reading only the part of it within the payload
+    QRFountainBlocks blocks;
+    qrfountain_beginBlocks(&blocks, fountain->checksum, index, fountain->blockCount);
+
+    uint8_t buffer[READ_SIZE];
+    uint16_t block;
+    while ((block = qrfountain_nextBlock(&blocks)) != QRFOUNTAIN_NO_BLOCK) {
+        uint16_t offset = block * blockSize;
+        uint8_t length = (fountain->length - offset < blockSize) ? (fountain->length - offset): blockSize;
+
+        for (uint16_t i = 0; i < length; i += READ_SIZE) {
+            uint8_t count = (length - i < READ_SIZE) ? (length - i): READ_SIZE;
+            fountain->reader(fountain->context, offset + i, buffer, count);
+            for (uint8_t j = 0; j < count; j++) { data[i + j] ^= buffer[j]; }
+        }
+    }
+}
+
+uint16_t qrfountain_nextFrame(QRFountain *fountain, uint8_t *frame) {
+    uint16_t index = fountain->index++;
+    qrfountain_getFrame(fountain, index, frame);
+    return index;
+}
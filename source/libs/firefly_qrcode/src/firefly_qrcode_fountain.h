@@ -0,0 +1,129 @@
+/**
+ * MIT License
+ *
+ * Copyright (c) 2018 Richard Moore <me@ricmoo.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/**
+ *  QR Fountain
+ *
+ *  Splits a payload too large for one QR code into an endless sequence of frames,
+ *  each small enough for one, which are shown one after another (an animated QR
+ *  code). A receiver that catches any blockCount frames (or very nearly; see below)
+ *  can rebuild the payload, regardless of which frames it missed.
+ *
+ *  The payload is split into blockCount blocks of blockSize bytes (the last zero
+ *  padded). Each frame is:
+ *
+ *    index (2 bytes) | length (2 bytes) | checksum (2 bytes) | block (blockSize bytes)
+ *
+ *  all big-endian, where checksum is the Fletcher-16 of the payload. The first
+ *  blockCount frames each carry one block, in order. Every later frame carries the
+ *  XOR of a pseudo-random half of the blocks (see qrfountain_beginBlocks), so each
+ *  adds a new random equation over GF(2); a receiver solves for the blocks missed
+ *  once it has caught enough frames (on average, 1.6 more than the blocks missed).
+ *
+ *  Frames are generated from the payload as needed, through a reader callback, so
+ *  the payload is never copied and only one frame is kept in memory.
+ *
+ *  This is portable (no Arduino dependencies); see extras/qrfountain_simulate.c
+ *  for a reference decoder.
+ */
+
+#ifndef _FIREFLY_QRCODE_FOUNTAIN_H_
+#define _FIREFLY_QRCODE_FOUNTAIN_H_
+
+#include <stdint.h>
+
+#include "firefly_qrcode.h"
+
+
+// The frame header; index, length and checksum
+#define QRFOUNTAIN_HEADER_SIZE     6
+
+// Returned by qrfountain_nextBlock once there are no more blocks in a frame
+#define QRFOUNTAIN_NO_BLOCK        0xffff
+
+
+// Copies length bytes of the payload at offset into buffer
+typedef void (*QRFountainReader)(void *context, uint16_t offset, uint8_t *buffer, uint8_t length);
+
+typedef struct QRFountain {
+    // The payload (read as needed; must remain valid while generating frames)
+    QRFountainReader reader;
+    void *context;
+    uint16_t length;
+
+    // The bytes of payload in each frame, and the number of blocks
+    uint8_t blockSize;
+    uint16_t blockCount;
+
+    // The Fletcher-16 of the payload
+    uint16_t checksum;
+
+    // The next frame qrfountain_nextFrame generates
+    uint16_t index;
+} QRFountain;
+
+// Which blocks a frame carries (see qrfountain_beginBlocks)
+typedef struct QRFountainBlocks {
+    uint32_t state;
+    uint32_t bits;
+    bool random;
+    uint16_t block;
+    uint16_t blockCount;
+    uint16_t required;
+} QRFountainBlocks;
+
+
+#ifdef __cplusplus
+extern "C"{
+#endif  /* __cplusplus */
+
+
+// Prepares to generate frames of frameSize bytes (including the header) of the payload,
+// reading it once to compute the checksum; returns false if the payload is empty, the
+// frame cannot hold any payload or there would be more than 65535 blocks
+bool qrfountain_init(QRFountain *fountain, QRFountainReader reader, void *context, uint16_t length, uint8_t frameSize);
+
+// Writes frame index (QRFOUNTAIN_HEADER_SIZE + blockSize bytes) into frame
+void qrfountain_getFrame(QRFountain *fountain, uint16_t index, uint8_t *frame);
+
+// Writes the next frame into frame, returning its index
+uint16_t qrfountain_nextFrame(QRFountain *fountain, uint8_t *frame);
+
+// The blocks XOR'ed into frame index of a payload with checksum, in ascending order;
+// call qrfountain_nextBlock until it returns QRFOUNTAIN_NO_BLOCK. A frame past the
+// first blockCount includes each block with probability 1/2 (and at least one), from
+// a hash of the checksum and index.
+void qrfountain_beginBlocks(QRFountainBlocks *blocks, uint16_t checksum, uint16_t index, uint16_t blockCount);
+uint16_t qrfountain_nextBlock(QRFountainBlocks *blocks);
+
+// The Fletcher-16 checksum of data, continued from checksum (0 to begin)
+uint16_t qrfountain_checksum(uint16_t checksum, const uint8_t *data, uint16_t length);
+
+
+#ifdef __cplusplus
+}
+#endif  /* __cplusplus */
+
+
+#endif  /* _FIREFLY_QRCODE_FOUNTAIN_H_ */